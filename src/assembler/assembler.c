@@ -0,0 +1,231 @@
+/*
+  License: DOWHATEVERYOUWANT
+
+  Assembles Intel8080 source into a binary image
+
+  The opcodes come from the libi8080 table the disassembler writes from,
+  so a listing of the disassembler(with or without labels) assembles
+  back into the image it was made from. The image covers the lowest to
+  the highest address assembled, ORG and DS gaps are zeros
+
+  -t assembles the regression cases below and checks what comes out
+
+  Usage:
+    gcc -O2 assembler.c ../libi8080/i8080.c -o assembler
+    ./assembler [-o image.bin] source.asm
+    ./assembler -t
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../libi8080/i8080.h"
+
+
+/* Definitions */
+#define DEFAULT_OUTPUT "a.bin"
+
+
+/* Struct definitions */
+/* Regression case: source and the bytes it assembles to at address 0 */
+typedef struct Case {
+  const char *source;
+  const char *bytes;
+  int size; // Bytes, -1 when the source must be refused
+} Case;
+
+
+/* Function declarations */
+char *ReadSource(const char *filename);
+void ReportError(const char *filename, const char *source, int line,
+                 int error);
+int RunCases(void);
+
+
+/* Regression cases(-t) */
+const Case Cases[] = {
+  { "X EQU 5\nMVI A,X\n", "\x3e\x05", 2 },
+  /* EQU of a symbol defined below, lines above would have used 0 */
+  { "MVI A,X\nX EQU Y\nY: NOP\n", NULL, -1 },
+  { "Y: NOP\nX EQU Y+1\nJMP X\n", "\x00\xc3\x01\x00", 4 },
+  { "DB \"A\",'B'\nMVI A,\"C\"\n", "\x41\x42\x3e\x43", 4 },
+  { "DB 'it''s',\"\"\"\"\n", "it's\"", 5 },
+  { "DB 'a'+1\n", "b", 1 },
+};
+
+
+int main(int argc, char **argv)
+{
+  const char *input = NULL;
+  const char *output = DEFAULT_OUTPUT;
+
+  /* Parse options: -o names the image */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    }
+    else if (strcmp(argv[i], "-t") == 0) {
+      return RunCases() == 0 ? 0 : EXIT_FAILURE;
+    }
+    else if (argv[i][0] != '-' && input == NULL) {
+      input = argv[i];
+    }
+    else {
+      input = NULL;
+      break;
+    }
+  }
+  if (input == NULL) {
+    fprintf(stderr, "Usage: %s [-o image.bin] source.asm | -t\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  char *source = ReadSource(input);
+  if (source == NULL) {
+    fprintf(stderr, "Can't read %s\n", input);
+    exit(EXIT_FAILURE);
+  }
+
+  uint8_t *memory = calloc(1, 0x10000);
+  uint32_t low, high;
+  int line;
+  int error = memory != NULL ?
+              Assemble(source, memory, &low, &high, &line) :
+              I8080_ERROR_MEMORY;
+  if (error != I8080_OK) {
+    ReportError(input, source, line, error);
+    exit(EXIT_FAILURE);
+  }
+
+  FILE *fp = fopen(output, "wb");
+  if (fp == NULL || fwrite(memory + low, 1, high - low, fp) != high - low ||
+      fclose(fp) != 0) {
+    fprintf(stderr, "Can't write %s\n", output);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr, "%s: %u bytes, $%04x-$%04x\n", output, high - low, low,
+          high > low ? high - 1 : low);
+
+  free(memory);
+  free(source);
+
+  return 0;
+}
+
+
+/* Function implementation */
+
+/*
+ * Function: ReadSource
+ * --------------------
+ *  Reads a whole text file
+ *
+ *  filename: name of the file
+ *
+ *  returns: the text, NULL if it can't be read
+ */
+char *ReadSource(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return NULL;
+  }
+
+  char *text = NULL;
+  size_t size = 0;
+  size_t room = 0;
+  size_t got;
+  do {
+    if (room - size < 4096) {
+      room = room * 2 + 4096;
+      char *grown = realloc(text, room + 1);
+      if (grown == NULL) {
+        free(text);
+        fclose(fp);
+        return NULL;
+      }
+      text = grown;
+    }
+    got = fread(text + size, 1, room - size, fp);
+    size += got;
+  } while (got > 0);
+
+  if (ferror(fp)) {
+    free(text);
+    text = NULL;
+  }
+  else {
+    text[size] = '\0';
+  }
+  fclose(fp);
+
+  return text;
+}
+
+/*
+ * Function: ReportError
+ * ---------------------
+ *  Prints why the source can't be assembled, with the line at fault
+ *
+ *  filename: name of the source
+ *  source: its text
+ *  line: number of the line at fault
+ *  error: error code returned by Assemble
+ *
+ *  returns: void
+ */
+void ReportError(const char *filename, const char *source, int line,
+                 int error)
+{
+  const char *reason = error == I8080_ERROR_SIZE ? "code past 64 KB" :
+                       error == I8080_ERROR_MEMORY ? "out of memory" :
+                       "can't assemble";
+
+  for (int i = 1; i < line && source != NULL; i++) {
+    source = strchr(source, '\n');
+    source = source != NULL ? source + 1 : NULL;
+  }
+  fprintf(stderr, "%s:%d: %s\n", filename, line, reason);
+  if (source != NULL && line > 0) {
+    fprintf(stderr, "  %.*s\n", (int)strcspn(source, "\n"), source);
+  }
+}
+
+/*
+ * Function: RunCases
+ * ------------------
+ *  Assembles every regression case and compares the result with what
+ *  it should be, printing the cases that fail
+ *
+ *  returns: number of cases failed
+ */
+int RunCases(void)
+{
+  int ncases = sizeof(Cases) / sizeof(Cases[0]);
+  int failed = 0;
+  uint8_t *memory = calloc(1, 0x10000);
+  if (memory == NULL) {
+    fprintf(stderr, "Can't allocate memory\n");
+    return 1;
+  }
+
+  for (int i = 0; i < ncases; i++) {
+    const Case *test = &Cases[i];
+    uint32_t low, high;
+    int line;
+    int error = Assemble(test->source, memory, &low, &high, &line);
+    int passed = test->size < 0 ? error != I8080_OK :
+                 error == I8080_OK && low == 0 &&
+                 high == (uint32_t)test->size &&
+                 memcmp(memory, test->bytes, test->size) == 0;
+    if (!passed) {
+      fprintf(stderr, "Case %d failed(error %d, line %d):\n%s", i + 1,
+              error, line, test->source);
+      failed++;
+    }
+  }
+  fprintf(stderr, "%d of %d cases passed\n", ncases - failed, ncases);
+  free(memory);
+
+  return failed;
+}
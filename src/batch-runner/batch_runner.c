@@ -0,0 +1,619 @@
+/*
+  License: DOWHATEVERYOUWANT
+
+  Batch runner for many short 8080 jobs in one process
+
+  Reads a job list, loads every ROM image once, then runs the jobs on a
+  pool of worker threads(one per core by default). Each worker owns a
+  preallocated machine and 64 KB of memory that are reused job after job,
+  and takes its jobs from its own share of the list, stealing from the
+  others once it runs dry. Results are printed in job order
+
+  Job list, one job per line(# starts a comment):
+    name [image=file[@addr]]... [pc=addr] [patch=addr:value]... [cpm]
+         [limit=instructions] [repeat=copies] [record=log] [replay=log]
+         [interrupt=vector:period[:first]]...
+
+  cpm loads images at 0x100 by default, starts there, serves the BDOS
+  print calls and stops at the warm boot, like full_emulator
+  record logs every value the job reads from its ports, replay feeds a
+  logged session back and stops the job if it strays from it
+  interrupt raises RST vector every period cycles, first at cycle first
+  (period by default)
+
+  Usage:
+    ./batch_runner [-j threads] jobs.txt
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "../libi8080/i8080.h"
+
+
+/* Definitions */
+#define MAX_IMAGES 8 // Images loaded by one job
+#define MAX_PATCHES 16 // Bytes patched by one job
+#define MAX_FILES 256 // Distinct image files of the job list
+#define NAME_SIZE 64
+#define PATH_SIZE 256
+#define CONSOLE_SIZE 256 // Console output kept per job
+#define DEFAULT_LIMIT 100000000 // Instructions run by a job that never stops
+
+/* CP/M entry points, both hold a HLT so the runner takes over */
+#define BOOT 0x0000
+#define BDOS 0x0005
+
+
+/* Struct definitions */
+typedef struct Image {
+  char *filename;
+  uint8_t *bytes; // Contents, read once for all jobs
+  int size;
+} Image;
+
+typedef struct Job {
+  char name[NAME_SIZE];
+  int images[MAX_IMAGES]; // Index in the loaded images
+  int origins[MAX_IMAGES]; // Load address, -1 for the default
+  int nimages;
+  uint16_t patches[MAX_PATCHES][2]; // Address and value
+  int npatches;
+  uint32_t interrupts[I8080_SCHEDULED][3]; // Vector, period, first cycle
+  int ninterrupts;
+  int pc; // Start address, -1 for the default
+  int cpm; // CP/M program
+  uint64_t limit; // Maximum number of instructions
+  char record[PATH_SIZE]; // Input log to write, empty for none
+  char replay[PATH_SIZE]; // Input log to replay, empty for none
+
+  /* Results */
+  const char *reason; // Why the job stopped
+  States final; // Registers when it stopped
+  uint64_t executed; // Instructions executed
+  double seconds; // Wall time
+  char console[CONSOLE_SIZE]; // BDOS output
+  int console_size;
+  uint64_t events; // Input events recorded or replayed
+} Job;
+
+typedef struct Worker {
+  _Alignas(64) _Atomic uint64_t range; // First and end job of its share
+  int id;
+  pthread_t thread;
+  struct Pool *pool;
+  uint64_t jobs; // Jobs run
+  uint64_t stolen; // Jobs taken from another worker
+  States state; // Machine reused by every job
+  uint8_t memory[0x10000]; // Memory of the machine
+  uint8_t image[0x10000]; // Initial memory of the job being set up
+} Worker;
+
+typedef struct Pool {
+  Worker *workers;
+  int nworkers;
+  Job *jobs;
+} Pool;
+
+
+/* Loaded image files */
+Image Images[MAX_FILES];
+int nimages = 0;
+
+
+/* Function declarations */
+double Seconds(void);
+int LoadImage(const char *filename);
+Job *ReadJobs(const char *filename, int *njobs);
+void BuildImage(const Job *job, uint8_t *image);
+void Bdos(Job *job, States *state);
+void RunJob(Worker *worker, Job *job);
+int NextJob(Pool *pool, Worker *self);
+void *WorkerMain(void *arg);
+void PrintResult(const Job *job);
+
+
+int main(int argc, char **argv)
+{
+  int nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+  char *joblist = NULL;
+
+  /* Parse options: -j N runs N worker threads */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      nworkers = atoi(argv[++i]);
+    }
+    else if (argv[i][0] != '-' && joblist == NULL) {
+      joblist = argv[i];
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-j threads] jobs.txt\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (joblist == NULL) {
+    fprintf(stderr, "Usage: %s [-j threads] jobs.txt\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  int njobs = 0;
+  Job *jobs = ReadJobs(joblist, &njobs);
+  if (nworkers < 1) {
+    nworkers = 1;
+  }
+  if (nworkers > njobs) {
+    nworkers = njobs > 0 ? njobs : 1;
+  }
+
+  /* Preallocate the workers, each getting a contiguous share of jobs */
+  Pool pool = { NULL, nworkers, jobs };
+  pool.workers = aligned_alloc(64, sizeof(Worker) * nworkers);
+  if (pool.workers == NULL) {
+    fprintf(stderr, "Can't allocate %d workers\n", nworkers);
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < nworkers; i++) {
+    Worker *worker = &pool.workers[i];
+    uint64_t first = (uint64_t)njobs * i / nworkers;
+    uint64_t end = (uint64_t)njobs * (i + 1) / nworkers;
+
+    memset(worker, 0, sizeof(Worker));
+    atomic_init(&worker->range, first << 32 | end);
+    worker->id = i;
+    worker->pool = &pool;
+    InitState(&worker->state, worker->memory);
+    if (AttachJit(&worker->state) != I8080_OK) {
+      AttachBlockCache(&worker->state);
+    }
+  }
+
+  double start = Seconds();
+  for (int i = 0; i < nworkers; i++) {
+    if (pthread_create(&pool.workers[i].thread, NULL, WorkerMain,
+                       &pool.workers[i]) != 0) {
+      fprintf(stderr, "Can't start worker %d\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i < nworkers; i++) {
+    pthread_join(pool.workers[i].thread, NULL);
+  }
+  double elapsed = Seconds() - start;
+
+  uint64_t executed = 0;
+  uint64_t stolen = 0;
+  for (int i = 0; i < njobs; i++) {
+    PrintResult(&jobs[i]);
+    executed += jobs[i].executed;
+  }
+  for (int i = 0; i < nworkers; i++) {
+    stolen += pool.workers[i].stolen;
+    ReleaseState(&pool.workers[i].state);
+  }
+
+  fprintf(stderr, "%d jobs on %d threads in %.3f s: %llu instructions "
+          "(%.2f MIPS), %llu jobs stolen\n",
+          njobs, nworkers, elapsed, (unsigned long long)executed,
+          executed / elapsed / 1e6, (unsigned long long)stolen);
+
+  free(pool.workers);
+  free(jobs);
+  for (int i = 0; i < nimages; i++) {
+    free(Images[i].filename);
+    free(Images[i].bytes);
+  }
+
+  return 0;
+}
+
+
+/* Function implementation */
+
+/*
+ * Function: Seconds
+ * -----------------
+ *  Reads the monotonic clock
+ *
+ *  returns: current time in seconds
+ */
+double Seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Function: LoadImage
+ * -------------------
+ *  Reads an image file, once for every job using it
+ *
+ *  filename: name of the file
+ *
+ *  returns: index of the image - exits if the file can't be read
+ */
+int LoadImage(const char *filename)
+{
+  for (int i = 0; i < nimages; i++) {
+    if (strcmp(Images[i].filename, filename) == 0) {
+      return i;
+    }
+  }
+  if (nimages == MAX_FILES) {
+    fprintf(stderr, "More than %d image files\n", MAX_FILES);
+    exit(EXIT_FAILURE);
+  }
+
+  Image *image = &Images[nimages];
+  image->bytes = malloc(0x10000);
+  int size = ReadIntoMemory(image->bytes, filename, 0);
+  if (size < 0) {
+    fprintf(stderr, "Can't read %s(error %d)\n", filename, size);
+    exit(EXIT_FAILURE);
+  }
+  image->size = size;
+  image->filename = strdup(filename);
+
+  return nimages++;
+}
+
+/*
+ * Function: ReadJobs
+ * ------------------
+ *  Parses the job list and loads the images it names
+ *
+ *  filename: name of the job list
+ *  njobs: set to the number of jobs
+ *
+ *  returns: array of jobs - exits on a malformed list
+ */
+Job *ReadJobs(const char *filename, int *njobs)
+{
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Can't open %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  Job *jobs = NULL;
+  int count = 0;
+  int room = 0;
+  char line[1024];
+  int number = 0;
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    Job job;
+    int repeat = 1;
+    char *token = strtok(line, " \t\r\n");
+
+    number++;
+    if (token == NULL || token[0] == '#') {
+      continue;
+    }
+    memset(&job, 0, sizeof(Job));
+    snprintf(job.name, NAME_SIZE, "%s", token);
+    job.pc = -1;
+    job.limit = DEFAULT_LIMIT;
+
+    while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+      if (token[0] == '#') {
+        break;
+      }
+      else if (strncmp(token, "image=", 6) == 0 && job.nimages < MAX_IMAGES) {
+        char *at = strchr(token + 6, '@');
+        job.origins[job.nimages] = -1;
+        if (at != NULL) {
+          *at = '\0';
+          job.origins[job.nimages] = strtoul(at + 1, NULL, 0) & 0xffff;
+        }
+        job.images[job.nimages++] = LoadImage(token + 6);
+      }
+      else if (strncmp(token, "patch=", 6) == 0 &&
+               job.npatches < MAX_PATCHES) {
+        char *value;
+        job.patches[job.npatches][0] = strtoul(token + 6, &value, 0);
+        job.patches[job.npatches][1] = strtoul(value + (*value == ':'),
+                                               NULL, 0);
+        job.npatches++;
+      }
+      else if (strncmp(token, "interrupt=", 10) == 0 &&
+               job.ninterrupts < I8080_SCHEDULED) {
+        uint32_t *interrupt = job.interrupts[job.ninterrupts++];
+        char *value;
+        interrupt[0] = strtoul(token + 10, &value, 0);
+        interrupt[1] = strtoul(value + (*value == ':'), &value, 0);
+        interrupt[2] = *value == ':' ? strtoul(value + 1, NULL, 0)
+                                     : interrupt[1];
+      }
+      else if (strncmp(token, "pc=", 3) == 0) {
+        job.pc = strtoul(token + 3, NULL, 0) & 0xffff;
+      }
+      else if (strncmp(token, "limit=", 6) == 0) {
+        job.limit = strtoull(token + 6, NULL, 0);
+      }
+      else if (strncmp(token, "repeat=", 7) == 0) {
+        repeat = atoi(token + 7);
+      }
+      else if (strncmp(token, "record=", 7) == 0) {
+        snprintf(job.record, PATH_SIZE, "%s", token + 7);
+      }
+      else if (strncmp(token, "replay=", 7) == 0) {
+        snprintf(job.replay, PATH_SIZE, "%s", token + 7);
+      }
+      else if (strcmp(token, "cpm") == 0) {
+        job.cpm = 1;
+      }
+      else {
+        fprintf(stderr, "%s:%d: unknown option %s\n", filename, number,
+                token);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    if (job.record[0] != '\0' && (repeat > 1 || job.replay[0] != '\0')) {
+      fprintf(stderr, "%s:%d: a recorded job can't be repeated or "
+              "replayed\n", filename, number);
+      exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < repeat; i++) {
+      if (count == room) {
+        room = room ? room * 2 : 64;
+        jobs = realloc(jobs, sizeof(Job) * room);
+        if (jobs == NULL) {
+          fprintf(stderr, "Can't allocate %d jobs\n", room);
+          exit(EXIT_FAILURE);
+        }
+      }
+      jobs[count++] = job;
+    }
+  }
+  fclose(fp);
+
+  *njobs = count;
+  return jobs;
+}
+
+/*
+ * Function: BuildImage
+ * --------------------
+ *  Lays out the initial memory of a job
+ *
+ *  job: job to set up
+ *  image: 64 KB receiving the memory contents
+ *
+ *  returns: void
+ */
+void BuildImage(const Job *job, uint8_t *image)
+{
+  uint32_t next = job->cpm ? 0x100 : 0; // Images follow each other
+
+  memset(image, 0, 0x10000);
+  for (int i = 0; i < job->nimages; i++) {
+    const Image *file = &Images[job->images[i]];
+    uint32_t origin = job->origins[i] >= 0 ? (uint32_t)job->origins[i] : next;
+    uint32_t size = file->size;
+
+    if (origin + size > 0x10000) {
+      size = 0x10000 - origin;
+    }
+    memcpy(&image[origin], file->bytes, size);
+    next = origin + size;
+  }
+  for (int i = 0; i < job->npatches; i++) {
+    image[job->patches[i][0]] = job->patches[i][1];
+  }
+  if (job->cpm) {
+    image[BOOT] = 0x76; // Warm boot lands on HLT
+    image[BDOS] = 0x76; // BDOS calls land on HLT
+  }
+}
+
+/*
+ * Function: Bdos
+ * --------------
+ *  CP/M system call, reached when the processor halts on the HLT at BDOS
+ *  C = 9 prints the string at DE(up to '$'), C = 2 prints a character
+ *  The output is kept with the job, then the call returns
+ *
+ *  job: job being run
+ *  state: state of Intel8080 machine
+ *
+ *  returns: void
+ */
+void Bdos(Job *job, States *state)
+{
+  char text[CONSOLE_SIZE];
+  int size = 0;
+
+  if (state->c == 9) {
+    uint16_t addr = ((state->d << 8) | state->e) + 3;
+    while (state->memory[addr] != '$' && size < CONSOLE_SIZE - 2) {
+      text[size++] = state->memory[addr++];
+    }
+    text[size++] = '\n';
+  }
+  else if (state->c == 2) {
+    size = snprintf(text, sizeof(text), "Print routine called\n");
+  }
+  if (size > CONSOLE_SIZE - 1 - job->console_size) {
+    size = CONSOLE_SIZE - 1 - job->console_size;
+  }
+  memcpy(&job->console[job->console_size], text, size);
+  job->console_size += size;
+  job->console[job->console_size] = '\0';
+
+  state->pc = state->memory[state->sp] |
+              (state->memory[(uint16_t)(state->sp + 1)] << 8);
+  state->sp += 2;
+  state->halted = 0;
+}
+
+/*
+ * Function: RunJob
+ * ----------------
+ *  Runs a job on the machine of a worker
+ *  Only the bytes that differ from the previous job are rewritten, so
+ *  jobs running the same ROM keep its decoded or translated blocks
+ *
+ *  worker: worker running the job
+ *  job: job to run, receives the results
+ *
+ *  returns: void
+ */
+void RunJob(Worker *worker, Job *job)
+{
+  States *state = &worker->state;
+  double start = Seconds();
+
+  BuildImage(job, worker->image);
+  CopyIntoMemory(state, worker->image);
+  ResetState(state);
+  state->pc = job->pc >= 0 ? job->pc : (job->cpm ? 0x100 : 0);
+  for (int i = 0; i < job->ninterrupts; i++) {
+    ScheduleInterrupt(state, job->interrupts[i][2], job->interrupts[i][1],
+                      job->interrupts[i][0]);
+  }
+
+  job->reason = "limit";
+  int error = I8080_OK;
+  if (job->record[0] != '\0') {
+    error = StartRecording(state, job->record);
+  }
+  else if (job->replay[0] != '\0') {
+    error = StartReplay(state, job->replay);
+  }
+  if (error != I8080_OK) {
+    job->reason = "log";
+    state->error = error;
+  }
+
+  while (job->executed < job->limit && state->error == I8080_OK) {
+    job->executed += Emulator(state, job->limit - job->executed);
+    if (state->error != I8080_OK) {
+      job->reason = "error";
+      break;
+    }
+    if (!state->halted) {
+      continue;
+    }
+    if (job->cpm && state->pc == BDOS + 1) {
+      Bdos(job, state);
+      continue;
+    }
+    job->reason = job->cpm && state->pc == BOOT + 1 ? "boot" : "halted";
+    break;
+  }
+  if (StopRecorder(state, &job->events) != I8080_OK) {
+    job->reason = "log";
+  }
+
+  job->final = *state;
+  job->seconds = Seconds() - start;
+}
+
+/*
+ * Function: NextJob
+ * -----------------
+ *  Takes the next job of a worker: the last one of its own share, or
+ *  the first one of another worker's share once its own is empty
+ *  A share is a range packed in one atomic word(first << 32 | end), so
+ *  both ends are taken with a compare and swap
+ *
+ *  pool: workers and jobs
+ *  self: worker asking for a job
+ *
+ *  returns: index of the job, -1 when every job has been taken
+ */
+int NextJob(Pool *pool, Worker *self)
+{
+  uint64_t range = atomic_load(&self->range);
+
+  while ((range >> 32) < (range & 0xffffffff)) {
+    uint64_t end = (range & 0xffffffff) - 1;
+    if (atomic_compare_exchange_weak(&self->range, &range,
+                                     (range & ~0xffffffffull) | end)) {
+      return end;
+    }
+  }
+
+  for (int i = 1; i < pool->nworkers; i++) {
+    Worker *victim = &pool->workers[(self->id + i) % pool->nworkers];
+
+    range = atomic_load(&victim->range);
+    while ((range >> 32) < (range & 0xffffffff)) {
+      uint64_t first = range >> 32;
+      if (atomic_compare_exchange_weak(&victim->range, &range,
+                                       range + (1ull << 32))) {
+        self->stolen++;
+        return first;
+      }
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * Function: WorkerMain
+ * --------------------
+ *  Thread of a worker, running jobs until none is left
+ *
+ *  arg: the worker
+ *
+ *  returns: NULL
+ */
+void *WorkerMain(void *arg)
+{
+  Worker *worker = arg;
+  int job;
+
+  while ((job = NextJob(worker->pool, worker)) >= 0) {
+    RunJob(worker, &worker->pool->jobs[job]);
+    worker->jobs++;
+  }
+
+  return NULL;
+}
+
+/*
+ * Function: PrintResult
+ * ---------------------
+ *  Prints the outcome of a job: why it stopped, its counters, the final
+ *  registers and its console output
+ *
+ *  job: finished job
+ *
+ *  returns: void
+ */
+void PrintResult(const Job *job)
+{
+  const States *state = &job->final;
+
+  printf("%s: %s after %llu instructions, %llu cycles in %.3f ms\n",
+         job->name, job->reason, (unsigned long long)job->executed,
+         (unsigned long long)state->cycles, job->seconds * 1e3);
+  printf("  Final state: A=$%02x BC=$%02x%02x DE=$%02x%02x "
+         "HL=$%02x%02x SP=$%04x PC=$%04x PSW=$%02x\n",
+         state->a, state->b, state->c, state->d, state->e, state->h,
+         state->l, state->sp, state->pc, state->cc.psw);
+  if (state->error != I8080_OK) {
+    printf("  Error: %d\n", state->error);
+  }
+  if (job->record[0] != '\0' || job->replay[0] != '\0') {
+    printf("  Input log: %llu events %s %s\n",
+           (unsigned long long)job->events,
+           job->record[0] != '\0' ? "recorded to" : "replayed from",
+           job->record[0] != '\0' ? job->record : job->replay);
+  }
+  for (const char *text = job->console; *text != '\0'; ) {
+    const char *end = strchr(text, '\n');
+    int size = end != NULL ? end - text : (int)strlen(text);
+    printf("  Console: %.*s\n", size, text);
+    text += size + (end != NULL);
+  }
+}
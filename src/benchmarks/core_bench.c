@@ -0,0 +1,643 @@
+/*
+  License: DOWHATEVERYOUWANT
+
+  CPU core benchmark
+
+  Runs the Emulator() core on synthetic workloads assembled from the
+  sources in workloads(register moves, ALU with flags, memory through
+  HL, PUSH and POP, CALL and RET chains, conditional branches), on the CPU
+  diagnostic and on the Space Invaders attract mode from power on, and
+  reports emulated MIPS, nanoseconds and host clock cycles per emulated
+  instruction as JSON, to be compared from build to build
+
+  Every workload runs a number of instructions once to warm the core up,
+  then as many more times as asked, the fastest run is reported along
+  with the median. Host cycles come from the CPU cycle counter of the
+  kernel(perf events), or the time stamp counter when it can't be read
+
+  Usage:
+    gcc -O2 [-DTHREADED_DISPATCH] [-DBLOCK_CACHE] [-DJIT] core_bench.c
+        ../libi8080/i8080.c -o core_bench
+    ./core_bench [-n instructions] [-r repeats] [-o results.json]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "../libi8080/i8080.h"
+
+
+/* Definitions */
+#define WORKLOAD_PATH "workloads/"
+#define CPUDIAG_FILE "../full-emulator/cpudiag.bin"
+#define ROM_PATH "../spaceinvader-emulator/invaders."
+#define MAX_REPEATS 100
+
+/* CP/M entry points of the diagnostic, both hold a HLT */
+#define BOOT 0x0000
+#define BDOS 0x0005
+
+/* Space Invaders cabinet */
+#define CYCLES_PER_FRAME 33333 // 2 MHz at 60 Hz
+#define PORT_SHIFT_AMOUNT 2
+#define PORT_SHIFT_RESULT 3
+#define PORT_SHIFT_DATA 4
+
+/* Kinds of workload */
+#define KIND_SYNTHETIC 0 // Assembled, loops forever
+#define KIND_CPUDIAG 1 // Repeated until enough instructions ran
+#define KIND_INVADERS 2 // Attract mode from power on
+
+
+/* Struct definitions */
+typedef struct Workload {
+  const char *name;
+  int kind; // KIND_*
+} Workload;
+
+/* Machine a workload runs on, and the memory it starts from */
+typedef struct Bench {
+  States state;
+  uint8_t *memory;
+  uint8_t *image; // Memory at power on
+  Ports ports;
+  uint8_t inputs[3]; // Cabinet ports 0-2, nothing pressed
+  uint16_t shift; // Shift register of the cabinet
+  uint8_t amount; // Its shift amount
+} Bench;
+
+/* Host cycle counter */
+typedef struct Counter {
+  const char *source; // "perf", "tsc" or "none"
+  int fd; // perf event, -1 without
+} Counter;
+
+/* Timing of one run */
+typedef struct Run {
+  uint64_t instructions;
+  uint64_t cycles; // Emulated clock cycles
+  double seconds;
+  uint64_t host_cycles;
+} Run;
+
+
+/* Function declarations */
+int Prepare(Bench *bench, const Workload *workload);
+void Start(Bench *bench, const Workload *workload);
+void Measure(Bench *bench, const Workload *workload, uint64_t count,
+             Counter *counter, Run *run);
+char *ReadSource(const char *filename);
+uint8_t ReadInput(void *context, uint8_t port);
+void WriteShiftAmount(void *context, uint8_t port, uint8_t value);
+void WriteShiftData(void *context, uint8_t port, uint8_t value);
+uint8_t ReadShiftResult(void *context, uint8_t port);
+void OpenCounter(Counter *counter);
+uint64_t ReadCounter(const Counter *counter);
+int CompareRuns(const void *a, const void *b);
+const char *CoreName(void);
+double Seconds(void);
+
+
+/* Workloads, in the order they're reported */
+const Workload Workloads[] = {
+  { "registers", KIND_SYNTHETIC },
+  { "alu", KIND_SYNTHETIC },
+  { "memory", KIND_SYNTHETIC },
+  { "stack", KIND_SYNTHETIC },
+  { "calls", KIND_SYNTHETIC },
+  { "branch", KIND_SYNTHETIC },
+  { "cpudiag", KIND_CPUDIAG },
+  { "invaders", KIND_INVADERS },
+};
+#define NWORKLOADS (int)(sizeof(Workloads) / sizeof(Workloads[0]))
+
+
+int main(int argc, char **argv)
+{
+  uint64_t count = 20000000; // Instructions of a run
+  int repeats = 5; // Timed runs of every workload
+  const char *output = NULL; // JSON file, stdout by default
+
+  /* Parse options */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      count = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      repeats = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-n instructions] [-r repeats] "
+              "[-o results.json]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (repeats < 1) {
+    repeats = 1;
+  }
+  if (repeats > MAX_REPEATS) {
+    repeats = MAX_REPEATS;
+  }
+
+  FILE *fp = output != NULL ? fopen(output, "w") : stdout;
+  Bench *bench = malloc(sizeof(Bench));
+  if (fp == NULL || bench == NULL) {
+    fprintf(stderr, "Can't open %s\n", output);
+    exit(EXIT_FAILURE);
+  }
+  Counter counter;
+  OpenCounter(&counter);
+
+  fprintf(fp, "{\n  \"benchmark\": \"core_bench\",\n  \"core\": \"%s\",\n",
+          CoreName());
+  fprintf(fp, "  \"instructions_per_run\": %llu,\n  \"repeats\": %d,\n",
+          (unsigned long long)count, repeats);
+  fprintf(fp, "  \"cycle_counter\": \"%s\",\n  \"workloads\": [",
+          counter.source);
+
+  int failed = 0;
+  for (int w = 0; w < NWORKLOADS; w++) {
+    const Workload *workload = &Workloads[w];
+    if (Prepare(bench, workload) < 0) {
+      exit(EXIT_FAILURE);
+    }
+
+    /* Warm up, then the timed runs from the same start */
+    Run runs[MAX_REPEATS];
+    Measure(bench, workload, count, &counter, &runs[0]);
+    for (int i = 0; i < repeats; i++) {
+      Measure(bench, workload, count, &counter, &runs[i]);
+    }
+    if (bench->state.error != I8080_OK) {
+      fprintf(stderr, "%s stopped with error %d\n", workload->name,
+              bench->state.error);
+      failed = 1;
+    }
+    qsort(runs, repeats, sizeof(Run), CompareRuns);
+    const Run *best = &runs[0];
+    const Run *median = &runs[repeats / 2];
+
+    fprintf(fp, "%s\n    {\n      \"name\": \"%s\",\n", w > 0 ? "," : "",
+            workload->name);
+    fprintf(fp, "      \"instructions\": %llu,\n"
+            "      \"emulated_cycles\": %llu,\n"
+            "      \"seconds\": %.6f,\n      \"median_seconds\": %.6f,\n",
+            (unsigned long long)best->instructions,
+            (unsigned long long)best->cycles, best->seconds,
+            median->seconds);
+    fprintf(fp, "      \"mips\": %.3f,\n      \"median_mips\": %.3f,\n"
+            "      \"ns_per_instruction\": %.3f,\n",
+            best->instructions / best->seconds / 1e6,
+            median->instructions / median->seconds / 1e6,
+            best->seconds * 1e9 / best->instructions);
+    if (counter.fd >= 0 || strcmp(counter.source, "tsc") == 0) {
+      fprintf(fp, "      \"host_cycles_per_instruction\": %.3f,\n",
+              (double)best->host_cycles / best->instructions);
+    }
+    else {
+      fprintf(fp, "      \"host_cycles_per_instruction\": null,\n");
+    }
+    fprintf(fp, "      \"speed_vs_2mhz\": %.1f\n    }",
+            best->cycles / best->seconds / 2e6);
+
+    fprintf(stderr, "%-10s %8.2f MIPS %7.2f ns/instruction\n",
+            workload->name, best->instructions / best->seconds / 1e6,
+            best->seconds * 1e9 / best->instructions);
+    ReleaseState(&bench->state);
+    free(bench->memory);
+    free(bench->image);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+
+  if (output != NULL && fclose(fp) != 0) {
+    fprintf(stderr, "Can't write %s\n", output);
+    failed = 1;
+  }
+#ifdef __linux__
+  if (counter.fd >= 0) {
+    close(counter.fd);
+  }
+#endif
+  free(bench);
+
+  return failed ? EXIT_FAILURE : 0;
+}
+
+
+/* Function implementation */
+
+/*
+ * Function: Prepare
+ * -----------------
+ *  Builds the power on memory of a workload and a machine on the fastest
+ *  core built into the library
+ *
+ *  bench: machine to prepare
+ *  workload: workload it runs
+ *
+ *  returns: 0 on success, -1 after printing why it failed
+ */
+int Prepare(Bench *bench, const Workload *workload)
+{
+  memset(bench, 0, sizeof(Bench));
+  bench->memory = calloc(1, 0x10000);
+  bench->image = calloc(1, 0x10000);
+  if (bench->memory == NULL || bench->image == NULL) {
+    fprintf(stderr, "Can't allocate memory\n");
+    return -1;
+  }
+
+  if (workload->kind == KIND_SYNTHETIC) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s%s.asm", WORKLOAD_PATH,
+             workload->name);
+    char *source = ReadSource(filename);
+    uint32_t low, high;
+    int line;
+    if (source == NULL) {
+      fprintf(stderr, "Can't read %s\n", filename);
+      return -1;
+    }
+    if (Assemble(source, bench->image, &low, &high, &line) != I8080_OK) {
+      fprintf(stderr, "%s:%d: can't assemble\n", filename, line);
+      free(source);
+      return -1;
+    }
+    free(source);
+  }
+  else if (workload->kind == KIND_CPUDIAG) {
+    /* Loaded at 0x100 like CP/M, with the stack fix of the emulator */
+    if (ReadIntoMemory(bench->image, CPUDIAG_FILE, 0x100) < 0) {
+      fprintf(stderr, "Can't read %s\n", CPUDIAG_FILE);
+      return -1;
+    }
+    bench->image[BOOT] = 0x76;
+    bench->image[BDOS] = 0x76;
+    bench->image[0x170] = 0x07;
+  }
+  else {
+    /* invaders.h, .g, .f and .e at 0x0000, 0x0800, 0x1000, 0x1800 */
+    const char *parts = "hgfe";
+    for (int i = 0; i < 4; i++) {
+      char filename[64];
+      snprintf(filename, sizeof(filename), "%s%c", ROM_PATH, parts[i]);
+      if (ReadIntoMemory(bench->image, filename, 0x800 * i) < 0) {
+        fprintf(stderr, "Can't read %s\n", filename);
+        return -1;
+      }
+    }
+    bench->inputs[0] = 0x0e;
+    bench->inputs[1] = 0x08;
+    InitPorts(&bench->ports);
+    for (int port = 0; port < 3; port++) {
+      MapInput(&bench->ports, port, ReadInput, bench);
+    }
+    MapOutput(&bench->ports, PORT_SHIFT_AMOUNT, WriteShiftAmount, bench);
+    MapOutput(&bench->ports, PORT_SHIFT_DATA, WriteShiftData, bench);
+    MapInput(&bench->ports, PORT_SHIFT_RESULT, ReadShiftResult, bench);
+  }
+
+  memcpy(bench->memory, bench->image, 0x10000);
+  InitState(&bench->state, bench->memory);
+  if (AttachJit(&bench->state) != I8080_OK) {
+    AttachBlockCache(&bench->state);
+  }
+
+  return 0;
+}
+
+/*
+ * Function: Start
+ * ---------------
+ *  Puts the machine of a workload back to power on. Only the bytes
+ *  written by the last run are copied back, so blocks of code the cores
+ *  decoded or translated stay valid
+ *
+ *  bench: machine of the workload
+ *  workload: workload it runs
+ *
+ *  returns: void
+ */
+void Start(Bench *bench, const Workload *workload)
+{
+  ResetState(&bench->state);
+  CopyIntoMemory(&bench->state, bench->image);
+
+  if (workload->kind == KIND_CPUDIAG) {
+    bench->state.pc = 0x100;
+  }
+  else if (workload->kind == KIND_INVADERS) {
+    bench->shift = 0;
+    bench->amount = 0;
+    bench->state.ports = &bench->ports;
+    ScheduleInterrupt(&bench->state, CYCLES_PER_FRAME / 2, CYCLES_PER_FRAME,
+                      1);
+    ScheduleInterrupt(&bench->state, CYCLES_PER_FRAME, CYCLES_PER_FRAME, 2);
+  }
+}
+
+/*
+ * Function: Measure
+ * -----------------
+ *  Runs a workload from power on for a number of instructions. The
+ *  diagnostic is started over each time it ends, its BDOS calls return
+ *  without printing
+ *
+ *  bench: machine of the workload
+ *  workload: workload to run
+ *  count: instructions to run
+ *  counter: host cycle counter
+ *  run: receives the timing
+ *
+ *  returns: void
+ */
+void Measure(Bench *bench, const Workload *workload, uint64_t count,
+             Counter *counter, Run *run)
+{
+  States *state = &bench->state;
+
+  memset(run, 0, sizeof(Run));
+  Start(bench, workload);
+
+  double start = Seconds();
+  uint64_t host = ReadCounter(counter);
+  while (run->instructions < count && state->error == I8080_OK) {
+    run->instructions += Emulator(state, count - run->instructions);
+    if (workload->kind != KIND_CPUDIAG || !state->halted) {
+      break;
+    }
+    if (state->pc == BDOS + 1) { // Return to the caller
+      state->pc = state->memory[state->sp] |
+                  state->memory[(uint16_t)(state->sp + 1)] << 8;
+      state->sp += 2;
+      state->halted = 0;
+    }
+    else { // Warm boot, the diagnostic is over
+      run->cycles += state->cycles;
+      Start(bench, workload);
+    }
+  }
+  run->host_cycles = ReadCounter(counter) - host;
+  run->seconds = Seconds() - start;
+  run->cycles += state->cycles;
+}
+
+/*
+ * Function: ReadSource
+ * --------------------
+ *  Reads a whole text file
+ *
+ *  filename: name of the file
+ *
+ *  returns: the text, NULL if it can't be read
+ */
+char *ReadSource(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return NULL;
+  }
+
+  char *text = NULL;
+  size_t size = 0;
+  size_t room = 0;
+  size_t got;
+  do {
+    if (room - size < 4096) {
+      room = room * 2 + 4096;
+      char *grown = realloc(text, room + 1);
+      if (grown == NULL) {
+        free(text);
+        fclose(fp);
+        return NULL;
+      }
+      text = grown;
+    }
+    got = fread(text + size, 1, room - size, fp);
+    size += got;
+  } while (got > 0);
+
+  if (ferror(fp)) {
+    free(text);
+    text = NULL;
+  }
+  else {
+    text[size] = '\0';
+  }
+  fclose(fp);
+
+  return text;
+}
+
+/*
+ * Function: ReadInput
+ * -------------------
+ *  Cabinet ports 0-2 with nothing pressed
+ *
+ *  context: the bench
+ *  port: port read
+ *
+ *  returns: its bits
+ */
+uint8_t ReadInput(void *context, uint8_t port)
+{
+  Bench *bench = context;
+
+  return bench->inputs[port];
+}
+
+/*
+ * Function: WriteShiftAmount
+ * --------------------------
+ *  OUT 2: bits of the shift register read by IN 3
+ *
+ *  context: the bench
+ *  port: port written
+ *  value: shift amount in the low 3 bits
+ *
+ *  returns: void
+ */
+void WriteShiftAmount(void *context, uint8_t port, uint8_t value)
+{
+  Bench *bench = context;
+
+  (void)port;
+  bench->amount = value & 7;
+}
+
+/*
+ * Function: WriteShiftData
+ * ------------------------
+ *  OUT 4: shifts a byte into the top of the shift register
+ *
+ *  context: the bench
+ *  port: port written
+ *  value: byte shifted in
+ *
+ *  returns: void
+ */
+void WriteShiftData(void *context, uint8_t port, uint8_t value)
+{
+  Bench *bench = context;
+
+  (void)port;
+  bench->shift = value << 8 | bench->shift >> 8;
+}
+
+/*
+ * Function: ReadShiftResult
+ * -------------------------
+ *  IN 3: 8 bits of the shift register, at the shift amount
+ *
+ *  context: the bench
+ *  port: port read
+ *
+ *  returns: the bits
+ */
+uint8_t ReadShiftResult(void *context, uint8_t port)
+{
+  Bench *bench = context;
+
+  (void)port;
+  return bench->shift >> (8 - bench->amount);
+}
+
+/*
+ * Function: OpenCounter
+ * ---------------------
+ *  Opens the host cycle counter: the kernel's count of the CPU cycles
+ *  this thread spends in user space, else the time stamp counter
+ *
+ *  counter: counter to open
+ *
+ *  returns: void
+ */
+void OpenCounter(Counter *counter)
+{
+  counter->source = "none";
+  counter->fd = -1;
+
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  counter->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (counter->fd >= 0) {
+    counter->source = "perf";
+    ioctl(counter->fd, PERF_EVENT_IOC_ENABLE, 0);
+    return;
+  }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+  counter->source = "tsc";
+#endif
+}
+
+/*
+ * Function: ReadCounter
+ * ---------------------
+ *  Reads the host cycle counter
+ *
+ *  counter: opened counter
+ *
+ *  returns: cycles so far, 0 without a counter
+ */
+uint64_t ReadCounter(const Counter *counter)
+{
+#ifdef __linux__
+  uint64_t cycles;
+  if (counter->fd >= 0 &&
+      read(counter->fd, &cycles, sizeof(cycles)) == sizeof(cycles)) {
+    return cycles;
+  }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+  if (strcmp(counter->source, "tsc") == 0) {
+    return __rdtsc();
+  }
+#endif
+  (void)counter;
+  return 0;
+}
+
+/*
+ * Function: CompareRuns
+ * ---------------------
+ *  Orders runs from the fastest, for qsort
+ *
+ *  a: run
+ *  b: run
+ *
+ *  returns: <0, 0 or >0 as a is faster, as fast or slower than b
+ */
+int CompareRuns(const void *a, const void *b)
+{
+  const Run *x = a;
+  const Run *y = b;
+  double rate_x = x->instructions / x->seconds;
+  double rate_y = y->instructions / y->seconds;
+
+  return (rate_x < rate_y) - (rate_x > rate_y);
+}
+
+/*
+ * Function: CoreName
+ * ------------------
+ *  Names the core Emulator() runs on: the JIT or the block cache when
+ *  the library has them, else the dispatch of the interpreter
+ *
+ *  returns: "jit", "block_cache", "threaded" or "switch"
+ */
+const char *CoreName(void)
+{
+  States state;
+  uint8_t memory[1]; // Never run
+  const char *name =
+#ifdef THREADED_DISPATCH
+    "threaded";
+#else
+    "switch";
+#endif
+
+  InitState(&state, memory);
+  if (AttachJit(&state) == I8080_OK) {
+    name = "jit";
+  }
+  else if (AttachBlockCache(&state) == I8080_OK) {
+    name = "block_cache";
+  }
+  ReleaseState(&state);
+
+  return name;
+}
+
+/*
+ * Function: Seconds
+ * -----------------
+ *  Reads the monotonic clock
+ *
+ *  returns: current time in seconds
+ */
+double Seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
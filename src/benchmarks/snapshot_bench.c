@@ -0,0 +1,251 @@
+/*
+  License: DOWHATEVERYOUWANT
+
+  Snapshot and fork latency benchmark
+
+  Warms up a Space Invaders machine, then measures how long it takes to
+  snapshot it, restore it and fork it into many children sharing its
+  memory copy-on-write. Every child runs on and must end in the same
+  state as the parent. Private(unshared) resident memory is sampled to
+  show what each child really costs, next to forks that copy the whole
+  64 KB
+
+  Usage:
+    gcc -O2 snapshot_bench.c ../libi8080/i8080.c -o snapshot_bench
+    ./snapshot_bench [-c children] [-w warmup] [-n instructions]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "../libi8080/i8080.h"
+
+
+/* Definitions */
+#define ROM_PATH "../spaceinvader-emulator/invaders."
+#define SNAPSHOT_FILE "snapshot_bench.snp"
+#define REPEATS 1000 // Snapshots and restores timed
+
+
+/* Function declarations */
+double Seconds(void);
+long PrivateKilobytes(void);
+int SameRegisters(const States *a, const States *b);
+
+
+int main(int argc, char **argv)
+{
+  int children = 500; // Forks of the warmed up machine
+  uint64_t warmup = 2000000; // Instructions run before the snapshot
+  uint64_t instructions = 100000; // Instructions run by every child
+
+  /* Parse options */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      children = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      warmup = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      instructions = strtoull(argv[++i], NULL, 0);
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-c children] [-w warmup] "
+              "[-n instructions]\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (children < 1) {
+    children = 1;
+  }
+
+  /* Load invaders.h, .g, .f and .e at 0x0000, 0x0800, 0x1000, 0x1800 */
+  uint8_t *memory = calloc(1, 0x10000);
+  const char *parts = "hgfe";
+  for (int i = 0; i < 4; i++) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "%s%c", ROM_PATH, parts[i]);
+    if (ReadIntoMemory(memory, filename, 0x800 * i) < 0) {
+      fprintf(stderr, "Can't read %s\n", filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Mid-screen RST 1 and vblank RST 2, 60 times a second at 2 MHz */
+  States parent;
+  InitState(&parent, memory);
+  ScheduleInterrupt(&parent, 16667, 33333, 1);
+  ScheduleInterrupt(&parent, 33333, 33333, 2);
+  Emulator(&parent, warmup);
+
+  /* Snapshot latency */
+  Snapshot *snapshot = NULL;
+  double start = Seconds();
+  for (int i = 0; i < REPEATS; i++) {
+    if (snapshot != NULL) {
+      FreeSnapshot(snapshot);
+    }
+    if (TakeSnapshot(&parent, NULL, 0, &snapshot) != I8080_OK) {
+      fprintf(stderr, "Can't take a snapshot\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  double snapshot_time = (Seconds() - start) / REPEATS;
+
+  /* Restore latency, into a machine that ran on from the snapshot */
+  States other;
+  uint8_t *other_memory = malloc(0x10000);
+  InitState(&other, other_memory);
+  RestoreSnapshot(snapshot, &other, NULL, 0);
+  double restore_time = 0;
+  for (int i = 0; i < REPEATS; i++) {
+    Emulator(&other, 1000);
+    start = Seconds();
+    RestoreSnapshot(snapshot, &other, NULL, 0);
+    restore_time += Seconds() - start;
+  }
+  restore_time /= REPEATS;
+
+  /* The parent runs on, every child must end up where it does */
+  Emulator(&parent, instructions);
+
+  /* Copy-on-write forks */
+  States *forks = malloc(sizeof(States) * children);
+  long resident = PrivateKilobytes();
+  start = Seconds();
+  for (int i = 0; i < children; i++) {
+    if (ForkSnapshot(snapshot, &forks[i], NULL, 0) != I8080_OK) {
+      fprintf(stderr, "Can't fork child %d\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+  double fork_time = (Seconds() - start) / children;
+  long forked = PrivateKilobytes();
+
+  int matches = 0;
+  start = Seconds();
+  for (int i = 0; i < children; i++) {
+    Emulator(&forks[i], instructions);
+    matches += SameRegisters(&forks[i], &parent) &&
+               memcmp(forks[i].memory, parent.memory, 0x10000) == 0;
+  }
+  double run_time = Seconds() - start;
+  long ran = PrivateKilobytes();
+
+  for (int i = 0; i < children; i++) {
+    ReleaseMemory(forks[i].memory);
+  }
+
+  /* Forks copying the whole memory, for comparison */
+  long copy_resident = PrivateKilobytes();
+  start = Seconds();
+  for (int i = 0; i < children; i++) {
+    uint8_t *copy = malloc(0x10000);
+    InitState(&forks[i], copy);
+    RestoreSnapshot(snapshot, &forks[i], NULL, 0);
+  }
+  double copy_time = (Seconds() - start) / children;
+  long copied = PrivateKilobytes();
+  for (int i = 0; i < children; i++) {
+    free(forks[i].memory);
+  }
+
+  /* A saved snapshot must fork into the same machine */
+  Snapshot *loaded = NULL;
+  States reloaded;
+  int saved = SaveSnapshot(snapshot, SNAPSHOT_FILE) == I8080_OK &&
+              LoadSnapshot(SNAPSHOT_FILE, &loaded) == I8080_OK &&
+              ForkSnapshot(loaded, &reloaded, NULL, 0) == I8080_OK;
+  if (saved) {
+    Emulator(&reloaded, instructions);
+    saved = SameRegisters(&reloaded, &parent) &&
+            memcmp(reloaded.memory, parent.memory, 0x10000) == 0;
+    ReleaseMemory(reloaded.memory);
+    FreeSnapshot(loaded);
+  }
+  remove(SNAPSHOT_FILE);
+
+  printf("Snapshot: %.2f us\n", snapshot_time * 1e6);
+  printf("Restore: %.2f us\n", restore_time * 1e6);
+  printf("Fork(copy-on-write): %.2f us per child, %.1f KB private per child "
+         "after forking, %.1f KB after running %llu instructions\n",
+         fork_time * 1e6, (double)(forked - resident) / children,
+         (double)(ran - resident) / children,
+         (unsigned long long)instructions);
+  printf("Fork(full copy): %.2f us per child, %.1f KB private per child\n",
+         copy_time * 1e6, (double)(copied - copy_resident) / children);
+  printf("Children: %d of %d match the parent, %.2f MIPS\n", matches,
+         children, (double)children * instructions / run_time / 1e6);
+  printf("Save/load round trip: %s\n", saved ? "matches" : "FAILED");
+
+  FreeSnapshot(snapshot);
+  free(forks);
+  free(other_memory);
+  free(memory);
+
+  return matches == children && saved ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* Function implementation */
+
+/*
+ * Function: Seconds
+ * -----------------
+ *  Reads the monotonic clock
+ *
+ *  returns: current time in seconds
+ */
+double Seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Function: PrivateKilobytes
+ * --------------------------
+ *  Reads the resident memory of the process not shared with a file or
+ *  another mapping(Linux /proc), pages a fork only reads are not counted
+ *
+ *  returns: private resident memory in KB, 0 when it can't be read
+ */
+long PrivateKilobytes(void)
+{
+  long size = 0;
+  long resident = 0;
+  long shared = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+
+  if (fp == NULL) {
+    return 0;
+  }
+  if (fscanf(fp, "%ld %ld %ld", &size, &resident, &shared) != 3) {
+    resident = shared = 0;
+  }
+  fclose(fp);
+
+  return (resident - shared) * 4; // 4 KB pages
+}
+
+/*
+ * Function: SameRegisters
+ * -----------------------
+ *  Compares the registers, flags and counters of two machines
+ *
+ *  a: first machine
+ *  b: second machine
+ *
+ *  returns: 1 if they match, else 0
+ */
+int SameRegisters(const States *a, const States *b)
+{
+  return a->a == b->a && a->b == b->b && a->c == b->c && a->d == b->d &&
+         a->e == b->e && a->h == b->h && a->l == b->l && a->sp == b->sp &&
+         a->pc == b->pc && a->cc.psw == b->cc.psw &&
+         a->int_enable == b->int_enable && a->halted == b->halted &&
+         a->cycles == b->cycles;
+}
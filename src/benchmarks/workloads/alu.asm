@@ -0,0 +1,41 @@
+; ALU workload: 8 bit arithmetic and logic on registers, every flag
+; written, with a 16 bit add and DAA now and then
+; Runs forever, the host stops it after a number of instructions
+
+        ORG 0
+start:  LXI SP,$f000
+        MVI A,$5a
+        LXI B,$1234
+        LXI D,$9abc
+        LXI H,$0001
+loop:   ADD B
+        ADC C
+        SUB D
+        SBB E
+        ANA B
+        XRA C
+        ORA D
+        CMP E
+        ADI $37
+        ACI $01
+        SUI $11
+        SBI $02
+        ANI $f7
+        XRI $5a
+        ORI $01
+        CPI $80
+        INR B
+        DCR C
+        INR D
+        DCR E
+        RLC
+        RAL
+        RRC
+        RAR
+        DAA
+        CMA
+        STC
+        CMC
+        DAD B
+        DAD D
+        JMP loop
@@ -0,0 +1,49 @@
+; Branch workload: conditional jumps, taken and not taken in patterns
+; set by a counter, and a PCHL through a small jump table
+; Runs forever, the host stops it after a number of instructions
+
+        ORG 0
+start:  LXI SP,$f000
+        MVI B,0
+loop:   INR B
+        MOV A,B
+        ANI $01
+        JZ even
+        MOV A,B
+        ANI $02
+        JNZ odd2
+        JMP next
+even:   MOV A,B
+        CPI $80
+        JC below
+        JP next
+        JM next
+below:  ORA A
+        JPE next
+        JPO next
+odd2:   MOV A,B
+        RRC
+        JNC next
+        MOV A,B
+        ANI $06
+        MOV E,A
+        MVI D,0
+        LXI H,table
+        DAD D
+        MOV E,M
+        INX H
+        MOV D,M
+        XCHG
+        PCHL
+next:   JMP loop
+case0:  JMP loop
+case1:  INR C
+        JMP loop
+case2:  DCR C
+        JMP loop
+case3:  MOV A,C
+        CMA
+        MOV C,A
+        JMP loop
+
+table:  DW case0, case1, case2, case3
@@ -0,0 +1,36 @@
+; Call workload: chains of CALL and RET three levels deep, conditional
+; calls and returns taken and not taken, and an RST
+; Runs forever, the host stops it after a number of instructions
+
+        ORG 0
+start:  LXI SP,$f000
+        JMP main
+
+        ORG $38
+rst7:   INR E
+        RET
+
+main:   MVI B,0
+loop:   INR B
+        CALL level1
+        MOV A,B
+        ANI $01
+        CZ level3
+        CNZ level2
+        RST 7
+        JMP loop
+
+level1: INR C
+        CALL level2
+        RET
+level2: INR D
+        CALL level3
+        MOV A,D
+        ANI $03
+        RZ
+        RET
+level3: MOV A,B
+        ORA A
+        RM
+        DCR C
+        RET
@@ -0,0 +1,41 @@
+; Memory workload: reads and writes through HL(M), BC and DE, and the
+; direct loads and stores, walking a 256 byte buffer
+; Runs forever, the host stops it after a number of instructions
+
+buffer  EQU $4000
+pointer EQU $4100
+
+        ORG 0
+start:  LXI SP,$f000
+        LXI H,buffer
+        LXI B,buffer+$40
+        LXI D,buffer+$80
+        XRA A
+loop:   MOV M,A
+        INR M
+        ADD M
+        MOV B,M
+        INX H
+        MOV M,B
+        SUB M
+        DCR M
+        MOV E,M
+        STAX B
+        LDAX D
+        INX B
+        INX D
+        STA pointer
+        LDA pointer
+        SHLD pointer+2
+        LHLD pointer+2
+        MVI M,$3c
+        MOV A,L
+        ANI $7f
+        MOV L,A
+        MOV A,C
+        ANI $7f
+        MOV C,A
+        MOV A,E
+        ORI $80
+        MOV E,A
+        JMP loop
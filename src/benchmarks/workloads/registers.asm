@@ -0,0 +1,38 @@
+; Register workload: MOVs between registers, with MVI, XCHG and the
+; register pair increments to keep values moving
+; Runs forever, the host stops it after a number of instructions
+
+        ORG 0
+start:  LXI SP,$f000
+        MVI A,$11
+        MVI B,$22
+        MVI C,$33
+        MVI D,$44
+        MVI E,$55
+        MVI H,$66
+        MVI L,$77
+loop:   MOV B,A
+        MOV C,B
+        MOV D,C
+        MOV E,D
+        MOV H,E
+        MOV L,H
+        MOV A,L
+        MOV A,B
+        MOV B,C
+        MOV C,D
+        MOV D,E
+        MOV E,H
+        MOV H,L
+        MOV L,A
+        XCHG
+        MOV A,E
+        MOV E,L
+        MOV L,D
+        MOV D,H
+        MOV H,A
+        INX H
+        DCX D
+        INX B
+        MVI A,$5a
+        JMP loop
@@ -0,0 +1,30 @@
+; Stack workload: PUSH and POP of every register pair, XTHL and SPHL
+; Runs forever, the host stops it after a number of instructions
+
+        ORG 0
+start:  LXI SP,$f000
+        LXI B,$0102
+        LXI D,$0304
+        LXI H,$0506
+        MVI A,$07
+loop:   PUSH B
+        PUSH D
+        PUSH H
+        PUSH PSW
+        POP B
+        POP D
+        POP H
+        POP PSW
+        PUSH H
+        XTHL
+        POP H
+        PUSH B
+        PUSH D
+        XTHL
+        POP D
+        POP B
+        LXI H,$f000
+        SPHL
+        INX B
+        DCX D
+        JMP loop
@@ -6,419 +6,1391 @@
 
   Reads the complete Space Invader ROM and disassembles
   it into Intel8080 assembly instructions
+
+  By default the image is decoded from start to end(linear sweep). The
+  recursive mode(-r) only decodes what is reachable from the entry
+  points, the reset and RST vectors, by following jumps, calls and
+  branches, so tables in the ROM are listed as data and don't throw the
+  code after them out of alignment. It can also write the control flow
+  graph of the code found(-g) for Graphviz
+
+  Images are mapped rather than read(streamed when they can't be mapped)
+  and the listing is formatted by hand into a large buffer written in
+  one go, so big images and long lists of ROMs cost little more than
+  their I/O
+
+  Files and directories(every file below them, by name) are listed on a
+  pool of threads(-j), one file at a time per thread, and images larger
+  than CHUNK_SIZE in chunks that are joined back in order. The listings
+  come out in the order of the files, as if listed one after the other
+
+  With labels(-l) a first pass collects the targets of jumps, calls and
+  memory references in bitmaps, and the listing names them: Sxxxx for
+  subroutines, Lxxxx for jumps and Dxxxx for data, or the names of a
+  symbol file(-s). Symbols outside the listing are defined with EQU
+
+  Usage:
+    gcc -O2 -pthread disassembler.c ../libi8080/i8080.c -o disassembler
+    ./disassembler [-r] [-g graph.dot] [-e addr]... [-j threads]
+                   [-l] [-s symbols] [file|directory]...
 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../libi8080/i8080.h"
 
 
 /* file name for Space Invaders ROM */
 #define FILE_NAME "invaders"
 
+/* Definitions */
+#define MAX_ENTRIES 64 // Entry points given with -e
+#define DATA_PER_LINE 8 // Bytes of a DB line
+#define OUTPUT_SIZE (1 << 20) // Listing buffered before it's written
+#define LINE_SIZE 64 // Room for the longest line of the listing
+#define READ_SIZE (1 << 16) // Read at a time when streaming an image
+#define CHUNK_SIZE (1 << 18) // Larger images are listed in chunks
+#define WINDOW 4 // Tasks per thread listed ahead of the output
+#define NAME_SIZE 32 // Longest symbol and its terminator
+
+/* What a byte of the image turned out to be(recursive mode) */
+#define BYTE_DATA 0 // Never reached from an entry point
+#define BYTE_CODE 1 // First byte of an instruction
+#define BYTE_OPERAND 2 // Operand byte of an instruction
+
+/* Targets collected for labels, named in this order of preference */
+#define TARGET_CALL 0 // Called or restarted, Sxxxx
+#define TARGET_JUMP 1 // Jumped or branched to, Lxxxx
+#define TARGET_DATA 2 // Loaded, stored or its address loaded, Dxxxx
+#define TARGETS 3
+
+/* What became of a task */
+#define TASK_OK 0
+#define TASK_OPEN 1 // The file can't be read
+#define TASK_GRAPH 2 // The graph can't be written
+#define TASK_MEMORY 3 // The image can't be decoded for lack of memory
+
+
+/* Struct definitions */
+typedef struct Image {
+  uint8_t *memory; // The image, loaded at address 0
+  size_t size; // Bytes of the image
+  uint32_t space; // Bytes of it in the 64 KB address space
+  int mapped; // memory is mapped from the file, else allocated
+  uint8_t kind[0x10000]; // BYTE_DATA, BYTE_CODE or BYTE_OPERAND
+  uint8_t leader[0x10000]; // A basic block starts at the address
+  int recursive; // Listed after Traverse
+  int labels; // Listed with labels
+  char **symbols; // Names of the 64 KB addresses, NULL for none
+  uint8_t target[TARGETS][0x10000 / 8]; // Bitmaps of targets by TARGET_*
+  uint8_t start[0x10000 / 8]; // Bitmap of the lines of a linear listing
+} Image;
+
+/*
+  Listing formatted into a buffer, written when it's full, or kept in
+  memory(fp NULL) with the buffer growing as needed
+*/
+typedef struct Output {
+  char *buffer;
+  size_t used;
+  size_t size;
+  FILE *fp;
+  int error; // A write failed
+} Output;
+
+/*
+  A chunk is listed from its first byte, but the instruction before it
+  may end 1 or 2 bytes into it. It's also listed from these until the
+  listings meet, which they soon do: every variant is written up to the
+  pc where it meets the first listing, which goes on from there
+*/
+typedef struct Join {
+  size_t pc[3]; // Where the listing from byte n meets the first one
+  size_t offset[3]; // Where that pc starts in the first listing
+} Join;
+
+/* A file, or a chunk of one, to list */
+typedef struct Task {
+  const char *filename;
+  size_t start; // First byte listed
+  size_t end; // End of the chunk, 0 for the whole image
+  int status; // TASK_*
+  int done; // Listed and ready to be written
+  Output *out; // Listings from byte 0, 1 and 2 of the chunk
+  Join join;
+  size_t resume[3]; // Where the next chunk starts after each listing
+  uint32_t code; // Bytes of code found(recursive)
+  uint32_t space; // Bytes in the address space(recursive)
+  double elapsed; // Seconds spent finding them
+} Task;
+
+/* Tasks and what the threads share */
+typedef struct Pool {
+  Task *tasks;
+  int ntasks;
+  int next; // First task no thread has taken
+  int written; // Tasks written to the output
+  int window; // Tasks taken ahead of the output
+  Output *listings; // 3 per task of the window, reused round robin
+  int recursive;
+  const uint16_t *entries;
+  int nentries;
+  const char *graph;
+  int labels;
+  char **symbols; // Read from the symbol file, NULL for none
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // A task was listed or written
+} Pool;
+
+/* Thread of the pool */
+typedef struct Worker {
+  pthread_t thread;
+  Pool *pool;
+  Image image; // Reused by every task
+  uint8_t starts[CHUNK_SIZE]; // Instructions of the chunk listing
+} Worker;
+
+/* Names of the files to list */
+typedef struct Files {
+  char **names;
+  int count;
+  int size;
+} Files;
 
-/* Function declaration*/
-int Disassembler(uint8_t *codebuffer, int pc);
+
+/* Function declarations */
+int LoadImage(Image *image, const char *filename);
+void UnloadImage(Image *image);
+int AddFiles(Files *files, const char *path);
+void *WorkerMain(void *arg);
+void RunTask(Worker *worker, Task *task);
+void ListChunk(Worker *worker, Task *task);
+int Traverse(Image *image, const uint16_t *entries, int count);
+size_t ListLinear(const Image *image, size_t pc, size_t end, Output *out,
+                  Join *join);
+void ListRecursive(const Image *image, Output *out);
+char **ReadSymbols(const char *filename);
+void FindTargets(Image *image, const uint16_t *entries, int count);
+const char *LabelOf(const Image *image, uint32_t addr, char *buffer);
+int Placed(const Image *image, uint32_t addr);
+void ListEquates(const Image *image, Output *out);
+char *PutLabel(Output *out, const Image *image, uint32_t pc);
+char *PutInstruction(char *p, const Image *image, const uint8_t *code);
+int WriteGraph(const Image *image, const char *filename);
+uint16_t Target(const Image *image, uint16_t addr);
+char *Reserve(Output *out);
+void Flush(Output *out);
+void Write(Output *out, const char *data, size_t size);
+char *PutHex(char *p, uint32_t value, int digits);
+char *PutText(char *p, const char *text);
+double Seconds(void);
 
 
 int main(int argc, char **argv){
 
-  // Open file and verify status
-  FILE *fp = fopen(FILE_NAME, "rb");
-  if(fp == NULL){
-    printf("Can't open %s\n", FILE_NAME);
+  Files files = { NULL, 0, 0 };
+  const char *graph = NULL; // Control flow graph file
+  int recursive = 0;
+  int nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+  int labels = 0;
+  const char *symbols = NULL; // Symbol file
+  int paths = 0; // Files and directories named
+  uint16_t entries[MAX_ENTRIES + 8];
+  int nentries = 0;
+
+  /* Parse options */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-r") == 0) {
+      recursive = 1;
+    }
+    else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+      graph = argv[++i];
+      recursive = 1;
+    }
+    else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc &&
+             nentries < MAX_ENTRIES) {
+      entries[nentries++] = strtoul(argv[++i], NULL, 0);
+      recursive = 1;
+    }
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      nworkers = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-l") == 0) {
+      labels = 1;
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      symbols = argv[++i];
+      labels = 1;
+    }
+    else if (argv[i][0] != '-') {
+      paths++;
+      if (AddFiles(&files, argv[i]) < 0) {
+        fprintf(stderr, "Can't read the directory %s\n", argv[i]);
+        exit(EXIT_FAILURE);
+      }
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-r] [-g graph.dot] [-e addr]... "
+              "[-j threads] [-l] [-s symbols] [file|directory]...\n",
+              argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (paths == 0) {
+    AddFiles(&files, FILE_NAME);
+  }
+  if (graph != NULL && files.count > 1) {
+    fprintf(stderr, "Only one file can be graphed\n");
     exit(EXIT_FAILURE);
   }
+  /* Then the reset and RST vectors, which unused vectors overlap */
+  for (uint16_t vector = 0; vector < 0x40; vector += 8) {
+    entries[nentries++] = vector;
+  }
 
-  // Get file size
-  fseek(fp, 0L, SEEK_END);
-  int fsize = ftell(fp);
+  /* A task per file, or per chunk of the large images */
+  Pool pool = { .recursive = recursive, .entries = entries,
+                .nentries = nentries, .graph = graph, .labels = labels };
+  if (symbols != NULL && (pool.symbols = ReadSymbols(symbols)) == NULL) {
+    exit(EXIT_FAILURE);
+  }
+  int room = 0;
+  for (int i = 0; i < files.count; i++) {
+    struct stat st;
+    size_t size = 0;
+    if (!recursive && !labels && stat(files.names[i], &st) == 0 &&
+        S_ISREG(st.st_mode)) {
+      size = st.st_size;
+    }
+    int nchunks = size > CHUNK_SIZE ? (size + CHUNK_SIZE - 1) / CHUNK_SIZE : 1;
 
-  // Return to beginning of file to read into memory buffer
-  fseek(fp, 0L, SEEK_SET);
-  uint8_t *buffer = malloc(fsize);
+    for (int chunk = 0; chunk < nchunks; chunk++) {
+      if (pool.ntasks == room) {
+        room = room * 2 + 64;
+        pool.tasks = realloc(pool.tasks, sizeof(Task) * room);
+        if (pool.tasks == NULL) {
+          fprintf(stderr, "Can't allocate the tasks\n");
+          exit(EXIT_FAILURE);
+        }
+      }
+      Task *task = &pool.tasks[pool.ntasks++];
+      memset(task, 0, sizeof(Task));
+      task->filename = files.names[i];
+      task->start = size * chunk / nchunks;
+      task->end = nchunks > 1 ? size * (chunk + 1) / nchunks : 0;
+    }
+  }
 
-  // Read file into buffer
-  fread(buffer, fsize, 1, fp);
-  fclose(fp);
+  if (nworkers < 1) {
+    nworkers = 1;
+  }
+  if (nworkers > pool.ntasks) {
+    nworkers = pool.ntasks > 0 ? pool.ntasks : 1;
+  }
+  pool.window = nworkers * WINDOW;
+  pool.listings = calloc(pool.window * 3, sizeof(Output));
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.changed, NULL);
+
+  Worker *workers = malloc(sizeof(Worker) * nworkers);
+  Output out = { malloc(OUTPUT_SIZE), 0, OUTPUT_SIZE, stdout, 0 };
+  if (workers == NULL || out.buffer == NULL || pool.listings == NULL) {
+    fprintf(stderr, "Can't allocate the buffers\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < nworkers; i++) {
+    workers[i].pool = &pool;
+    if (pthread_create(&workers[i].thread, NULL, WorkerMain,
+                       &workers[i]) != 0) {
+      fprintf(stderr, "Can't start worker %d\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Write the listings in order as they come */
+  int failed = 0;
+  int skip = 0; // The file can't be read
+  size_t resume = 0; // Where the next chunk of the file starts
+  for (int i = 0; i < pool.ntasks; i++) {
+    Task *task = &pool.tasks[i];
+
+    pthread_mutex_lock(&pool.lock);
+    while (!task->done) {
+      pthread_cond_wait(&pool.changed, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    if (task->start == 0) {
+      skip = 0;
+      resume = 0;
+      if (files.count > 1 && task->status != TASK_OPEN) {
+        Flush(&out); // File names can be longer than LINE_SIZE
+        fprintf(out.fp, "; %s\n", task->filename);
+      }
+    }
+    if (!skip && task->status == TASK_OPEN) {
+      fprintf(stderr, "Can't open %s\n", task->filename);
+      failed = 1;
+      skip = 1; // The rest of the file
+    }
+    else if (!skip && task->status == TASK_MEMORY) {
+      fprintf(stderr, "Can't allocate the decoding of %s\n", task->filename);
+      failed = 1;
+    }
+    else if (!skip && recursive) {
+      fprintf(stderr, "%s: %u of %u bytes are code, found in %.3f ms\n",
+              task->filename, task->code, task->space, task->elapsed * 1e3);
+      Write(&out, task->out[0].buffer, task->out[0].used);
+      if (task->status == TASK_GRAPH) {
+        fprintf(stderr, "Can't write %s\n", graph);
+        failed = 1;
+      }
+    }
+    else if (!skip) {
+      /* Go on from where the previous chunk's last instruction ended */
+      int from = resume - task->start;
+      if (from == 0) {
+        Write(&out, task->out[0].buffer, task->out[0].used);
+      }
+      else {
+        Write(&out, task->out[from].buffer, task->out[from].used);
+        Write(&out, task->out[0].buffer + task->join.offset[from],
+              task->out[0].used - task->join.offset[from]);
+      }
+      resume = task->resume[from];
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.written++;
+    pthread_cond_broadcast(&pool.changed);
+    pthread_mutex_unlock(&pool.lock);
+  }
+  Flush(&out);
+  if (out.error) {
+    fprintf(stderr, "Can't write the listing\n");
+    failed = 1;
+  }
+
+  for (int i = 0; i < nworkers; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  pthread_cond_destroy(&pool.changed);
+  pthread_mutex_destroy(&pool.lock);
+  for (int i = 0; i < pool.window * 3; i++) {
+    free(pool.listings[i].buffer);
+  }
+  free(pool.listings);
+  free(out.buffer);
+  free(workers);
+  free(pool.tasks);
+  for (int i = 0; i < files.count; i++) {
+    free(files.names[i]);
+  }
+  free(files.names);
+  if (pool.symbols != NULL) {
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+      free(pool.symbols[addr]);
+    }
+    free(pool.symbols);
+  }
+
+  return failed ? EXIT_FAILURE : 0;
+}
+
+
+/* Function implementation */
+
+/*
+ * Function: LoadImage
+ * -------------------
+ *  Maps a ROM image at address 0, or reads it when it can't be mapped
+ *  (pipes, empty files), and clears what a previous image left
+ *
+ *  image: image to load into
+ *  filename: name of the file
+ *
+ *  returns: 0 on success, -1 if the file can't be read
+ */
+int LoadImage(Image *image, const char *filename)
+{
+  struct stat st;
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  image->memory = NULL;
+  image->size = 0;
+  image->mapped = 0;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      image->memory = map;
+      image->size = st.st_size;
+      image->mapped = 1;
+    }
+  }
+
+  /* Stream it into a buffer growing as needed */
+  if (!image->mapped) {
+    size_t room = 0;
+    ssize_t got;
+    do {
+      if (room - image->size < READ_SIZE) {
+        room = room * 2 + READ_SIZE;
+        uint8_t *memory = realloc(image->memory, room);
+        if (memory == NULL) {
+          got = -1;
+          break;
+        }
+        image->memory = memory;
+      }
+      got = read(fd, image->memory + image->size, room - image->size);
+      image->size += got > 0 ? got : 0;
+    } while (got > 0);
+    if (got < 0) {
+      free(image->memory);
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+
+  image->space = image->size < 0x10000 ? image->size : 0x10000;
+  memset(image->kind, BYTE_DATA, image->space);
+  memset(image->leader, 0, image->space);
+  memset(image->target, 0, sizeof(image->target));
+  memset(image->start, 0, sizeof(image->start));
+
+  return 0;
+}
+
+/*
+ * Function: UnloadImage
+ * ---------------------
+ *  Unmaps or frees the image loaded by LoadImage
+ *
+ *  image: image to unload
+ *
+ *  returns: void
+ */
+void UnloadImage(Image *image)
+{
+  if (image->mapped) {
+    munmap(image->memory, image->size);
+  }
+  else {
+    free(image->memory);
+  }
+  image->memory = NULL;
+}
+
+/*
+ * Function: AddFiles
+ * ------------------
+ *  Adds a file to the list, or every file below a directory sorted by
+ *  name, leaving out hidden ones
+ *
+ *  files: list of names
+ *  path: file or directory
+ *
+ *  returns: 0 on success, -1 if a directory can't be read
+ */
+int AddFiles(Files *files, const char *path)
+{
+  struct stat st;
+
+  if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    struct dirent **entries;
+    int count = scandir(path, &entries, NULL, alphasort);
+    if (count < 0) {
+      return -1;
+    }
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+      const char *name = entries[i]->d_name;
+      if (name[0] != '.' && result == 0) {
+        size_t length = strlen(path) + strlen(name) + 2;
+        char *child = malloc(length);
+        if (child == NULL) {
+          result = -1;
+        }
+        else {
+          snprintf(child, length, "%s/%s", path, name);
+          result = AddFiles(files, child);
+          free(child);
+        }
+      }
+      free(entries[i]);
+    }
+    free(entries);
+    return result;
+  }
+
+  /* Anything else is listed, or reported if it can't be read */
+  if (files->count == files->size) {
+    files->size = files->size * 2 + 64;
+    files->names = realloc(files->names, sizeof(char *) * files->size);
+  }
+  if (files->names == NULL ||
+      (files->names[files->count] = strdup(path)) == NULL) {
+    return -1;
+  }
+  files->count++;
+
+  return 0;
+}
+
+/*
+ * Function: WorkerMain
+ * --------------------
+ *  Thread of the pool, taking tasks in order until none is left. It
+ *  waits while the output is more than a window of tasks behind, so the
+ *  listings held in memory stay bounded and their buffers are reused
+ *
+ *  arg: the worker
+ *
+ *  returns: NULL
+ */
+void *WorkerMain(void *arg)
+{
+  Worker *worker = arg;
+  Pool *pool = worker->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->next < pool->ntasks) {
+    if (pool->next >= pool->written + pool->window) {
+      pthread_cond_wait(&pool->changed, &pool->lock);
+      continue;
+    }
+    /* The listings of the task a window before, written by now */
+    Task *task = &pool->tasks[pool->next];
+    task->out = &pool->listings[pool->next % pool->window * 3];
+    pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    for (int n = 0; n < 3; n++) {
+      task->out[n].used = 0;
+    }
+
+    RunTask(worker, task);
+
+    pthread_mutex_lock(&pool->lock);
+    task->done = 1;
+    pthread_cond_broadcast(&pool->changed);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+/*
+ * Function: RunTask
+ * -----------------
+ *  Loads the file of a task and lists it, or its chunk, into memory
+ *
+ *  worker: thread running the task
+ *  task: task to run
+ *
+ *  returns: void
+ */
+void RunTask(Worker *worker, Task *task)
+{
+  Pool *pool = worker->pool;
+  Image *image = &worker->image;
+
+  if (LoadImage(image, task->filename) < 0) {
+    task->status = TASK_OPEN;
+    return;
+  }
+  image->recursive = pool->recursive;
+  image->labels = pool->labels;
+  image->symbols = pool->symbols;
+
+  if (!pool->recursive) {
+    if (image->labels) {
+      FindTargets(image, NULL, 0);
+      ListEquates(image, &task->out[0]);
+    }
+    ListChunk(worker, task);
+  }
+  else {
+    double start = Seconds();
+    if (Traverse(image, pool->entries, pool->nentries) < 0) {
+      task->status = TASK_MEMORY;
+      UnloadImage(image);
+      return;
+    }
+    task->elapsed = Seconds() - start;
+
+    for (uint32_t addr = 0; addr < image->space; addr++) {
+      task->code += image->kind[addr] != BYTE_DATA;
+    }
+    task->space = image->space;
+
+    if (image->labels) {
+      FindTargets(image, pool->entries, pool->nentries);
+      ListEquates(image, &task->out[0]);
+    }
+    ListRecursive(image, &task->out[0]);
+    if (pool->graph != NULL && WriteGraph(image, pool->graph) < 0) {
+      task->status = TASK_GRAPH;
+    }
+  }
+  UnloadImage(image);
+}
+
+/*
+ * Function: ListChunk
+ * -------------------
+ *  Lists a chunk of the image from its first byte and, unless it's the
+ *  first chunk, from its second and third byte until they meet the first
+ *  listing(Join). Instructions are looked for by their lengths before
+ *  anything is listed
+ *
+ *  worker: thread running the task
+ *  task: task of the chunk
+ *
+ *  returns: void
+ */
+void ListChunk(Worker *worker, Task *task)
+{
+  const Image *image = &worker->image;
+  size_t start = task->start;
+  size_t end = task->end;
+  if (end == 0 || end > image->size) {
+    end = image->size;
+  }
+  if (start >= end) {
+    for (int n = 0; n < 3; n++) {
+      task->resume[n] = start + n;
+    }
+    return;
+  }
+  if (start == 0) {
+    task->resume[0] = ListLinear(image, start, end, &task->out[0], NULL);
+    return;
+  }
+
+  /* Find where the listings from byte 1 and 2 meet the first one */
+  Join *join = &task->join;
+  memset(worker->starts, 0, end - start);
+  for (size_t pc = start; pc < end; pc += Opcodes[image->memory[pc]].length) {
+    worker->starts[pc - start] = 1;
+  }
+  for (int n = 1; n < 3; n++) {
+    size_t pc = start + n;
+    while (pc < end && !worker->starts[pc - start]) {
+      pc += Opcodes[image->memory[pc]].length;
+    }
+    join->pc[n] = pc;
+  }
+
+  task->resume[0] = ListLinear(image, start, end, &task->out[0], join);
+  for (int n = 1; n < 3; n++) {
+    if (join->pc[n] < end) {
+      ListLinear(image, start + n, join->pc[n], &task->out[n], NULL);
+      task->resume[n] = task->resume[0];
+    }
+    else { // Never met, the whole chunk is listed from byte n
+      task->resume[n] = ListLinear(image, start + n, end, &task->out[n],
+                                   NULL);
+      join->offset[n] = task->out[0].used;
+    }
+  }
+}
+
+/*
+ * Function: Target
+ * ----------------
+ *  Reads the address an instruction jumps or calls to
+ *
+ *  image: image being disassembled
+ *  addr: address of the instruction
+ *
+ *  returns: the operand, or the vector of an RST
+ */
+uint16_t Target(const Image *image, uint16_t addr)
+{
+  const uint8_t *memory = image->memory;
+  uint8_t op = memory[addr];
 
-  // Dissamble machine code until PC reaches end of code
-  int pc = 0;
-  while(pc < fsize){
-    pc += Disassembler(buffer, pc);
+  if (Opcodes[op].flow == I8080_FLOW_RESTART) {
+    return op & 0x38;
   }
+  return memory[(uint16_t)(addr + 1)] | memory[(uint16_t)(addr + 2)] << 8;
+}
 
+/*
+ * Function: Traverse
+ * ------------------
+ *  Decodes the code reachable from the entry points: every jump, call,
+ *  branch and RST target is decoded in turn, and calls are assumed to
+ *  return to the next instruction. Targets of RET and PCHL aren't known
+ *  Marks every byte as code or data, and the first address of every
+ *  basic block. Each byte is decoded once, so this is linear in the size
+ *  of the image. An instruction overlapping code decoded before isn't
+ *  decoded, so code found from the first entries wins
+ *
+ *  image: image to disassemble
+ *  entries: addresses execution may start at, most trusted first
+ *  count: number of entries
+ *
+ *  returns: 0, -1 when the work list can't be allocated
+ */
+int Traverse(Image *image, const uint16_t *entries, int count)
+{
+  uint16_t *work = malloc(sizeof(uint16_t) * (count + 0x20000));
+  int top = 0;
+  if (work == NULL) {
+    return -1;
+  }
+
+  /* The first entries are decoded first, and win over the others */
+  for (int i = count - 1; i >= 0; i--) {
+    work[top++] = entries[i];
+  }
+
+  while (top > 0) {
+    uint32_t addr = work[--top];
+
+    if (addr < image->space) {
+      image->leader[addr] = 1;
+    }
+    while (addr < image->space && image->kind[addr] == BYTE_DATA) {
+      const Opcode *opcode = &Opcodes[image->memory[addr]];
+
+      /* Instructions running into code decoded before are left alone */
+      if (addr + opcode->length > image->space) {
+        break;
+      }
+      int overlaps = 0;
+      for (int i = 1; i < opcode->length; i++) {
+        overlaps |= image->kind[addr + i] != BYTE_DATA;
+      }
+      if (overlaps) {
+        break;
+      }
+
+      image->kind[addr] = BYTE_CODE;
+      for (int i = 1; i < opcode->length; i++) {
+        image->kind[addr + i] = BYTE_OPERAND;
+      }
+
+      uint32_t next = addr + opcode->length;
+      switch (opcode->flow) {
+        case I8080_FLOW_NEXT: {
+          addr = next;
+          continue;
+        }
+        case I8080_FLOW_JUMP: {
+          work[top++] = Target(image, addr);
+          break;
+        }
+        case I8080_FLOW_BRANCH:
+        case I8080_FLOW_CALL:
+        case I8080_FLOW_CALL_IF:
+        case I8080_FLOW_RESTART: {
+          work[top++] = Target(image, addr);
+          work[top++] = next;
+          break;
+        }
+        case I8080_FLOW_RETURN_IF:
+        case I8080_FLOW_HALT: { // An interrupt resumes after HLT
+          work[top++] = next;
+          break;
+        }
+        default: { // RET and PCHL
+          break;
+        }
+      }
+      break;
+    }
+
+    /* Joined code decoded earlier, which must start a block too */
+    if (addr < image->space && image->kind[addr] == BYTE_CODE) {
+      image->leader[addr] = 1;
+    }
+  }
+
+  free(work);
   return 0;
 }
 
+/*
+ * Function: ListLinear
+ * --------------------
+ *  Lists the image decoding every byte as code, from pc until an
+ *  instruction starts at or past end. Instructions cut short by the end
+ *  of the image are decoded as if zeros followed
+ *
+ *  image: image to disassemble
+ *  pc: first instruction listed
+ *  end: end of the bytes listed
+ *  out: listing
+ *  join: notes where the pcs in join->pc start in the listing, or NULL
+ *
+ *  returns: the pc past the last instruction listed
+ */
+size_t ListLinear(const Image *image, size_t pc, size_t end, Output *out,
+                  Join *join)
+{
+  int digits = 4; // Addresses of images larger than 64 KB get longer
+  while (digits < 8 && (image->size - 1) >> (digits * 4) != 0) {
+    digits += 2;
+  }
+
+  while (pc < end) {
+    if (join != NULL) {
+      for (int n = 1; n < 3; n++) {
+        if (pc == join->pc[n]) {
+          join->offset[n] = out->used;
+        }
+      }
+    }
+    const uint8_t *code = image->memory + pc;
+    uint8_t tail[3] = { 0, 0, 0 };
+    if (image->size - pc < 3) {
+      memcpy(tail, code, image->size - pc);
+      code = tail;
+    }
+
+    char *p = image->labels ? PutLabel(out, image, pc) : Reserve(out);
+    p = PutHex(p, pc, digits);
+    *p++ = ' ';
+    p = PutInstruction(p, image, code);
+    *p++ = '\n';
+    out->used = p - out->buffer;
+    pc += Opcodes[code[0]].length;
+  }
+
+  return pc;
+}
+
+/*
+ * Function: ListRecursive
+ * -----------------------
+ *  Lists the image after Traverse: code as instructions, everything else
+ *  as DB lines of up to DATA_PER_LINE bytes
+ *
+ *  image: image to disassemble
+ *  out: listing
+ *
+ *  returns: void
+ */
+void ListRecursive(const Image *image, Output *out)
+{
+  uint32_t pc = 0;
+
+  while (pc < image->space) {
+    char *p = image->labels ? PutLabel(out, image, pc) : Reserve(out);
+    p = PutHex(p, pc, 4);
+    *p++ = ' ';
+
+    if (image->kind[pc] == BYTE_CODE) {
+      p = PutInstruction(p, image, image->memory + pc);
+      pc += Opcodes[image->memory[pc]].length;
+    }
+    else {
+      /* Data lines stop at code and at labels */
+      uint32_t end = pc;
+      char label[NAME_SIZE];
+      p = PutText(p, "DB ");
+      do {
+        p = PutHex(PutText(p, end > pc ? ",$" : "$"),
+                   image->memory[end], 2);
+        end++;
+      } while (end < image->space && end < pc + DATA_PER_LINE &&
+               image->kind[end] != BYTE_CODE &&
+               !(image->labels && LabelOf(image, end, label) != NULL));
+      pc = end;
+    }
+    *p++ = '\n';
+    out->used = p - out->buffer;
+  }
+}
+
+/*
+ * Function: ReadSymbols
+ * ---------------------
+ *  Reads a symbol file: an address and a name per line, like
+ *  "$20c0 isrDelay" or "0x0100 Start", blank lines and comments(; or #)
+ *  left out. Names are letters, digits, _ and . but don't start with a
+ *  digit
+ *
+ *  filename: symbol file
+ *
+ *  returns: the name of every address(NULL for none), NULL on errors
+ */
+char **ReadSymbols(const char *filename)
+{
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Can't open %s\n", filename);
+    return NULL;
+  }
+  char **symbols = calloc(0x10000, sizeof(char *));
+  if (symbols == NULL) {
+    fprintf(stderr, "Can't allocate the symbols\n");
+    fclose(fp);
+    return NULL;
+  }
+
+  char line[256];
+  int number = 0;
+  int error = 0;
+  while (!error && fgets(line, sizeof(line), fp) != NULL) {
+    char *p = line;
+    number++;
+    p[strcspn(p, ";#\r\n")] = '\0';
+    p += strspn(p, " \t");
+    if (*p == '\0') {
+      continue;
+    }
+
+    /* Address */
+    if (*p == '$') {
+      p++;
+    }
+    char *end;
+    unsigned long addr = strtoul(p, &end, 16);
+    error = end == p || addr > 0xffff || (*end != ' ' && *end != '\t');
+
+    /* Name */
+    p = end + strspn(end, " \t");
+    size_t length = strspn(p, "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                           "abcdefghijklmnopqrstuvwxyz0123456789_.");
+    error = error || length == 0 || length >= NAME_SIZE ||
+            (*p >= '0' && *p <= '9') || p[length + strspn(p + length, " \t")];
+    if (!error) {
+      free(symbols[addr]);
+      symbols[addr] = strndup(p, length);
+      error = symbols[addr] == NULL;
+    }
+  }
+  fclose(fp);
+
+  if (error) {
+    fprintf(stderr, "%s:%d: expected an address and a name\n", filename,
+            number);
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+      free(symbols[addr]);
+    }
+    free(symbols);
+    return NULL;
+  }
+
+  return symbols;
+}
+
+/*
+ * Function: FindTargets
+ * ---------------------
+ *  First pass of a labelled listing, over the code once: marks the
+ *  targets of jumps, calls, RSTs and memory references(LDA, STA, LHLD,
+ *  SHLD) in the bitmaps of the image, and in a linear listing where its
+ *  lines start. The entry points decoded as code count as subroutines
+ *  LXI operands are as often numbers as addresses, so they're left out
+ *
+ *  image: image to disassemble, after Traverse when recursive
+ *  entries: entry points of a recursive listing
+ *  count: number of entries
+ *
+ *  returns: void
+ */
+void FindTargets(Image *image, const uint16_t *entries, int count)
+{
+  uint32_t pc = 0;
+
+  for (int i = 0; i < count; i++) {
+    uint16_t addr = entries[i];
+    if (addr < image->space && image->kind[addr] == BYTE_CODE) {
+      image->target[TARGET_CALL][addr >> 3] |= 1 << (addr & 7);
+    }
+  }
+
+  while (pc < image->space) {
+    uint8_t op = image->memory[pc];
+    const Opcode *opcode = &Opcodes[op];
+
+    if (image->recursive && image->kind[pc] != BYTE_CODE) {
+      pc++;
+      continue;
+    }
+    if (!image->recursive) {
+      image->start[pc >> 3] |= 1 << (pc & 7);
+    }
+
+    int target = -1;
+    switch (opcode->flow) {
+      case I8080_FLOW_JUMP:
+      case I8080_FLOW_BRANCH: {
+        target = TARGET_JUMP;
+        break;
+      }
+      case I8080_FLOW_CALL:
+      case I8080_FLOW_CALL_IF:
+      case I8080_FLOW_RESTART: {
+        target = TARGET_CALL;
+        break;
+      }
+      default: {
+        switch (op) {
+          case 0x22: // SHLD
+          case 0x2a: // LHLD
+          case 0x32: // STA
+          case 0x3a: { // LDA
+            target = TARGET_DATA;
+            break;
+          }
+        }
+        break;
+      }
+    }
+    if (target >= 0 && pc + opcode->length <= image->size) {
+      uint16_t addr = Target(image, pc);
+      image->target[target][addr >> 3] |= 1 << (addr & 7);
+    }
+
+    pc += opcode->length;
+  }
+}
+
+/*
+ * Function: Placed
+ * ----------------
+ *  Tells if a line of the listing starts at an address, where a label
+ *  can go. Data lines are cut at labels
+ *
+ *  image: image disassembled
+ *  addr: address
+ *
+ *  returns: 1 if a label can go there, 0 otherwise
+ */
+int Placed(const Image *image, uint32_t addr)
+{
+  if (addr >= image->space) {
+    return 0;
+  }
+  if (image->recursive) {
+    return image->kind[addr] != BYTE_OPERAND;
+  }
+  return image->start[addr >> 3] >> (addr & 7) & 1;
+}
+
+/*
+ * Function: LabelOf
+ * -----------------
+ *  Names an address: its symbol, or a label when it's a target and a line
+ *  of the listing starts there
+ *
+ *  image: image disassembled
+ *  addr: address
+ *  buffer: NAME_SIZE bytes for a label made up
+ *
+ *  returns: the name, NULL if the address has none
+ */
+const char *LabelOf(const Image *image, uint32_t addr, char *buffer)
+{
+  static const char prefix[TARGETS] = { 'S', 'L', 'D' };
+
+  if (addr > 0xffff) {
+    return NULL;
+  }
+  if (image->symbols != NULL && image->symbols[addr] != NULL) {
+    return image->symbols[addr];
+  }
+  if (!Placed(image, addr)) {
+    return NULL;
+  }
+  for (int target = 0; target < TARGETS; target++) {
+    if (image->target[target][addr >> 3] >> (addr & 7) & 1) {
+      buffer[0] = prefix[target];
+      *PutHex(buffer + 1, addr, 4) = '\0';
+      return buffer;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Function: ListEquates
+ * ---------------------
+ *  Defines the symbols no line of the listing starts at(RAM, I/O
+ *  buffers, the middle of an instruction) with EQU
+ *
+ *  image: image disassembled, after FindTargets
+ *  out: listing
+ *
+ *  returns: void
+ */
+void ListEquates(const Image *image, Output *out)
+{
+  if (image->symbols == NULL) {
+    return;
+  }
+  for (uint32_t addr = 0; addr < 0x10000; addr++) {
+    if (image->symbols[addr] != NULL && !Placed(image, addr)) {
+      char *p = PutText(Reserve(out), image->symbols[addr]);
+      p = PutHex(PutText(p, " EQU $"), addr, 4);
+      *p++ = '\n';
+      out->used = p - out->buffer;
+    }
+  }
+}
+
+/*
+ * Function: PutLabel
+ * ------------------
+ *  Writes the label line of an address when it has a name, and makes
+ *  room for the line that follows
+ *
+ *  out: listing
+ *  image: image disassembled
+ *  pc: address of the next line
+ *
+ *  returns: where the next line goes
+ */
+char *PutLabel(Output *out, const Image *image, uint32_t pc)
+{
+  char label[NAME_SIZE];
+  const char *name = LabelOf(image, pc, label);
+
+  if (name != NULL) {
+    char *p = PutText(Reserve(out), name);
+    *p++ = ':';
+    *p++ = '\n';
+    out->used = p - out->buffer;
+  }
+  return Reserve(out);
+}
+
+/*
+ * Function: PutInstruction
+ * ------------------------
+ *  Writes an instruction, naming its address operand when it has a label
+ *  LXI operands are only named after symbols
+ *
+ *  p: where to write
+ *  image: image disassembled
+ *  code: the bytes of the instruction
+ *
+ *  returns: end of the text
+ */
+char *PutInstruction(char *p, const Image *image, const uint8_t *code)
+{
+  const Opcode *opcode = &Opcodes[code[0]];
+
+  if (image->labels && opcode->operand == I8080_OPERAND_WORD) {
+    uint16_t addr = code[1] | code[2] << 8;
+    char label[NAME_SIZE];
+    const char *name = NULL;
+    if ((code[0] & 0xcf) != 0x01) {
+      name = LabelOf(image, addr, label);
+    }
+    else if (image->symbols != NULL) { // LXI
+      name = image->symbols[addr];
+    }
+    if (name != NULL) {
+      return PutText(PutText(p, opcode->mnemonic), name);
+    }
+  }
+  Disassemble(code, 0, p);
+
+  return p + strlen(p);
+}
+
+/*
+ * Function: WriteGraph
+ * --------------------
+ *  Writes the control flow graph found by Traverse in Graphviz format:
+ *  a node per basic block, an edge per jump, call, branch or fall through
+ *
+ *  image: image disassembled
+ *  filename: file to write
+ *
+ *  returns: 0 on success, -1 if the file can't be written
+ */
+int WriteGraph(const Image *image, const char *filename)
+{
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) {
+    return -1;
+  }
+
+  fprintf(fp, "digraph code {\n");
+  fprintf(fp, "  node [shape=box fontname=monospace];\n");
+  for (uint32_t start = 0; start < image->space; start++) {
+    if (!image->leader[start] || image->kind[start] != BYTE_CODE) {
+      continue;
+    }
+
+    /* Decode up to the instruction ending the block */
+    uint32_t addr = start;
+    uint32_t next = start;
+    const Opcode *opcode;
+    do {
+      addr = next;
+      opcode = &Opcodes[image->memory[addr]];
+      next = addr + opcode->length;
+    } while (opcode->flow == I8080_FLOW_NEXT && next < image->space &&
+             image->kind[next] == BYTE_CODE && !image->leader[next]);
+
+    fprintf(fp, "  L%04x [label=\"%04x-%04x\"];\n", start, start, next - 1);
+
+    uint32_t target = Target(image, addr);
+    int jumps = opcode->flow == I8080_FLOW_JUMP ||
+                opcode->flow == I8080_FLOW_BRANCH ||
+                opcode->flow == I8080_FLOW_CALL ||
+                opcode->flow == I8080_FLOW_CALL_IF ||
+                opcode->flow == I8080_FLOW_RESTART;
+    int falls = opcode->flow != I8080_FLOW_JUMP &&
+                opcode->flow != I8080_FLOW_RETURN &&
+                opcode->flow != I8080_FLOW_INDIRECT;
+    if (jumps && target < image->space && image->kind[target] == BYTE_CODE) {
+      int call = opcode->flow == I8080_FLOW_CALL ||
+                 opcode->flow == I8080_FLOW_CALL_IF ||
+                 opcode->flow == I8080_FLOW_RESTART;
+      fprintf(fp, "  L%04x -> L%04x%s;\n", start, target,
+              call ? " [style=dashed]" : "");
+    }
+    if (falls && next < image->space && image->kind[next] == BYTE_CODE) {
+      fprintf(fp, "  L%04x -> L%04x;\n", start, next);
+    }
+  }
+  fprintf(fp, "}\n");
+
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+/*
+ * Function: Reserve
+ * -----------------
+ *  Makes room for a line of the listing, writing the buffer out first
+ *  when it's nearly full, or growing it when the listing is in memory
+ *
+ *  out: listing
+ *
+ *  returns: where the line goes, the caller moves used past it
+ */
+char *Reserve(Output *out)
+{
+  if (out->size - out->used >= LINE_SIZE) {
+    return out->buffer + out->used;
+  }
+
+  if (out->fp != NULL) {
+    Flush(out);
+  }
+  else {
+    out->size = out->size * 2 + OUTPUT_SIZE / 16;
+    out->buffer = realloc(out->buffer, out->size);
+    if (out->buffer == NULL) {
+      fprintf(stderr, "Can't allocate %zu bytes of listing\n", out->size);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return out->buffer + out->used;
+}
+
+/*
+ * Function: Flush
+ * ---------------
+ *  Writes the buffered listing to its file
+ *
+ *  out: listing
+ *
+ *  returns: void
+ */
+void Flush(Output *out)
+{
+  if (out->used > 0 && fwrite(out->buffer, 1, out->used, out->fp) !=
+      out->used) {
+    out->error = 1;
+  }
+  out->used = 0;
+}
 
 /*
- * Function: Disassembler
- * ----------------------
- *  Reads machine code and disassembles it to 8080 assembly instruction code
+ * Function: Write
+ * ---------------
+ *  Writes a listing made in memory after the buffered one
+ *
+ *  out: listing written to its file
+ *  data: listing to write
+ *  size: bytes of it
  *
- *  codebuffer: pointer to the 8080 assembly ROM from a memory buffer
- *  pc: the current program counter
+ *  returns: void
+ */
+void Write(Output *out, const char *data, size_t size)
+{
+  if (size == 0) {
+    return;
+  }
+  Flush(out);
+  if (fwrite(data, 1, size, out->fp) != size) {
+    out->error = 1;
+  }
+}
+
+/*
+ * Function: PutHex
+ * ----------------
+ *  Writes a number in lower case hexadecimal
+ *
+ *  p: where to write
+ *  value: number
+ *  digits: digits written, with leading zeros
+ *
+ *  returns: end of the digits
+ */
+char *PutHex(char *p, uint32_t value, int digits)
+{
+  static const char hex[16] = "0123456789abcdef";
+
+  for (int i = digits - 1; i >= 0; i--) {
+    p[i] = hex[value & 0xf];
+    value >>= 4;
+  }
+  return p + digits;
+}
+
+/*
+ * Function: PutText
+ * -----------------
+ *  Copies a string without its terminator
+ *
+ *  p: where to write
+ *  text: string
+ *
+ *  returns: end of the copy
+ */
+char *PutText(char *p, const char *text)
+{
+  while (*text != '\0') {
+    *p++ = *text++;
+  }
+  return p;
+}
+
+/*
+ * Function: Seconds
+ * -----------------
+ *  Reads the monotonic clock
  *
- *  returns: returns the number of bytes
- *           required from the OpCode(to increment PC)
+ *  returns: current time in seconds
  */
-int Disassembler(uint8_t *codebuffer, int pc)
+double Seconds(void)
 {
-  uint8_t *code = &codebuffer[pc];
-  int opbytes = 1;
-
-  printf("%04x ", pc);
-  switch(*code)
-  {
-    case 0x00: printf("NOP"); break;
-    case 0x01: printf("LXI B,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x02: printf("STAX B"); break;
-    case 0x03: printf("INX B"); break;
-    case 0x04: printf("INR B"); break;
-    case 0x05: printf("DCR B"); break;
-    case 0x06: printf("MVI B,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x07: printf("RLC"); break;
-    case 0x08: break; // Free OpCode
-    case 0x09: printf("DAD B"); break;
-    case 0x0a: printf("LDAX B"); break;
-    case 0x0b: printf("DCX B"); break;
-    case 0x0c: printf("INR C"); break;
-    case 0x0d: printf("DCR C"); break;
-    case 0x0e: printf("MCI C,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x0f: printf("RRC"); break;
-    case 0x10: break; // Free OpCode
-    case 0x11: printf("LXI D,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x12: printf("STAX D"); break;
-    case 0x13: printf("INX D"); break;
-    case 0x14: printf("INR D"); break;
-    case 0x15: printf("DCR D"); break;
-    case 0x16: printf("MVI D,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x17: printf("RAL"); break;
-    case 0x18: break; // Free OpCode
-    case 0x19: printf("DAD D"); break;
-    case 0x1a: printf("LDAX D"); break;
-    case 0x1b: printf("DCX D"); break;
-    case 0x1c: printf("INR E"); break;
-    case 0x1d: printf("DCR E"); break;
-    case 0x1e: printf("MVI E,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x1f: printf("RAR"); break;
-    case 0x20: break; // Free OpCode
-    case 0x21: printf("LXI H,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x22: printf("SHLD $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x23: printf("INX H"); break;
-    case 0x24: printf("INR H"); break;
-    case 0x25: printf("DCR H"); break;
-    case 0x26: printf("MVI H,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x27: printf("DAA"); // Allows decimal arithmetic
-    case 0x28: break; // Free OpCode
-    case 0x29: printf("DAD H"); break;
-    case 0x2a: printf("LHLD $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x2b: printf("DCX H"); break;
-    case 0x2c: printf("INR L"); break;
-    case 0x2d: printf("DCR L"); break;
-    case 0x2e: printf("MVI L,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x2f: printf("CMA"); break;
-    case 0x30: break; // Free OpCode
-    case 0x31: printf("LXI SP,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x32: printf("STA $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x33: printf("INX SP"); break;
-    case 0x34: printf("INR M"); break;
-    case 0x35: printf("DCR M"); break;
-    case 0x36: printf("MVI M,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x37: printf("STC"); break;
-    case 0x38: break; // Free OpCode
-    case 0x39: printf("DAD SP"); break;
-    case 0x3a: printf("LDA $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x3b: printf("DCX SP"); break;
-    case 0x3c: printf("INR A"); break;
-    case 0x3d: printf("DCR A"); break;
-    case 0x3e: printf("MVI A, $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x3f: printf("CMC"); break;
-    case 0x40: printf("MOV B,B"); break;
-    case 0x41: printf("MOV B,C"); break;
-    case 0x42: printf("MOV B,D"); break;
-    case 0x43: printf("MOV B,E"); break;
-    case 0x44: printf("MOV B,H"); break;
-    case 0x45: printf("MOV B,L"); break;
-    case 0x46: printf("MOV B,M"); break;
-    case 0x47: printf("MOV B,A"); break;
-    case 0x48: printf("MOV C,B"); break;
-    case 0x49: printf("MOV C,C"); break;
-    case 0x4a: printf("MOV C,D"); break;
-    case 0x4b: printf("MOV C,E"); break;
-    case 0x4c: printf("MOV C,H"); break;
-    case 0x4d: printf("MOV C,L"); break;
-    case 0x4e: printf("MOV C,M"); break;
-    case 0x4f: printf("MOV C,A"); break;
-    case 0x50: printf("MOV D,B"); break;
-    case 0x51: printf("MOV D,C"); break;
-    case 0x52: printf("MOV D,D"); break;
-    case 0x53: printf("MOV D,E"); break;
-    case 0x54: printf("MOV D,H"); break;
-    case 0x55: printf("MOV D,L"); break;
-    case 0x56: printf("MOV D,M"); break;
-    case 0x57: printf("MOV D,A"); break;
-    case 0x58: printf("MOV E,B"); break;
-    case 0x59: printf("MOV E,C"); break;
-    case 0x5a: printf("MOV E,D"); break;
-    case 0x5b: printf("MOV E,E"); break;
-    case 0x5c: printf("MOV E,H"); break;
-    case 0x5d: printf("MOV E,L"); break;
-    case 0x5e: printf("MOV E,M"); break;
-    case 0x5f: printf("MOV E,A"); break;
-    case 0x60: printf("MOV H,B"); break;
-    case 0x61: printf("MOV H,C");	break;
-    case 0x62: printf("MOV H,D"); break;
-    case 0x63: printf("MOV H,E"); break;
-    case 0x64: printf("MOV H,H"); break;
-    case 0x65: printf("MOV H,L"); break;
-    case 0x66: printf("MOV H,M"); break;
-    case 0x67: printf("MOV H,A"); break;
-    case 0x68: printf("MOV L,B"); break;
-    case 0x69: printf("MOV L,C"); break;
-    case 0x6a: printf("MOV L,D"); break;
-    case 0x6b: printf("MOV L,E"); break;
-    case 0x6c: printf("MOV L,H"); break;
-    case 0x6d: printf("MOV L,L"); break;
-    case 0x6e: printf("MOV L,M"); break;
-    case 0x6f: printf("MOV L,A"); break;
-    case 0x70: printf("MOV M,B"); break;
-    case 0x71: printf("MOV M,C"); break;
-    case 0x72: printf("MOV M,D"); break;
-    case 0x73: printf("MOV M,E"); break;
-    case 0x74: printf("MOV M,H"); break;
-    case 0x75: printf("MOV M,L"); break;
-    case 0x76: printf("HLT"); break;
-    case 0x77: printf("MOV M,A"); break;
-    case 0x78: printf("MOV A,B"); break;
-    case 0x79: printf("MOV A,C"); break;
-    case 0x7a: printf("MOV A,D"); break;
-    case 0x7b: printf("MOV A,E"); break;
-    case 0x7c: printf("MOV A,H"); break;
-    case 0x7d: printf("MOV A,L"); break;
-    case 0x7e:	printf("MOV A,M"); break;
-    case 0x7f:	printf("MOV A,A"); break;
-    case 0x80:	printf("ADD B"); break;
-    case 0x81:	printf("ADD C"); break;
-    case 0x82:	printf("ADD D"); break;
-    case 0x83:	printf("ADD E"); break;
-    case 0x84:	printf("ADD H"); break;
-    case 0x85:	printf("ADD L"); break;
-    case 0x86:	printf("ADD M"); break;
-    case 0x87:	printf("ADD A"); break;
-    case 0x88:	printf("ADC B"); break;
-    case 0x89:	printf("ADC C"); break;
-    case 0x8a:	printf("ADC D"); break;
-    case 0x8b:	printf("ADC E"); break;
-    case 0x8c:	printf("ADC H"); break;
-    case 0x8d:	printf("ADC L"); break;
-    case 0x8e:	printf("ADC M"); break;
-    case 0x8f:	printf("ADC A"); break;
-    case 0x90:	printf("SUB B"); break;
-    case 0x91:	printf("SUB C"); break;
-    case 0x92:	printf("SUB D"); break;
-    case 0x93:	printf("SUB E"); break;
-    case 0x94:	printf("SUB H"); break;
-    case 0x95:	printf("SUB L"); break;
-    case 0x96:	printf("SUB M"); break;
-    case 0x97:	printf("SUB A"); break;
-    case 0x98:	printf("SBB B"); break;
-    case 0x99:	printf("SBB C"); break;
-    case 0x9a:	printf("SBB D"); break;
-    case 0x9b:	printf("SBB E"); break;
-    case 0x9c:	printf("SBB H"); break;
-    case 0x9d:	printf("SBB L"); break;
-    case 0x9e:	printf("SBB M"); break;
-    case 0x9f:	printf("SBB A"); break;
-    case 0xa0:	printf("ANA B"); break;
-    case 0xa1:	printf("ANA C"); break;
-    case 0xa2:	printf("ANA D"); break;
-    case 0xa3:	printf("ANA E"); break;
-    case 0xa4:	printf("ANA H"); break;
-    case 0xa5:	printf("ANA L"); break;
-    case 0xa6:	printf("ANA M"); break;
-    case 0xa7:	printf("ANA A"); break;
-    case 0xa8:	printf("XRA B"); break;
-    case 0xa9:	printf("XRA C"); break;
-    case 0xaa:	printf("XRA D"); break;
-    case 0xab:	printf("XRA E"); break;
-    case 0xac:	printf("XRA H"); break;
-    case 0xad:	printf("XRA L"); break;
-    case 0xae:	printf("XRA M"); break;
-    case 0xaf:	printf("XRA A"); break;
-    case 0xb0:	printf("ORA B"); break;
-    case 0xb1:	printf("ORA C"); break;
-    case 0xb2:	printf("ORA D"); break;
-    case 0xb3:	printf("ORA E"); break;
-    case 0xb4:	printf("ORA H"); break;
-    case 0xb5:	printf("ORA L"); break;
-    case 0xb6:	printf("ORA M"); break;
-    case 0xb7:	printf("ORA A"); break;
-    case 0xb8:	printf("CMP B"); break;
-    case 0xb9:	printf("CMP C"); break;
-    case 0xba:	printf("CMP D"); break;
-    case 0xbb:	printf("CMP E"); break;
-    case 0xbc:	printf("CMP H"); break;
-    case 0xbd:	printf("CMP L"); break;
-    case 0xbe:	printf("CMP M"); break;
-    case 0xbf:	printf("CMP A"); break;
-    case 0xc0: printf("RNZ"); break;
-    case 0xc1: printf("POP B"); break;
-    case 0xc2: printf("JNZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xc3: printf("JMP $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xc4: printf("CNZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xc5: printf("PUSH B"); break;
-    case 0xc6: printf("ADI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xc7: printf("RST 0"); break;
-    case 0xc8: printf("RZ"); break;
-    case 0xc9: printf("RET"); break;
-    case 0xca: printf("JZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xcb: break; // Free Opcode
-    case 0xcc: printf("CZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xcd: printf("CALL $%02x%02x", code[2], code[1]);
-    	         opbytes = 3;
-               break;
-    case 0xce: printf("ACI $%02x", code[1]);
-        	     opbytes = 2;
-               break;
-    case 0xcf: printf("RST 1"); break;
-    case 0xd0: printf("RNC"); break;
-    case 0xd1: printf("POP D"); break;
-    case 0xd2: printf("JNC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xd3: printf("OUT $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xd4: printf("CNC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xd5: printf("PUSH D"); break;
-    case 0xd6: printf("SUI D8");
-               opbytes = 2;
-               break;
-    case 0xd7: printf("RST 2"); break;
-    case 0xd8: printf("RC"); break;
-    case 0xd9: break; // Free OpCode
-    case 0xda: printf("JC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xdb: printf("IN $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xdc: printf("CC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xdd: break; // Free OpCode
-    case 0xde: printf("SBI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xdf: printf("RST 3"); break;
-    case 0xe0: printf("RPO"); break;
-    case 0xe1: printf("POP H"); break;
-    case 0xe2: printf("JPO $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xe3: printf("XTHL"); break;
-    case 0xe4: printf("CPO $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xe5: printf("PUSH H"); break;
-    case 0xe6: printf("ANI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xe7: printf("RST 4"); break;
-    case 0xe8: printf("RPE"); break;
-    case 0xe9: printf("PCHL"); break;
-    case 0xea: printf("JPE $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xeb: printf("XCHG"); break;
-    case 0xec: printf("CPE $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xed: break; // Free OpCode
-    case 0xee: printf("XRI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xef: printf("RST 5"); break;
-    case 0xf0: printf("RP"); break;
-    case 0xf1: printf("POP PSW"); break;
-    case 0xf2: printf("JP $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xf3: printf("DI"); break;
-    case 0xf4: printf("CP $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xf5: printf("PUSH PSW"); break;
-    case 0xf6: printf("ORI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xf7: printf("RST 6");
-    case 0xf8: printf("RM"); break;
-    case 0xf9: printf("SPHL"); break;
-    case 0xfa: printf("JM $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xfb: printf("EI"); break;
-    case 0xfc: printf("CM $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xfd: break; // Free OpCode
-    case 0xfe: printf("CPI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xff: printf("RST 7"); break;
-
-    default: break;
-  }
-
-  printf("\n");
-
-  return opbytes;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
 }
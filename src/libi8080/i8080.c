@@ -0,0 +1,5276 @@
+/*
+  License: DOWHATEVERYOUWANT
+
+  libi8080: embeddable Intel 8080 CPU core
+
+  A complete emulation of all the opcode of the Intel 8080 CPU architecture,
+  shared by the programs in this repository. See i8080.h for the interface
+*/
+#ifdef __linux__
+#define _GNU_SOURCE // memfd_create
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <strings.h>
+#include "i8080.h"
+
+
+/*
+  Threaded dispatch(-DTHREADED_DISPATCH) needs GCC labels as values
+  Other compilers fall back to the portable switch
+*/
+#if defined(THREADED_DISPATCH) && !defined(__GNUC__)
+#undef THREADED_DISPATCH
+#endif
+
+
+/*
+  The JIT(-DJIT) emits x86-64 code and needs GCC on a POSIX system
+  Other targets fall back to the interpreter
+  It replaces the decoded block cache, so BLOCK_CACHE is ignored
+*/
+#if defined(JIT) && !(defined(__GNUC__) && defined(__x86_64__) && \
+                      defined(__unix__))
+#undef JIT
+#endif
+#if defined(JIT) && defined(BLOCK_CACHE)
+#undef BLOCK_CACHE
+#endif
+
+#if defined(JIT) || defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(JIT) && !defined(__linux__)
+#include <fcntl.h> // shm_open
+#endif
+
+
+/* Longest straight-line run kept in one decoded block */
+#define BLOCK_INSTRUCTIONS 32
+#define BLOCK_BYTES (BLOCK_INSTRUCTIONS * 3)
+
+
+/* Struct definitions */
+typedef struct Decoded {
+  uint8_t bytes[3]; // Opcode and operands copied out of memory
+  uint8_t cycles; // Clock cycles of the opcode
+#ifdef THREADED_DISPATCH
+  const void *handler; // Label of the opcode handler
+#endif
+} Decoded;
+
+typedef struct Block {
+  uint16_t start; // Address of the first instruction
+  int size; // Number of bytes decoded
+  int length; // Number of instructions decoded
+  struct Block *retired; // Next invalidated block waiting to be freed
+  Decoded code[BLOCK_INSTRUCTIONS];
+} Block;
+
+typedef struct BlockCache {
+  Block *blocks[0x10000]; // Decoded blocks indexed by start address
+  uint16_t code[0x10000]; // Number of blocks covering each byte
+  uint32_t pages[0x100]; // Sum of code over each 256-byte page
+  Block *retired; // Invalidated blocks, freed at the next lookup
+  uint64_t hits; // Lookups finding a decoded block
+  uint64_t misses; // Lookups decoding a new block
+  uint64_t invalidations; // Blocks dropped by writes into their code
+} BlockCache;
+
+/*
+  Memory holding translated blocks and the shared routines, mapped
+  twice: once executable, where the code runs and every pointer into it
+  points, and once writable, where it's emitted and patched
+*/
+#define JIT_ARENA_BYTES (16 << 20)
+/* Upper bound of the native code of one block and its stubs */
+#define JIT_BLOCK_CODE (16 << 10)
+/* Jumps between blocks tracked before the arena is flushed */
+#define JIT_LINKS 0x10000
+/* Stubs of a single block */
+#define JIT_FIXUPS 256
+
+/* Kinds of stub emitted after the body of a block */
+enum { JIT_REFUSE, JIT_WRITTEN, JIT_EXIT, JIT_LINK, JIT_STOP };
+
+typedef struct JitLink {
+  uint8_t *field; // rel32 field of a jump to the guest address
+  uint8_t *stub; // Slow path looking the address up at run time
+  struct JitLink *next; // Next jump to the same guest address
+} JitLink;
+
+typedef struct JitFixup {
+  int kind; // JIT_REFUSE, JIT_WRITTEN, JIT_EXIT, JIT_LINK or JIT_STOP
+  uint8_t *field; // rel32 field of the jump to the stub
+  uint8_t *resume; // Code following the store(JIT_WRITTEN)
+  uint16_t target; // Guest address to continue at(JIT_EXIT, JIT_LINK)
+  uint8_t skipped; // Instructions of the block left unexecuted(JIT_EXIT,
+                   // JIT_STOP)
+} JitFixup;
+
+typedef struct Jit {
+  uint8_t *entry[0x10000]; // Native code of the block at each address
+  uint8_t code[0x10000]; // Number of blocks covering each byte
+  uint8_t size[0x10000]; // Guest bytes translated by the block at an address
+  uint8_t written; // Set by translated code when a store hits a block
+  JitLink *incoming[0x10000]; // Jumps into the block at each address
+  JitLink links[JIT_LINKS];
+  int nlinks;
+  JitFixup fixups[JIT_FIXUPS]; // Stubs of the block being translated
+  int nfixups;
+  int pending; // Cycles not yet added to the counter(translating)
+  uint8_t *arena; // Executable view of the code
+  uint8_t *writable; // Writable view of the same pages
+  uint8_t *first; // First byte after the shared routines
+  uint8_t *top; // Next free byte of the arena
+  uint8_t *dispatch; // Continues at the guest address in eax
+  uint8_t *exit; // Returns to the caller of enter
+  uint64_t (*enter)(States *state, uint64_t budget, uint64_t cycle_limit,
+                    uint8_t *code, struct Jit *jit);
+  uint64_t blocks; // Blocks translated
+  uint64_t invalidations; // Blocks dropped by writes into their code
+  uint64_t flushes; // Times the arena was emptied
+  uint64_t interpreted; // Instructions stepped by the interpreter
+} Jit;
+
+/*
+  Saved machine. On Linux the memory lives in an anonymous file that
+  forks map privately, so the kernel copies a page only when a fork
+  writes to it. Elsewhere forks get a full copy
+*/
+struct Snapshot {
+  States registers; // Registers, flags and counters(pointers cleared)
+  uint8_t *memory; // 64 KB, read only
+  int fd; // File holding the memory, -1 when it's a plain copy
+  uint32_t size; // Bytes of device state
+  uint8_t *devices; // Device state saved by the host
+};
+
+/*
+  Snapshot file: magic, registers, size of the device state, interrupts
+  (EI cycle, raised request, scheduled interrupts), device state, memory
+*/
+#define SNAPSHOT_MAGIC "I8080SS2"
+#define SNAPSHOT_HEADER (44 + 13 * I8080_SCHEDULED)
+
+/*
+  Input log. Every event is the number of cycles since the previous one,
+  shifted left by one with the kind in bit 0, as a little endian base 128
+  varint, followed by the port and value(IN) or the vector(interrupt)
+  Most events take 3 or 4 bytes
+*/
+enum { EVENT_INPUT, EVENT_INTERRUPT };
+
+struct Recorder {
+  FILE *fp; // Log file
+  int replaying; // Replay the log instead of writing it
+  int failed; // A write to the log failed
+  uint64_t last; // Cycle counter at the previous event
+  uint64_t events; // Events written or replayed
+  /* Next event of the log, read ahead while replaying */
+  int pending; // Set while there is one
+  int kind; // EVENT_INPUT or EVENT_INTERRUPT
+  uint64_t cycles; // Cycle counter when it happens
+  uint8_t port; // Port read, or vector of the interrupt
+  uint8_t value; // Value read
+};
+
+/* Log file: magic, cycle counter and hash of the machine, then events */
+#define RECORDER_MAGIC "I8080RL1"
+#define RECORDER_HEADER 20
+
+/*
+  Two pass assembler(Assemble). The first pass finds the address of
+  every label, the second writes the code. Symbols live in an open
+  addressing hash table grown when half full
+*/
+#define ASSEMBLER_SYMBOLS 1024 // Initial slots of the symbol table
+#define ASSEMBLER_NAME 32 // Longest symbol and its terminator
+#define ASSEMBLER_LINE 256 // Longest line of source and its terminator
+#define ASSEMBLER_OPERANDS 8 // Operands of a statement(DB, DW)
+
+typedef struct AsmSymbol {
+  char name[ASSEMBLER_NAME]; // Empty for a free slot
+  uint16_t value;
+} AsmSymbol;
+
+typedef struct Assembler {
+  uint8_t *memory; // 64 KB receiving the code
+  uint32_t pc; // Address of the next byte, 0x10000 when memory is full
+  int pass; // 1 finds the labels, 2 writes the code
+  int error; // First error, I8080_OK otherwise
+  int undefined; // An expression used a symbol not defined yet
+  int done; // END was met
+  uint32_t low; // Lowest address written
+  uint32_t high; // Highest address written + 1
+  AsmSymbol *symbols;
+  uint32_t size; // Slots of the symbol table
+  uint32_t count; // Symbols defined
+} Assembler;
+
+
+/* Condition flags as PSW bits */
+#define FLAG_CY 0x01
+#define FLAG_P 0x04
+#define FLAG_AC 0x10
+#define FLAG_Z 0x40
+#define FLAG_S 0x80
+
+
+/* Zero, sign and parity flags of every 8 bit result */
+static const uint8_t ZSPTable[256] = {
+  0x44, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84
+
+};
+
+/*
+  Auxiliary carry out of bit 3 for additions and subtractions
+  Indexed by bit 3 of the accumulator, the operand and the result
+  Subtractions add the two's complement, so AC is set when there is no borrow
+*/
+static const uint8_t ACAddTable[8] = {
+  0, FLAG_AC, FLAG_AC, FLAG_AC, 0, 0, 0, FLAG_AC
+};
+static const uint8_t ACSubTable[8] = {
+  FLAG_AC, FLAG_AC, 0, FLAG_AC, 0, FLAG_AC, 0, 0
+};
+
+/* Shorthands of the opcode table */
+#define SZAP (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P)
+#define ALL (SZAP | FLAG_CY)
+#define CY FLAG_CY
+#define NEXT I8080_FLOW_NEXT
+#define JUMP I8080_FLOW_JUMP
+#define BRANCH I8080_FLOW_BRANCH
+#define CALL I8080_FLOW_CALL
+#define CALL_IF I8080_FLOW_CALL_IF
+#define RETURN I8080_FLOW_RETURN
+#define RETURN_IF I8080_FLOW_RETURN_IF
+#define RESTART I8080_FLOW_RESTART
+#define INDIRECT I8080_FLOW_INDIRECT
+#define HALT I8080_FLOW_HALT
+#define NONE I8080_OPERAND_NONE
+#define BYTE I8080_OPERAND_BYTE
+#define WORD I8080_OPERAND_WORD
+
+/*
+  Mnemonic, size in bytes, clock cycles(T-states) not taken and taken,
+  flags written, control flow and operand of every opcode
+  Undocumented opcodes are executed as 4 cycle NOPs
+*/
+const Opcode Opcodes[256] = {
+  { "NOP", 1, 4, 4, 0, NEXT, NONE }, // 0x00
+  { "LXI B,", 3, 10, 10, 0, NEXT, WORD }, // 0x01
+  { "STAX B", 1, 7, 7, 0, NEXT, NONE }, // 0x02
+  { "INX B", 1, 5, 5, 0, NEXT, NONE }, // 0x03
+  { "INR B", 1, 5, 5, SZAP, NEXT, NONE }, // 0x04
+  { "DCR B", 1, 5, 5, SZAP, NEXT, NONE }, // 0x05
+  { "MVI B,", 2, 7, 7, 0, NEXT, BYTE }, // 0x06
+  { "RLC", 1, 4, 4, CY, NEXT, NONE }, // 0x07
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0x08
+  { "DAD B", 1, 10, 10, CY, NEXT, NONE }, // 0x09
+  { "LDAX B", 1, 7, 7, 0, NEXT, NONE }, // 0x0a
+  { "DCX B", 1, 5, 5, 0, NEXT, NONE }, // 0x0b
+  { "INR C", 1, 5, 5, SZAP, NEXT, NONE }, // 0x0c
+  { "DCR C", 1, 5, 5, SZAP, NEXT, NONE }, // 0x0d
+  { "MVI C,", 2, 7, 7, 0, NEXT, BYTE }, // 0x0e
+  { "RRC", 1, 4, 4, CY, NEXT, NONE }, // 0x0f
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0x10
+  { "LXI D,", 3, 10, 10, 0, NEXT, WORD }, // 0x11
+  { "STAX D", 1, 7, 7, 0, NEXT, NONE }, // 0x12
+  { "INX D", 1, 5, 5, 0, NEXT, NONE }, // 0x13
+  { "INR D", 1, 5, 5, SZAP, NEXT, NONE }, // 0x14
+  { "DCR D", 1, 5, 5, SZAP, NEXT, NONE }, // 0x15
+  { "MVI D,", 2, 7, 7, 0, NEXT, BYTE }, // 0x16
+  { "RAL", 1, 4, 4, CY, NEXT, NONE }, // 0x17
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0x18
+  { "DAD D", 1, 10, 10, CY, NEXT, NONE }, // 0x19
+  { "LDAX D", 1, 7, 7, 0, NEXT, NONE }, // 0x1a
+  { "DCX D", 1, 5, 5, 0, NEXT, NONE }, // 0x1b
+  { "INR E", 1, 5, 5, SZAP, NEXT, NONE }, // 0x1c
+  { "DCR E", 1, 5, 5, SZAP, NEXT, NONE }, // 0x1d
+  { "MVI E,", 2, 7, 7, 0, NEXT, BYTE }, // 0x1e
+  { "RAR", 1, 4, 4, CY, NEXT, NONE }, // 0x1f
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0x20
+  { "LXI H,", 3, 10, 10, 0, NEXT, WORD }, // 0x21
+  { "SHLD ", 3, 16, 16, 0, NEXT, WORD }, // 0x22
+  { "INX H", 1, 5, 5, 0, NEXT, NONE }, // 0x23
+  { "INR H", 1, 5, 5, SZAP, NEXT, NONE }, // 0x24
+  { "DCR H", 1, 5, 5, SZAP, NEXT, NONE }, // 0x25
+  { "MVI H,", 2, 7, 7, 0, NEXT, BYTE }, // 0x26
+  { "DAA", 1, 4, 4, ALL, NEXT, NONE }, // 0x27
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0x28
+  { "DAD H", 1, 10, 10, CY, NEXT, NONE }, // 0x29
+  { "LHLD ", 3, 16, 16, 0, NEXT, WORD }, // 0x2a
+  { "DCX H", 1, 5, 5, 0, NEXT, NONE }, // 0x2b
+  { "INR L", 1, 5, 5, SZAP, NEXT, NONE }, // 0x2c
+  { "DCR L", 1, 5, 5, SZAP, NEXT, NONE }, // 0x2d
+  { "MVI L,", 2, 7, 7, 0, NEXT, BYTE }, // 0x2e
+  { "CMA", 1, 4, 4, 0, NEXT, NONE }, // 0x2f
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0x30
+  { "LXI SP,", 3, 10, 10, 0, NEXT, WORD }, // 0x31
+  { "STA ", 3, 13, 13, 0, NEXT, WORD }, // 0x32
+  { "INX SP", 1, 5, 5, 0, NEXT, NONE }, // 0x33
+  { "INR M", 1, 10, 10, SZAP, NEXT, NONE }, // 0x34
+  { "DCR M", 1, 10, 10, SZAP, NEXT, NONE }, // 0x35
+  { "MVI M,", 2, 10, 10, 0, NEXT, BYTE }, // 0x36
+  { "STC", 1, 4, 4, CY, NEXT, NONE }, // 0x37
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0x38
+  { "DAD SP", 1, 10, 10, CY, NEXT, NONE }, // 0x39
+  { "LDA ", 3, 13, 13, 0, NEXT, WORD }, // 0x3a
+  { "DCX SP", 1, 5, 5, 0, NEXT, NONE }, // 0x3b
+  { "INR A", 1, 5, 5, SZAP, NEXT, NONE }, // 0x3c
+  { "DCR A", 1, 5, 5, SZAP, NEXT, NONE }, // 0x3d
+  { "MVI A,", 2, 7, 7, 0, NEXT, BYTE }, // 0x3e
+  { "CMC", 1, 4, 4, CY, NEXT, NONE }, // 0x3f
+  { "MOV B,B", 1, 5, 5, 0, NEXT, NONE }, // 0x40
+  { "MOV B,C", 1, 5, 5, 0, NEXT, NONE }, // 0x41
+  { "MOV B,D", 1, 5, 5, 0, NEXT, NONE }, // 0x42
+  { "MOV B,E", 1, 5, 5, 0, NEXT, NONE }, // 0x43
+  { "MOV B,H", 1, 5, 5, 0, NEXT, NONE }, // 0x44
+  { "MOV B,L", 1, 5, 5, 0, NEXT, NONE }, // 0x45
+  { "MOV B,M", 1, 7, 7, 0, NEXT, NONE }, // 0x46
+  { "MOV B,A", 1, 5, 5, 0, NEXT, NONE }, // 0x47
+  { "MOV C,B", 1, 5, 5, 0, NEXT, NONE }, // 0x48
+  { "MOV C,C", 1, 5, 5, 0, NEXT, NONE }, // 0x49
+  { "MOV C,D", 1, 5, 5, 0, NEXT, NONE }, // 0x4a
+  { "MOV C,E", 1, 5, 5, 0, NEXT, NONE }, // 0x4b
+  { "MOV C,H", 1, 5, 5, 0, NEXT, NONE }, // 0x4c
+  { "MOV C,L", 1, 5, 5, 0, NEXT, NONE }, // 0x4d
+  { "MOV C,M", 1, 7, 7, 0, NEXT, NONE }, // 0x4e
+  { "MOV C,A", 1, 5, 5, 0, NEXT, NONE }, // 0x4f
+  { "MOV D,B", 1, 5, 5, 0, NEXT, NONE }, // 0x50
+  { "MOV D,C", 1, 5, 5, 0, NEXT, NONE }, // 0x51
+  { "MOV D,D", 1, 5, 5, 0, NEXT, NONE }, // 0x52
+  { "MOV D,E", 1, 5, 5, 0, NEXT, NONE }, // 0x53
+  { "MOV D,H", 1, 5, 5, 0, NEXT, NONE }, // 0x54
+  { "MOV D,L", 1, 5, 5, 0, NEXT, NONE }, // 0x55
+  { "MOV D,M", 1, 7, 7, 0, NEXT, NONE }, // 0x56
+  { "MOV D,A", 1, 5, 5, 0, NEXT, NONE }, // 0x57
+  { "MOV E,B", 1, 5, 5, 0, NEXT, NONE }, // 0x58
+  { "MOV E,C", 1, 5, 5, 0, NEXT, NONE }, // 0x59
+  { "MOV E,D", 1, 5, 5, 0, NEXT, NONE }, // 0x5a
+  { "MOV E,E", 1, 5, 5, 0, NEXT, NONE }, // 0x5b
+  { "MOV E,H", 1, 5, 5, 0, NEXT, NONE }, // 0x5c
+  { "MOV E,L", 1, 5, 5, 0, NEXT, NONE }, // 0x5d
+  { "MOV E,M", 1, 7, 7, 0, NEXT, NONE }, // 0x5e
+  { "MOV E,A", 1, 5, 5, 0, NEXT, NONE }, // 0x5f
+  { "MOV H,B", 1, 5, 5, 0, NEXT, NONE }, // 0x60
+  { "MOV H,C", 1, 5, 5, 0, NEXT, NONE }, // 0x61
+  { "MOV H,D", 1, 5, 5, 0, NEXT, NONE }, // 0x62
+  { "MOV H,E", 1, 5, 5, 0, NEXT, NONE }, // 0x63
+  { "MOV H,H", 1, 5, 5, 0, NEXT, NONE }, // 0x64
+  { "MOV H,L", 1, 5, 5, 0, NEXT, NONE }, // 0x65
+  { "MOV H,M", 1, 7, 7, 0, NEXT, NONE }, // 0x66
+  { "MOV H,A", 1, 5, 5, 0, NEXT, NONE }, // 0x67
+  { "MOV L,B", 1, 5, 5, 0, NEXT, NONE }, // 0x68
+  { "MOV L,C", 1, 5, 5, 0, NEXT, NONE }, // 0x69
+  { "MOV L,D", 1, 5, 5, 0, NEXT, NONE }, // 0x6a
+  { "MOV L,E", 1, 5, 5, 0, NEXT, NONE }, // 0x6b
+  { "MOV L,H", 1, 5, 5, 0, NEXT, NONE }, // 0x6c
+  { "MOV L,L", 1, 5, 5, 0, NEXT, NONE }, // 0x6d
+  { "MOV L,M", 1, 7, 7, 0, NEXT, NONE }, // 0x6e
+  { "MOV L,A", 1, 5, 5, 0, NEXT, NONE }, // 0x6f
+  { "MOV M,B", 1, 7, 7, 0, NEXT, NONE }, // 0x70
+  { "MOV M,C", 1, 7, 7, 0, NEXT, NONE }, // 0x71
+  { "MOV M,D", 1, 7, 7, 0, NEXT, NONE }, // 0x72
+  { "MOV M,E", 1, 7, 7, 0, NEXT, NONE }, // 0x73
+  { "MOV M,H", 1, 7, 7, 0, NEXT, NONE }, // 0x74
+  { "MOV M,L", 1, 7, 7, 0, NEXT, NONE }, // 0x75
+  { "HLT", 1, 7, 7, 0, HALT, NONE }, // 0x76
+  { "MOV M,A", 1, 7, 7, 0, NEXT, NONE }, // 0x77
+  { "MOV A,B", 1, 5, 5, 0, NEXT, NONE }, // 0x78
+  { "MOV A,C", 1, 5, 5, 0, NEXT, NONE }, // 0x79
+  { "MOV A,D", 1, 5, 5, 0, NEXT, NONE }, // 0x7a
+  { "MOV A,E", 1, 5, 5, 0, NEXT, NONE }, // 0x7b
+  { "MOV A,H", 1, 5, 5, 0, NEXT, NONE }, // 0x7c
+  { "MOV A,L", 1, 5, 5, 0, NEXT, NONE }, // 0x7d
+  { "MOV A,M", 1, 7, 7, 0, NEXT, NONE }, // 0x7e
+  { "MOV A,A", 1, 5, 5, 0, NEXT, NONE }, // 0x7f
+  { "ADD B", 1, 4, 4, ALL, NEXT, NONE }, // 0x80
+  { "ADD C", 1, 4, 4, ALL, NEXT, NONE }, // 0x81
+  { "ADD D", 1, 4, 4, ALL, NEXT, NONE }, // 0x82
+  { "ADD E", 1, 4, 4, ALL, NEXT, NONE }, // 0x83
+  { "ADD H", 1, 4, 4, ALL, NEXT, NONE }, // 0x84
+  { "ADD L", 1, 4, 4, ALL, NEXT, NONE }, // 0x85
+  { "ADD M", 1, 7, 7, ALL, NEXT, NONE }, // 0x86
+  { "ADD A", 1, 4, 4, ALL, NEXT, NONE }, // 0x87
+  { "ADC B", 1, 4, 4, ALL, NEXT, NONE }, // 0x88
+  { "ADC C", 1, 4, 4, ALL, NEXT, NONE }, // 0x89
+  { "ADC D", 1, 4, 4, ALL, NEXT, NONE }, // 0x8a
+  { "ADC E", 1, 4, 4, ALL, NEXT, NONE }, // 0x8b
+  { "ADC H", 1, 4, 4, ALL, NEXT, NONE }, // 0x8c
+  { "ADC L", 1, 4, 4, ALL, NEXT, NONE }, // 0x8d
+  { "ADC M", 1, 7, 7, ALL, NEXT, NONE }, // 0x8e
+  { "ADC A", 1, 4, 4, ALL, NEXT, NONE }, // 0x8f
+  { "SUB B", 1, 4, 4, ALL, NEXT, NONE }, // 0x90
+  { "SUB C", 1, 4, 4, ALL, NEXT, NONE }, // 0x91
+  { "SUB D", 1, 4, 4, ALL, NEXT, NONE }, // 0x92
+  { "SUB E", 1, 4, 4, ALL, NEXT, NONE }, // 0x93
+  { "SUB H", 1, 4, 4, ALL, NEXT, NONE }, // 0x94
+  { "SUB L", 1, 4, 4, ALL, NEXT, NONE }, // 0x95
+  { "SUB M", 1, 7, 7, ALL, NEXT, NONE }, // 0x96
+  { "SUB A", 1, 4, 4, ALL, NEXT, NONE }, // 0x97
+  { "SBB B", 1, 4, 4, ALL, NEXT, NONE }, // 0x98
+  { "SBB C", 1, 4, 4, ALL, NEXT, NONE }, // 0x99
+  { "SBB D", 1, 4, 4, ALL, NEXT, NONE }, // 0x9a
+  { "SBB E", 1, 4, 4, ALL, NEXT, NONE }, // 0x9b
+  { "SBB H", 1, 4, 4, ALL, NEXT, NONE }, // 0x9c
+  { "SBB L", 1, 4, 4, ALL, NEXT, NONE }, // 0x9d
+  { "SBB M", 1, 7, 7, ALL, NEXT, NONE }, // 0x9e
+  { "SBB A", 1, 4, 4, ALL, NEXT, NONE }, // 0x9f
+  { "ANA B", 1, 4, 4, ALL, NEXT, NONE }, // 0xa0
+  { "ANA C", 1, 4, 4, ALL, NEXT, NONE }, // 0xa1
+  { "ANA D", 1, 4, 4, ALL, NEXT, NONE }, // 0xa2
+  { "ANA E", 1, 4, 4, ALL, NEXT, NONE }, // 0xa3
+  { "ANA H", 1, 4, 4, ALL, NEXT, NONE }, // 0xa4
+  { "ANA L", 1, 4, 4, ALL, NEXT, NONE }, // 0xa5
+  { "ANA M", 1, 7, 7, ALL, NEXT, NONE }, // 0xa6
+  { "ANA A", 1, 4, 4, ALL, NEXT, NONE }, // 0xa7
+  { "XRA B", 1, 4, 4, ALL, NEXT, NONE }, // 0xa8
+  { "XRA C", 1, 4, 4, ALL, NEXT, NONE }, // 0xa9
+  { "XRA D", 1, 4, 4, ALL, NEXT, NONE }, // 0xaa
+  { "XRA E", 1, 4, 4, ALL, NEXT, NONE }, // 0xab
+  { "XRA H", 1, 4, 4, ALL, NEXT, NONE }, // 0xac
+  { "XRA L", 1, 4, 4, ALL, NEXT, NONE }, // 0xad
+  { "XRA M", 1, 7, 7, ALL, NEXT, NONE }, // 0xae
+  { "XRA A", 1, 4, 4, ALL, NEXT, NONE }, // 0xaf
+  { "ORA B", 1, 4, 4, ALL, NEXT, NONE }, // 0xb0
+  { "ORA C", 1, 4, 4, ALL, NEXT, NONE }, // 0xb1
+  { "ORA D", 1, 4, 4, ALL, NEXT, NONE }, // 0xb2
+  { "ORA E", 1, 4, 4, ALL, NEXT, NONE }, // 0xb3
+  { "ORA H", 1, 4, 4, ALL, NEXT, NONE }, // 0xb4
+  { "ORA L", 1, 4, 4, ALL, NEXT, NONE }, // 0xb5
+  { "ORA M", 1, 7, 7, ALL, NEXT, NONE }, // 0xb6
+  { "ORA A", 1, 4, 4, ALL, NEXT, NONE }, // 0xb7
+  { "CMP B", 1, 4, 4, ALL, NEXT, NONE }, // 0xb8
+  { "CMP C", 1, 4, 4, ALL, NEXT, NONE }, // 0xb9
+  { "CMP D", 1, 4, 4, ALL, NEXT, NONE }, // 0xba
+  { "CMP E", 1, 4, 4, ALL, NEXT, NONE }, // 0xbb
+  { "CMP H", 1, 4, 4, ALL, NEXT, NONE }, // 0xbc
+  { "CMP L", 1, 4, 4, ALL, NEXT, NONE }, // 0xbd
+  { "CMP M", 1, 7, 7, ALL, NEXT, NONE }, // 0xbe
+  { "CMP A", 1, 4, 4, ALL, NEXT, NONE }, // 0xbf
+  { "RNZ", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xc0
+  { "POP B", 1, 10, 10, 0, NEXT, NONE }, // 0xc1
+  { "JNZ ", 3, 10, 10, 0, BRANCH, WORD }, // 0xc2
+  { "JMP ", 3, 10, 10, 0, JUMP, WORD }, // 0xc3
+  { "CNZ ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xc4
+  { "PUSH B", 1, 11, 11, 0, NEXT, NONE }, // 0xc5
+  { "ADI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xc6
+  { "RST 0", 1, 11, 11, 0, RESTART, NONE }, // 0xc7
+  { "RZ", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xc8
+  { "RET", 1, 10, 10, 0, RETURN, NONE }, // 0xc9
+  { "JZ ", 3, 10, 10, 0, BRANCH, WORD }, // 0xca
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0xcb
+  { "CZ ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xcc
+  { "CALL ", 3, 17, 17, 0, CALL, WORD }, // 0xcd
+  { "ACI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xce
+  { "RST 1", 1, 11, 11, 0, RESTART, NONE }, // 0xcf
+  { "RNC", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xd0
+  { "POP D", 1, 10, 10, 0, NEXT, NONE }, // 0xd1
+  { "JNC ", 3, 10, 10, 0, BRANCH, WORD }, // 0xd2
+  { "OUT ", 2, 10, 10, 0, NEXT, BYTE }, // 0xd3
+  { "CNC ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xd4
+  { "PUSH D", 1, 11, 11, 0, NEXT, NONE }, // 0xd5
+  { "SUI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xd6
+  { "RST 2", 1, 11, 11, 0, RESTART, NONE }, // 0xd7
+  { "RC", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xd8
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0xd9
+  { "JC ", 3, 10, 10, 0, BRANCH, WORD }, // 0xda
+  { "IN ", 2, 10, 10, 0, NEXT, BYTE }, // 0xdb
+  { "CC ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xdc
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0xdd
+  { "SBI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xde
+  { "RST 3", 1, 11, 11, 0, RESTART, NONE }, // 0xdf
+  { "RPO", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xe0
+  { "POP H", 1, 10, 10, 0, NEXT, NONE }, // 0xe1
+  { "JPO ", 3, 10, 10, 0, BRANCH, WORD }, // 0xe2
+  { "XTHL", 1, 18, 18, 0, NEXT, NONE }, // 0xe3
+  { "CPO ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xe4
+  { "PUSH H", 1, 11, 11, 0, NEXT, NONE }, // 0xe5
+  { "ANI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xe6
+  { "RST 4", 1, 11, 11, 0, RESTART, NONE }, // 0xe7
+  { "RPE", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xe8
+  { "PCHL", 1, 5, 5, 0, INDIRECT, NONE }, // 0xe9
+  { "JPE ", 3, 10, 10, 0, BRANCH, WORD }, // 0xea
+  { "XCHG", 1, 4, 4, 0, NEXT, NONE }, // 0xeb
+  { "CPE ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xec
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0xed
+  { "XRI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xee
+  { "RST 5", 1, 11, 11, 0, RESTART, NONE }, // 0xef
+  { "RP", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xf0
+  { "POP PSW", 1, 10, 10, ALL, NEXT, NONE }, // 0xf1
+  { "JP ", 3, 10, 10, 0, BRANCH, WORD }, // 0xf2
+  { "DI", 1, 4, 4, 0, NEXT, NONE }, // 0xf3
+  { "CP ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xf4
+  { "PUSH PSW", 1, 11, 11, 0, NEXT, NONE }, // 0xf5
+  { "ORI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xf6
+  { "RST 6", 1, 11, 11, 0, RESTART, NONE }, // 0xf7
+  { "RM", 1, 5, 11, 0, RETURN_IF, NONE }, // 0xf8
+  { "SPHL", 1, 5, 5, 0, NEXT, NONE }, // 0xf9
+  { "JM ", 3, 10, 10, 0, BRANCH, WORD }, // 0xfa
+  { "EI", 1, 4, 4, 0, NEXT, NONE }, // 0xfb
+  { "CM ", 3, 11, 17, 0, CALL_IF, WORD }, // 0xfc
+  { NULL, 1, 4, 4, 0, NEXT, NONE }, // 0xfd
+  { "CPI ", 2, 7, 7, ALL, NEXT, BYTE }, // 0xfe
+  { "RST 7", 1, 11, 11, 0, RESTART, NONE } // 0xff
+};
+
+#undef SZAP
+#undef ALL
+#undef CY
+#undef NEXT
+#undef JUMP
+#undef BRANCH
+#undef CALL
+#undef CALL_IF
+#undef RETURN
+#undef RETURN_IF
+#undef RESTART
+#undef INDIRECT
+#undef HALT
+#undef NONE
+#undef BYTE
+#undef WORD
+
+
+/* Function declarations */
+static void Add(States *state, uint8_t value, uint8_t carry);
+static uint8_t Subtract(States *state, uint8_t value, uint8_t borrow);
+static void And(States *state, uint8_t value);
+static void Xor(States *state, uint8_t value);
+static void Or(States *state, uint8_t value);
+static uint8_t Increment(States *state, uint8_t value);
+static uint8_t Decrement(States *state, uint8_t value);
+static void DecimalAdjust(States *state);
+#ifdef BLOCK_CACHE
+static BlockCache *CreateBlockCache(void);
+static Block *LookupBlock(BlockCache *cache, uint8_t *memory, uint16_t pc,
+                          const void *const *handlers);
+#endif
+static void InvalidateBlocks(BlockCache *cache, uint16_t addr);
+static int RestoreState(const Snapshot *snapshot, States *state,
+                        void *devices, uint32_t size);
+static uint32_t HashMachine(const States *state);
+static void WriteEvent(Recorder *recorder, int kind, uint64_t cycles,
+                       uint8_t port, uint8_t value);
+static void ReadEvent(Recorder *recorder);
+static uint8_t ReadPort(States *state, uint8_t port);
+static void WritePort(States *state, uint8_t port, uint8_t value);
+static void RaiseScheduled(States *state);
+static void Deliver(States *state);
+static uint64_t Run(States *state, uint64_t count, uint64_t cycle_limit);
+#ifdef JIT
+static Jit *CreateJit(void);
+static void FlushJit(Jit *jit);
+static uint8_t *TranslateBlock(Jit *jit, uint8_t *memory, uint16_t pc);
+static void InvalidateTranslations(Jit *jit, uint16_t addr);
+static void TranslatedWrite(States *state, uint16_t addr);
+static uint64_t ExecuteTranslated(States *state, uint64_t count,
+                                  uint64_t cycle_limit);
+#endif
+static AsmSymbol *FindSymbol(Assembler *as, const char *name);
+static void DefineSymbol(Assembler *as, const char *name, uint16_t value);
+static int Evaluate(Assembler *as, const char *text, int32_t *value);
+static void Emit(Assembler *as, uint8_t byte);
+static void AssembleLine(Assembler *as, char *line);
+
+
+/* Function implementation */
+
+/*
+ * Function: InitState
+ * -------------------
+ *  Prepares a machine: registers cleared, no cache, JIT, trace, ports
+ *  or recorder
+ *
+ *  state: state of Intel8080 machine
+ *  memory: 64 KB of memory owned by the caller
+ *
+ *  returns: void
+ */
+void InitState(States *state, uint8_t *memory)
+{
+  memset(state, 0, sizeof(States));
+  state->memory = memory;
+  state->ei_cycles = UINT64_MAX;
+}
+
+/*
+ * Function: ResetState
+ * --------------------
+ *  Clears registers, flags, counters and errors
+ *  Memory, the attached cache or JIT, the trace sink, the ports and
+ *  the recorder are kept
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: void
+ */
+void ResetState(States *state)
+{
+  States kept = *state;
+
+  InitState(state, kept.memory);
+  state->cache = kept.cache;
+  state->jit = kept.jit;
+  state->trace = kept.trace;
+  state->ports = kept.ports;
+  state->recorder = kept.recorder;
+}
+
+/*
+ * Function: ReleaseState
+ * ----------------------
+ *  Frees the block cache or JIT attached to a machine and closes its
+ *  recorder. The memory belongs to the caller and isn't touched
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: void
+ */
+void ReleaseState(States *state)
+{
+  if (state->cache != NULL) {
+    for (int addr = 0; addr < 0x10000; addr++) {
+      free(state->cache->blocks[addr]);
+    }
+    while (state->cache->retired != NULL) {
+      Block *next = state->cache->retired->retired;
+      free(state->cache->retired);
+      state->cache->retired = next;
+    }
+    free(state->cache);
+    state->cache = NULL;
+  }
+#ifdef JIT
+  if (state->jit != NULL) {
+    munmap(state->jit->arena, JIT_ARENA_BYTES);
+    munmap(state->jit->writable, JIT_ARENA_BYTES);
+    free(state->jit);
+    state->jit = NULL;
+  }
+#endif
+  if (state->recorder != NULL) {
+    StopRecorder(state, NULL);
+  }
+}
+
+/*
+ * Function: AttachBlockCache
+ * --------------------------
+ *  Runs the machine from a cache of decoded blocks(BLOCK_CACHE builds)
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: I8080_OK, I8080_ERROR_MEMORY or I8080_ERROR_UNSUPPORTED
+ */
+int AttachBlockCache(States *state)
+{
+#ifdef BLOCK_CACHE
+  if (state->cache == NULL) {
+    state->cache = CreateBlockCache();
+  }
+  return state->cache != NULL ? I8080_OK : I8080_ERROR_MEMORY;
+#else
+  (void)state;
+  return I8080_ERROR_UNSUPPORTED;
+#endif
+}
+
+/*
+ * Function: AttachJit
+ * -------------------
+ *  Runs the machine from translated native code(JIT builds)
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: I8080_OK, I8080_ERROR_MEMORY(no executable memory)
+ *           or I8080_ERROR_UNSUPPORTED
+ */
+int AttachJit(States *state)
+{
+#ifdef JIT
+  if (state->jit == NULL) {
+    state->jit = CreateJit();
+  }
+  return state->jit != NULL ? I8080_OK : I8080_ERROR_MEMORY;
+#else
+  (void)state;
+  return I8080_ERROR_UNSUPPORTED;
+#endif
+}
+
+/*
+ * Function: ReadStatistics
+ * ------------------------
+ *  Reads the counters of the attached block cache or JIT
+ *
+ *  state: state of Intel8080 machine
+ *  stats: counters, all zero when neither is attached
+ *
+ *  returns: void
+ */
+void ReadStatistics(const States *state, Statistics *stats)
+{
+  memset(stats, 0, sizeof(Statistics));
+  if (state->cache != NULL) {
+    stats->hits = state->cache->hits;
+    stats->misses = state->cache->misses;
+    stats->invalidations = state->cache->invalidations;
+  }
+#ifdef JIT
+  if (state->jit != NULL) {
+    stats->blocks = state->jit->blocks;
+    stats->invalidations = state->jit->invalidations;
+    stats->flushes = state->jit->flushes;
+    stats->interpreted = state->jit->interpreted;
+  }
+#endif
+}
+
+/*
+ * Function: InitPorts
+ * -------------------
+ *  Empties a port dispatch table, every port is unmapped
+ *
+ *  ports: table to clear
+ *
+ *  returns: void
+ */
+void InitPorts(Ports *ports)
+{
+  memset(ports, 0, sizeof(Ports));
+}
+
+/*
+ * Function: MapInput
+ * ------------------
+ *  Attaches a device to IN on a port
+ *
+ *  ports: dispatch table
+ *  port: port number
+ *  handler: called with context and the port, returns the value read
+ *           (NULL unmaps the port)
+ *  context: device the handler works on
+ *
+ *  returns: void
+ */
+void MapInput(Ports *ports, uint8_t port, InputHandler handler,
+              void *context)
+{
+  ports->input[port] = handler;
+  ports->input_context[port] = context;
+}
+
+/*
+ * Function: MapOutput
+ * -------------------
+ *  Attaches a device to OUT on a port
+ *
+ *  ports: dispatch table
+ *  port: port number
+ *  handler: called with context, the port and the accumulator
+ *           (NULL unmaps the port)
+ *  context: device the handler works on
+ *
+ *  returns: void
+ */
+void MapOutput(Ports *ports, uint8_t port, OutputHandler handler,
+               void *context)
+{
+  ports->output[port] = handler;
+  ports->output_context[port] = context;
+}
+
+/*
+ * Function: WriteMemory
+ * ---------------------
+ *  Stores a byte on behalf of the host(loaders, debuggers, snapshots)
+ *  Decoded or translated code covering the byte is dropped
+ *
+ *  state: state of Intel8080 machine
+ *  addr: address to write
+ *  value: byte to store
+ *
+ *  returns: void
+ */
+void WriteMemory(States *state, uint16_t addr, uint8_t value)
+{
+  state->memory[addr] = value;
+  if (state->cache != NULL && state->cache->code[addr] != 0) {
+    InvalidateBlocks(state->cache, addr);
+  }
+#ifdef JIT
+  if (state->jit != NULL && state->jit->code[addr] != 0) {
+    InvalidateTranslations(state->jit, addr);
+  }
+#endif
+}
+
+/*
+ * Function: CopyIntoMemory
+ * ------------------------
+ *  Brings the whole memory to the contents of an image
+ *  With a block cache or JIT attached only the differing bytes are
+ *  written, so the blocks of unchanged code stay valid. Pages the block
+ *  cache has no code in are copied whole
+ *
+ *  state: state of Intel8080 machine
+ *  image: 64 KB to copy
+ *
+ *  returns: void
+ */
+void CopyIntoMemory(States *state, const uint8_t *image)
+{
+  if (state->cache == NULL && state->jit == NULL) {
+    memcpy(state->memory, image, 0x10000);
+    return;
+  }
+  for (int addr = 0; addr < 0x10000; addr += 64) {
+    if (state->cache != NULL && state->cache->pages[addr >> 8] == 0) {
+      memcpy(&state->memory[addr], &image[addr], 64);
+      continue;
+    }
+    if (memcmp(&state->memory[addr], &image[addr], 64) == 0) {
+      continue;
+    }
+    for (int i = addr; i < addr + 64; i++) {
+      if (state->memory[i] != image[i]) {
+        WriteMemory(state, i, image[i]);
+      }
+    }
+  }
+}
+
+/*
+ * Function: ReadIntoMemory
+ * ------------------------
+ *  Reads a ROM image into memory
+ *
+ *  memory: 64 KB of memory
+ *  filename: image to read
+ *  offset: address of the first byte
+ *
+ *  returns: number of bytes read, or I8080_ERROR_FILE or I8080_ERROR_SIZE
+ */
+int ReadIntoMemory(uint8_t *memory, const char *filename, uint32_t offset)
+{
+  // Open file and verify status
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return I8080_ERROR_FILE;
+  }
+
+  // Read one byte past the room left to detect images too large
+  size_t room = offset < 0x10000 ? 0x10000 - offset : 0;
+  size_t size = fread(&memory[offset], 1, room, fp);
+  int error = ferror(fp);
+  int more = fgetc(fp) != EOF;
+  fclose(fp);
+
+  if (error) {
+    return I8080_ERROR_FILE;
+  }
+  if (more) {
+    return I8080_ERROR_SIZE;
+  }
+  return size;
+}
+
+/*
+ * Function: TakeSnapshot
+ * ----------------------
+ *  Saves a machine: registers, flags, counters, memory and the state of
+ *  the host's devices
+ *
+ *  state: state of Intel8080 machine
+ *  devices: device state to keep with the machine(may be NULL)
+ *  size: bytes of device state, ignored when devices is NULL
+ *  snapshot: set to the new snapshot
+ *
+ *  returns: I8080_OK or I8080_ERROR_MEMORY
+ */
+int TakeSnapshot(const States *state, const void *devices, uint32_t size,
+                 Snapshot **snapshot)
+{
+  Snapshot *saved = calloc(1, sizeof(Snapshot));
+  if (saved == NULL) {
+    return I8080_ERROR_MEMORY;
+  }
+  saved->fd = -1;
+  saved->registers = *state;
+  saved->registers.memory = NULL;
+  saved->registers.cache = NULL;
+  saved->registers.jit = NULL;
+  saved->registers.trace = NULL;
+  saved->registers.ports = NULL;
+  saved->registers.recorder = NULL;
+
+#ifdef __linux__
+  int fd = memfd_create("i8080-snapshot", MFD_CLOEXEC);
+  if (fd >= 0) {
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, 0x10000) == 0) {
+      memory = mmap(NULL, 0x10000, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (memory != MAP_FAILED) {
+      memcpy(memory, state->memory, 0x10000);
+      mprotect(memory, 0x10000, PROT_READ);
+      saved->memory = memory;
+      saved->fd = fd;
+    }
+    else {
+      close(fd);
+    }
+  }
+#endif
+  if (saved->memory == NULL) {
+    saved->memory = malloc(0x10000);
+    if (saved->memory == NULL) {
+      free(saved);
+      return I8080_ERROR_MEMORY;
+    }
+    memcpy(saved->memory, state->memory, 0x10000);
+  }
+
+  if (devices != NULL && size > 0) {
+    saved->devices = malloc(size);
+    if (saved->devices == NULL) {
+      FreeSnapshot(saved);
+      return I8080_ERROR_MEMORY;
+    }
+    memcpy(saved->devices, devices, size);
+    saved->size = size;
+  }
+
+  *snapshot = saved;
+  return I8080_OK;
+}
+
+/*
+ * Function: FreeSnapshot
+ * ----------------------
+ *  Frees a snapshot, forks made from it stay valid
+ *
+ *  snapshot: snapshot to free
+ *
+ *  returns: void
+ */
+void FreeSnapshot(Snapshot *snapshot)
+{
+#ifdef __linux__
+  if (snapshot->fd >= 0) {
+    munmap(snapshot->memory, 0x10000);
+    close(snapshot->fd);
+    snapshot->memory = NULL;
+  }
+#endif
+  free(snapshot->memory);
+  free(snapshot->devices);
+  free(snapshot);
+}
+
+/*
+ * Function: RestoreState
+ * ----------------------
+ *  Copies the saved registers and device state into a machine
+ *  Memory, the attached cache or JIT, the trace sink, the ports and
+ *  the recorder are kept
+ *
+ *  snapshot: snapshot to restore
+ *  state: state of Intel8080 machine
+ *  devices: receives the device state(may be NULL)
+ *  size: room for device state
+ *
+ *  returns: I8080_OK or I8080_ERROR_SIZE if the device state doesn't fit
+ */
+static int RestoreState(const Snapshot *snapshot, States *state,
+                        void *devices, uint32_t size)
+{
+  States kept = *state;
+
+  if (snapshot->size > 0 && snapshot->size > size) {
+    return I8080_ERROR_SIZE;
+  }
+  *state = snapshot->registers;
+  state->memory = kept.memory;
+  state->cache = kept.cache;
+  state->jit = kept.jit;
+  state->trace = kept.trace;
+  state->ports = kept.ports;
+  state->recorder = kept.recorder;
+  if (snapshot->size > 0) {
+    memcpy(devices, snapshot->devices, snapshot->size);
+  }
+
+  return I8080_OK;
+}
+
+/*
+ * Function: RestoreSnapshot
+ * -------------------------
+ *  Puts a machine back to a snapshot, its memory included
+ *
+ *  snapshot: snapshot to restore
+ *  state: state of Intel8080 machine
+ *  devices: receives the device state(may be NULL)
+ *  size: room for device state
+ *
+ *  returns: I8080_OK or I8080_ERROR_SIZE if the device state doesn't fit
+ */
+int RestoreSnapshot(const Snapshot *snapshot, States *state, void *devices,
+                    uint32_t size)
+{
+  int error = RestoreState(snapshot, state, devices, size);
+  if (error != I8080_OK) {
+    return error;
+  }
+  CopyIntoMemory(state, snapshot->memory);
+
+  return I8080_OK;
+}
+
+/*
+ * Function: ForkSnapshot
+ * ----------------------
+ *  Starts a new machine from a snapshot
+ *  Its memory is a private copy-on-write mapping of the snapshot, only
+ *  the pages the fork writes to get copied(a full copy without memfd)
+ *  The memory must be given back with ReleaseMemory
+ *
+ *  snapshot: snapshot to fork
+ *  child: machine to set up, previous contents are discarded
+ *  devices: receives the device state(may be NULL)
+ *  size: room for device state
+ *
+ *  returns: I8080_OK, I8080_ERROR_MEMORY or I8080_ERROR_SIZE
+ */
+int ForkSnapshot(const Snapshot *snapshot, States *child, void *devices,
+                 uint32_t size)
+{
+  uint8_t *memory = NULL;
+
+  if (snapshot->size > 0 && snapshot->size > size) {
+    return I8080_ERROR_SIZE;
+  }
+#ifdef __linux__
+  if (snapshot->fd >= 0) {
+    memory = mmap(NULL, 0x10000, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                  snapshot->fd, 0);
+  }
+  else {
+    memory = mmap(NULL, 0x10000, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+      memcpy(memory, snapshot->memory, 0x10000);
+    }
+  }
+  if (memory == MAP_FAILED) {
+    return I8080_ERROR_MEMORY;
+  }
+#else
+  memory = malloc(0x10000);
+  if (memory == NULL) {
+    return I8080_ERROR_MEMORY;
+  }
+  memcpy(memory, snapshot->memory, 0x10000);
+#endif
+
+  InitState(child, memory);
+  return RestoreState(snapshot, child, devices, size);
+}
+
+/*
+ * Function: ReleaseMemory
+ * -----------------------
+ *  Gives back the memory of a machine made by ForkSnapshot
+ *
+ *  memory: memory of the fork
+ *
+ *  returns: void
+ */
+void ReleaseMemory(uint8_t *memory)
+{
+#ifdef __linux__
+  munmap(memory, 0x10000);
+#else
+  free(memory);
+#endif
+}
+
+/*
+ * Function: SaveSnapshot
+ * ----------------------
+ *  Writes a snapshot to a file, multi-byte values are little endian
+ *
+ *  snapshot: snapshot to save
+ *  filename: file to write
+ *
+ *  returns: I8080_OK or I8080_ERROR_FILE
+ */
+int SaveSnapshot(const Snapshot *snapshot, const char *filename)
+{
+  const States *saved = &snapshot->registers;
+  uint8_t header[SNAPSHOT_HEADER];
+
+  memcpy(header, SNAPSHOT_MAGIC, 8);
+  header[8] = saved->a;
+  header[9] = saved->b;
+  header[10] = saved->c;
+  header[11] = saved->d;
+  header[12] = saved->e;
+  header[13] = saved->h;
+  header[14] = saved->l;
+  header[15] = saved->cc.psw;
+  header[16] = saved->int_enable;
+  header[17] = saved->halted;
+  header[18] = saved->sp & 0xff;
+  header[19] = saved->sp >> 8;
+  header[20] = saved->pc & 0xff;
+  header[21] = saved->pc >> 8;
+  for (int i = 0; i < 8; i++) {
+    header[22 + i] = saved->cycles >> (8 * i);
+  }
+  for (int i = 0; i < 4; i++) {
+    header[30 + i] = snapshot->size >> (8 * i);
+  }
+  for (int i = 0; i < 8; i++) {
+    header[34 + i] = saved->ei_cycles >> (8 * i);
+  }
+  header[42] = saved->irq;
+  header[43] = saved->nscheduled;
+  memset(&header[44], 0, 13 * I8080_SCHEDULED);
+  for (int n = 0; n < saved->nscheduled; n++) {
+    uint8_t *entry = &header[44 + 13 * n];
+    for (int i = 0; i < 8; i++) {
+      entry[i] = saved->scheduled[n].cycles >> (8 * i);
+    }
+    for (int i = 0; i < 4; i++) {
+      entry[8 + i] = saved->scheduled[n].period >> (8 * i);
+    }
+    entry[12] = saved->scheduled[n].vector;
+  }
+
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    return I8080_ERROR_FILE;
+  }
+  int ok = fwrite(header, SNAPSHOT_HEADER, 1, fp) == 1 &&
+           fwrite(snapshot->devices, 1, snapshot->size, fp) == snapshot->size &&
+           fwrite(snapshot->memory, 0x10000, 1, fp) == 1;
+  if (fclose(fp) != 0 || !ok) {
+    return I8080_ERROR_FILE;
+  }
+
+  return I8080_OK;
+}
+
+/*
+ * Function: LoadSnapshot
+ * ----------------------
+ *  Reads a snapshot written by SaveSnapshot
+ *
+ *  filename: file to read
+ *  snapshot: set to the new snapshot
+ *
+ *  returns: I8080_OK, I8080_ERROR_FILE(unreadable, not a snapshot or
+ *           not as long as its header says)
+ *           or I8080_ERROR_MEMORY
+ */
+int LoadSnapshot(const char *filename, Snapshot **snapshot)
+{
+  uint8_t header[SNAPSHOT_HEADER];
+  uint8_t *memory = NULL;
+  uint8_t *devices = NULL;
+  uint32_t size = 0;
+  States state;
+  int error = I8080_ERROR_FILE;
+
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return I8080_ERROR_FILE;
+  }
+  if (fread(header, SNAPSHOT_HEADER, 1, fp) != 1 ||
+      memcmp(header, SNAPSHOT_MAGIC, 8) != 0) {
+    goto done;
+  }
+  for (int i = 0; i < 4; i++) {
+    size |= (uint32_t)header[30 + i] << (8 * i);
+  }
+
+  /* The devices lie between the header and the memory, so the length
+     of the file checks their size before it's allocated */
+  long length = -1;
+  if (fseek(fp, 0, SEEK_END) == 0) {
+    length = ftell(fp);
+  }
+  if (length < 0 ||
+      (uint64_t)length != SNAPSHOT_HEADER + (uint64_t)size + 0x10000 ||
+      fseek(fp, SNAPSHOT_HEADER, SEEK_SET) != 0) {
+    goto done;
+  }
+  memory = malloc(0x10000);
+  devices = malloc(size > 0 ? size : 1);
+  if (memory == NULL || devices == NULL) {
+    error = I8080_ERROR_MEMORY;
+    goto done;
+  }
+  if (fread(devices, 1, size, fp) != size ||
+      fread(memory, 0x10000, 1, fp) != 1) {
+    goto done;
+  }
+
+  InitState(&state, memory);
+  state.a = header[8];
+  state.b = header[9];
+  state.c = header[10];
+  state.d = header[11];
+  state.e = header[12];
+  state.h = header[13];
+  state.l = header[14];
+  state.cc.psw = header[15];
+  state.int_enable = header[16];
+  state.halted = header[17];
+  state.sp = header[18] | (header[19] << 8);
+  state.pc = header[20] | (header[21] << 8);
+  for (int i = 0; i < 8; i++) {
+    state.cycles |= (uint64_t)header[22 + i] << (8 * i);
+  }
+  state.ei_cycles = 0;
+  for (int i = 0; i < 8; i++) {
+    state.ei_cycles |= (uint64_t)header[34 + i] << (8 * i);
+  }
+  state.irq = header[42] <= 8 ? header[42] : 0;
+  for (int n = 0; n < header[43] && n < I8080_SCHEDULED; n++) {
+    const uint8_t *entry = &header[44 + 13 * n];
+    uint64_t cycles = 0;
+    uint32_t period = 0;
+    for (int i = 0; i < 8; i++) {
+      cycles |= (uint64_t)entry[i] << (8 * i);
+    }
+    for (int i = 0; i < 4; i++) {
+      period |= (uint32_t)entry[8 + i] << (8 * i);
+    }
+    ScheduleInterrupt(&state, cycles, period, entry[12]);
+  }
+  error = TakeSnapshot(&state, devices, size, snapshot);
+
+done:
+  fclose(fp);
+  free(memory);
+  free(devices);
+  return error;
+}
+
+/*
+ * Function: HashMachine
+ * ---------------------
+ *  FNV-1a hash of the registers, flags, counters and memory, tells a
+ *  replay whether it starts from the machine that was recorded
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: 32 bit hash
+ */
+static uint32_t HashMachine(const States *state)
+{
+  uint8_t registers[] = {
+    state->a, state->b, state->c, state->d, state->e, state->h, state->l,
+    state->cc.psw, state->int_enable, state->halted,
+    state->sp & 0xff, state->sp >> 8, state->pc & 0xff, state->pc >> 8
+  };
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < sizeof(registers); i++) {
+    hash = (hash ^ registers[i]) * 16777619u;
+  }
+  for (int i = 0; i < 0x10000; i++) {
+    hash = (hash ^ state->memory[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+/*
+ * Function: WriteEvent
+ * --------------------
+ *  Appends an event to the log being recorded
+ *
+ *  recorder: recorder writing the log
+ *  kind: EVENT_INPUT or EVENT_INTERRUPT
+ *  cycles: cycle counter when it happened
+ *  port: port read, or vector of the interrupt
+ *  value: value read(EVENT_INPUT only)
+ *
+ *  returns: void
+ */
+static void WriteEvent(Recorder *recorder, int kind, uint64_t cycles,
+                       uint8_t port, uint8_t value)
+{
+  uint8_t bytes[12];
+  int n = 0;
+  uint64_t delta = cycles - recorder->last;
+
+  // Deltas need at most 63 bits, the counter only counts up
+  uint64_t varint = (delta << 1) | kind;
+  do {
+    bytes[n++] = (varint & 0x7f) | (varint > 0x7f ? 0x80 : 0);
+    varint >>= 7;
+  } while (varint != 0);
+  bytes[n++] = port;
+  if (kind == EVENT_INPUT) {
+    bytes[n++] = value;
+  }
+
+  if (fwrite(bytes, 1, n, recorder->fp) != (size_t)n) {
+    recorder->failed = 1;
+  }
+  recorder->last = cycles;
+  recorder->events++;
+}
+
+/*
+ * Function: ReadEvent
+ * -------------------
+ *  Reads the next event of the log being replayed
+ *  recorder->pending is cleared at the end of the log
+ *
+ *  recorder: recorder replaying the log
+ *
+ *  returns: void
+ */
+static void ReadEvent(Recorder *recorder)
+{
+  uint64_t varint = 0;
+  int c;
+
+  recorder->pending = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if ((c = getc(recorder->fp)) == EOF) {
+      return;
+    }
+    varint |= (uint64_t)(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      break;
+    }
+  }
+  recorder->kind = varint & 1;
+  recorder->cycles = recorder->last + (varint >> 1);
+  if ((c = getc(recorder->fp)) == EOF) {
+    return;
+  }
+  recorder->port = c;
+  if (recorder->kind == EVENT_INPUT) {
+    if ((c = getc(recorder->fp)) == EOF) {
+      return;
+    }
+    recorder->value = c;
+  }
+  recorder->last = recorder->cycles;
+  recorder->pending = 1;
+}
+
+/*
+ * Function: ReadPort
+ * ------------------
+ *  Serves IN: asks the device mapped on the port, or the log while
+ *  replaying
+ *  A replay reaching an IN the log doesn't have at this cycle and port
+ *  stops the machine with I8080_ERROR_REPLAY
+ *
+ *  state: state of Intel8080 machine, cycle counter up to date
+ *  port: port read
+ *
+ *  returns: value read
+ */
+static uint8_t ReadPort(States *state, uint8_t port)
+{
+  Recorder *recorder = state->recorder;
+  uint8_t value;
+
+  if (recorder != NULL && recorder->replaying) {
+    if (!recorder->pending || recorder->kind != EVENT_INPUT ||
+        recorder->cycles != state->cycles || recorder->port != port) {
+      state->error = I8080_ERROR_REPLAY;
+      return 0;
+    }
+    value = recorder->value;
+    recorder->events++;
+    ReadEvent(recorder);
+    return value;
+  }
+
+  const Ports *ports = state->ports;
+  value = 0;
+  if (ports != NULL && ports->input[port] != NULL) {
+    value = ports->input[port](ports->input_context[port], port);
+  }
+  if (recorder != NULL) {
+    WriteEvent(recorder, EVENT_INPUT, state->cycles, port, value);
+  }
+
+  return value;
+}
+
+/*
+ * Function: WritePort
+ * -------------------
+ *  Serves OUT with the device mapped on the port
+ *  Outputs follow from the inputs, so they aren't logged
+ *
+ *  state: state of Intel8080 machine, cycle counter up to date
+ *  port: port written
+ *  value: accumulator
+ *
+ *  returns: void
+ */
+static void WritePort(States *state, uint8_t port, uint8_t value)
+{
+  const Ports *ports = state->ports;
+
+  if (ports != NULL && ports->output[port] != NULL) {
+    ports->output[port](ports->output_context[port], port, value);
+  }
+}
+
+/*
+ * Function: StartRecording
+ * ------------------------
+ *  Logs every value the machine reads from its ports, and the
+ *  interrupts the host delivers(LogInterrupt), with the cycle counter
+ *  at which they happen. Replaying the log from the same machine
+ *  reproduces the session exactly
+ *
+ *  state: state of Intel8080 machine, as the replay will start from it
+ *  filename: log to write
+ *
+ *  returns: I8080_OK, I8080_ERROR_FILE or I8080_ERROR_MEMORY
+ */
+int StartRecording(States *state, const char *filename)
+{
+  uint8_t header[RECORDER_HEADER];
+  uint32_t hash = HashMachine(state);
+
+  if (state->recorder != NULL) {
+    StopRecorder(state, NULL);
+  }
+  Recorder *recorder = calloc(1, sizeof(Recorder));
+  if (recorder == NULL) {
+    return I8080_ERROR_MEMORY;
+  }
+  recorder->fp = fopen(filename, "wb");
+  if (recorder->fp == NULL) {
+    free(recorder);
+    return I8080_ERROR_FILE;
+  }
+
+  memcpy(header, RECORDER_MAGIC, 8);
+  for (int i = 0; i < 8; i++) {
+    header[8 + i] = state->cycles >> (8 * i);
+  }
+  for (int i = 0; i < 4; i++) {
+    header[16 + i] = hash >> (8 * i);
+  }
+  if (fwrite(header, RECORDER_HEADER, 1, recorder->fp) != 1) {
+    fclose(recorder->fp);
+    free(recorder);
+    return I8080_ERROR_FILE;
+  }
+
+  recorder->last = state->cycles;
+  state->recorder = recorder;
+  return I8080_OK;
+}
+
+/*
+ * Function: StartReplay
+ * ---------------------
+ *  Feeds the machine the inputs of a recorded session instead of its
+ *  devices. Outputs still go to the devices
+ *
+ *  state: state of Intel8080 machine, as it was when recording started
+ *  filename: log to replay
+ *
+ *  returns: I8080_OK, I8080_ERROR_FILE(unreadable or not a log),
+ *           I8080_ERROR_MEMORY or I8080_ERROR_REPLAY(the log was
+ *           recorded from another machine)
+ */
+int StartReplay(States *state, const char *filename)
+{
+  uint8_t header[RECORDER_HEADER];
+  uint64_t cycles = 0;
+  uint32_t hash = 0;
+
+  if (state->recorder != NULL) {
+    StopRecorder(state, NULL);
+  }
+  Recorder *recorder = calloc(1, sizeof(Recorder));
+  if (recorder == NULL) {
+    return I8080_ERROR_MEMORY;
+  }
+  recorder->fp = fopen(filename, "rb");
+  if (recorder->fp == NULL) {
+    free(recorder);
+    return I8080_ERROR_FILE;
+  }
+  if (fread(header, RECORDER_HEADER, 1, recorder->fp) != 1 ||
+      memcmp(header, RECORDER_MAGIC, 8) != 0) {
+    fclose(recorder->fp);
+    free(recorder);
+    return I8080_ERROR_FILE;
+  }
+
+  for (int i = 0; i < 8; i++) {
+    cycles |= (uint64_t)header[8 + i] << (8 * i);
+  }
+  for (int i = 0; i < 4; i++) {
+    hash |= (uint32_t)header[16 + i] << (8 * i);
+  }
+  if (cycles != state->cycles || hash != HashMachine(state)) {
+    fclose(recorder->fp);
+    free(recorder);
+    return I8080_ERROR_REPLAY;
+  }
+
+  recorder->replaying = 1;
+  recorder->last = cycles;
+  ReadEvent(recorder);
+  state->recorder = recorder;
+  return I8080_OK;
+}
+
+/*
+ * Function: LogInterrupt
+ * ----------------------
+ *  Tells the recorder the host delivered an interrupt at the current
+ *  cycle counter. While replaying, checks it is the next logged event
+ *
+ *  state: state of Intel8080 machine
+ *  vector: RST number of the interrupt
+ *
+ *  returns: I8080_OK, or I8080_ERROR_REPLAY(also set in state->error)
+ *           if the log has no such interrupt here
+ */
+int LogInterrupt(States *state, uint8_t vector)
+{
+  Recorder *recorder = state->recorder;
+
+  if (recorder == NULL) {
+    return I8080_OK;
+  }
+  if (!recorder->replaying) {
+    WriteEvent(recorder, EVENT_INTERRUPT, state->cycles, vector, 0);
+    return I8080_OK;
+  }
+  if (!recorder->pending || recorder->kind != EVENT_INTERRUPT ||
+      recorder->cycles != state->cycles || recorder->port != vector) {
+    state->error = I8080_ERROR_REPLAY;
+    return I8080_ERROR_REPLAY;
+  }
+  recorder->events++;
+  ReadEvent(recorder);
+
+  return I8080_OK;
+}
+
+/*
+ * Function: NextInterrupt
+ * -----------------------
+ *  Looks ahead in the log being replayed for the next interrupt, so the
+ *  host can run the machine up to it and deliver it on the same cycle
+ *
+ *  state: state of Intel8080 machine
+ *  cycles: set to the cycle counter of the interrupt
+ *  vector: set to its RST number
+ *
+ *  returns: 1 if the next event is an interrupt, else 0
+ */
+int NextInterrupt(const States *state, uint64_t *cycles, uint8_t *vector)
+{
+  const Recorder *recorder = state->recorder;
+
+  if (recorder == NULL || !recorder->replaying || !recorder->pending ||
+      recorder->kind != EVENT_INTERRUPT) {
+    return 0;
+  }
+  *cycles = recorder->cycles;
+  *vector = recorder->port;
+
+  return 1;
+}
+
+/*
+ * Function: StopRecorder
+ * ----------------------
+ *  Ends recording or replaying and closes the log
+ *
+ *  state: state of Intel8080 machine
+ *  events: set to the number of events written or replayed(may be NULL)
+ *
+ *  returns: I8080_OK, or I8080_ERROR_FILE if the log couldn't be written
+ */
+int StopRecorder(States *state, uint64_t *events)
+{
+  Recorder *recorder = state->recorder;
+
+  if (recorder == NULL) {
+    if (events != NULL) {
+      *events = 0;
+    }
+    return I8080_OK;
+  }
+  if (events != NULL) {
+    *events = recorder->events;
+  }
+  int failed = fclose(recorder->fp) != 0 || recorder->failed;
+  free(recorder);
+  state->recorder = NULL;
+
+  return failed ? I8080_ERROR_FILE : I8080_OK;
+}
+
+/*
+ * Function: Add
+ * -------------
+ *  Adds a value and carry to the accumulator(ADD, ADC, ADI, ACI)
+ *  All condition flags are resolved from the lookup tables
+ *
+ *  state: state of Intel8080 machine
+ *  value: operand added to the accumulator
+ *  carry: carry in(0 or 1)
+ *
+ *  returns: void
+ */
+static void Add(States *state, uint8_t value, uint8_t carry)
+{
+  uint16_t answer = state->a + value + carry;
+  int index = ((state->a & 0x08) >> 3) | ((value & 0x08) >> 2) |
+              ((answer & 0x08) >> 1);
+  state->cc.psw = ZSPTable[answer & 0xff] | ACAddTable[index] |
+                  ((answer >> 8) & FLAG_CY);
+  state->a = answer & 0xff;
+}
+
+/*
+ * Function: Subtract
+ * ------------------
+ *  Subtracts a value and borrow from the accumulator(SUB, SBB, SUI, SBI)
+ *  The accumulator is left untouched so CMP and CPI can share it
+ *
+ *  state: state of Intel8080 machine
+ *  value: operand subtracted from the accumulator
+ *  borrow: borrow in(0 or 1)
+ *
+ *  returns: the 8 bit difference
+ */
+static uint8_t Subtract(States *state, uint8_t value, uint8_t borrow)
+{
+  uint16_t answer = state->a - value - borrow;
+  int index = ((state->a & 0x08) >> 3) | ((value & 0x08) >> 2) |
+              ((answer & 0x08) >> 1);
+  state->cc.psw = ZSPTable[answer & 0xff] | ACSubTable[index] |
+                  ((answer >> 8) & FLAG_CY);
+  return answer & 0xff;
+}
+
+/*
+ * Function: And
+ * -------------
+ *  Logical AND with the accumulator(ANA, ANI)
+ *  Carry is cleared, AC is the OR of bit 3 of both operands
+ *
+ *  state: state of Intel8080 machine
+ *  value: operand
+ *
+ *  returns: void
+ */
+static void And(States *state, uint8_t value)
+{
+  uint8_t ac = ((state->a | value) & 0x08) << 1;
+  state->a &= value;
+  state->cc.psw = ZSPTable[state->a] | ac;
+}
+
+/*
+ * Function: Xor
+ * -------------
+ *  Logical XOR with the accumulator(XRA, XRI)
+ *  Carry and auxiliary carry are cleared
+ *
+ *  state: state of Intel8080 machine
+ *  value: operand
+ *
+ *  returns: void
+ */
+static void Xor(States *state, uint8_t value)
+{
+  state->a ^= value;
+  state->cc.psw = ZSPTable[state->a];
+}
+
+/*
+ * Function: Or
+ * ------------
+ *  Logical OR with the accumulator(ORA, ORI)
+ *  Carry and auxiliary carry are cleared
+ *
+ *  state: state of Intel8080 machine
+ *  value: operand
+ *
+ *  returns: void
+ */
+static void Or(States *state, uint8_t value)
+{
+  state->a |= value;
+  state->cc.psw = ZSPTable[state->a];
+}
+
+/*
+ * Function: Increment
+ * -------------------
+ *  Increments a register or memory value(INR)
+ *  Carry is unaffected
+ *
+ *  state: state of Intel8080 machine
+ *  value: value to increment
+ *
+ *  returns: the incremented value
+ */
+static uint8_t Increment(States *state, uint8_t value)
+{
+  uint8_t answer = value + 1;
+  uint8_t ac = ((answer & 0x0f) == 0) ? FLAG_AC : 0;
+  state->cc.psw = (state->cc.psw & FLAG_CY) | ZSPTable[answer] | ac;
+  return answer;
+}
+
+/*
+ * Function: Decrement
+ * -------------------
+ *  Decrements a register or memory value(DCR)
+ *  Carry is unaffected
+ *
+ *  state: state of Intel8080 machine
+ *  value: value to decrement
+ *
+ *  returns: the decremented value
+ */
+static uint8_t Decrement(States *state, uint8_t value)
+{
+  uint8_t answer = value - 1;
+  uint8_t ac = ((answer & 0x0f) != 0x0f) ? FLAG_AC : 0;
+  state->cc.psw = (state->cc.psw & FLAG_CY) | ZSPTable[answer] | ac;
+  return answer;
+}
+
+/*
+ * Function: DecimalAdjust
+ * -----------------------
+ *  Adjusts the accumulator to packed BCD after an addition(DAA)
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: void
+ */
+static void DecimalAdjust(States *state)
+{
+  uint8_t correction = 0;
+  uint8_t carry = state->cc.cy;
+  uint8_t lsb = state->a & 0x0f;
+  uint8_t msb = state->a >> 4;
+
+  if (state->cc.ac || lsb > 9) {
+    correction += 0x06;
+  }
+  if (state->cc.cy || msb > 9 || (msb >= 9 && lsb > 9)) {
+    correction += 0x60;
+    carry = 1;
+  }
+  Add(state, correction, 0);
+  state->cc.cy = carry;
+}
+
+
+#ifdef BLOCK_CACHE
+/*
+ * Function: CreateBlockCache
+ * --------------------------
+ *  Allocates an empty cache of decoded blocks
+ *
+ *  returns: pointer to the cache, NULL if it can't be allocated
+ */
+static BlockCache *CreateBlockCache(void)
+{
+  return calloc(1, sizeof(BlockCache));
+}
+
+/*
+ * Function: LookupBlock
+ * ---------------------
+ *  Finds the decoded block starting at pc, decoding it on a miss
+ *  A block is a straight-line run of instructions copied out of memory,
+ *  ending after the first branch, call, return, RST, PCHL, HLT or EI
+ *
+ *  cache: cache of decoded blocks
+ *  memory: memory of Intel8080 machine
+ *  pc: address of the first instruction
+ *  handlers: opcode handler labels(threaded dispatch), else NULL
+ *
+ *  returns: pointer to the decoded block, NULL if it can't be allocated
+ */
+static Block *LookupBlock(BlockCache *cache, uint8_t *memory, uint16_t pc,
+                          const void *const *handlers)
+{
+  Block *block = cache->blocks[pc];
+
+  // Blocks invalidated while executing are safe to free now
+  while (cache->retired != NULL) {
+    Block *next = cache->retired->retired;
+    free(cache->retired);
+    cache->retired = next;
+  }
+
+  if (block != NULL) {
+    cache->hits++;
+    return block;
+  }
+  cache->misses++;
+
+  block = malloc(sizeof(Block));
+  if (block == NULL) {
+    return NULL;
+  }
+  block->start = pc;
+  block->size = 0;
+  block->length = 0;
+
+  uint16_t addr = pc;
+  while (block->length < BLOCK_INSTRUCTIONS) {
+    uint8_t op = memory[addr];
+    Decoded *insn = &block->code[block->length++];
+    insn->bytes[0] = op;
+    insn->bytes[1] = memory[(uint16_t)(addr + 1)];
+    insn->bytes[2] = memory[(uint16_t)(addr + 2)];
+    insn->cycles = Opcodes[op].cycles;
+#ifdef THREADED_DISPATCH
+    insn->handler = handlers[op];
+#else
+    (void)handlers;
+#endif
+    addr += Opcodes[op].length;
+    block->size += Opcodes[op].length;
+
+    // Control flow ends the block(EI so interrupts are checked)
+    if (Opcodes[op].flow != I8080_FLOW_NEXT || op == 0xfb) {
+      break;
+    }
+  }
+
+  for (int i = 0; i < block->size; i++) {
+    cache->code[(uint16_t)(pc + i)]++;
+    cache->pages[(uint16_t)(pc + i) >> 8]++;
+  }
+  cache->blocks[pc] = block;
+
+  return block;
+}
+
+#endif
+
+/*
+ * Function: InvalidateBlocks
+ * --------------------------
+ *  Drops every decoded block covering a byte that was written
+ *  Blocks are only retired here since one of them may still be executing
+ *
+ *  cache: cache of decoded blocks
+ *  addr: address that was written
+ *
+ *  returns: void
+ */
+static void InvalidateBlocks(BlockCache *cache, uint16_t addr)
+{
+  for (int i = 0; i < BLOCK_BYTES; i++) {
+    uint16_t start = addr - i;
+    Block *block = cache->blocks[start];
+
+    if (block != NULL && i < block->size) {
+      cache->blocks[start] = NULL;
+      for (int j = 0; j < block->size; j++) {
+        cache->code[(uint16_t)(start + j)]--;
+        cache->pages[(uint16_t)(start + j) >> 8]--;
+      }
+      block->retired = cache->retired;
+      cache->retired = block;
+      cache->invalidations++;
+    }
+  }
+}
+
+#ifdef JIT
+/*
+  Native code generation(x86-64)
+  Translated code keeps the state in rbx, memory in r12, the remaining
+  instruction budget in r13, the cycle limit in r14, the cycle counter
+  in r15 and the Jit context in rbp. Guest registers stay in States
+*/
+
+/* x86-64 registers used as operands */
+#define X86_EAX 0
+#define X86_ECX 1
+#define X86_EDX 2
+#define X86_ESI 6
+
+/* Byte offset of a States field(fits a disp8) */
+#define FIELD(f) ((uint8_t)offsetof(States, f))
+
+/* Append bytes to the arena */
+#define EMIT(...) \
+  EmitBytes(jit, (const uint8_t[]){__VA_ARGS__}, \
+            sizeof((const uint8_t[]){__VA_ARGS__}))
+
+/* Offsets of registers B, C, D, E, H, L, (M), A */
+static const uint8_t RegisterOffsets[8] = {
+  offsetof(States, b), offsetof(States, c), offsetof(States, d),
+  offsetof(States, e), offsetof(States, h), offsetof(States, l),
+  0, offsetof(States, a)
+};
+
+/* PSW bit tested by conditions NZ/Z, NC/C, PO/PE, P/M */
+static const uint8_t ConditionMasks[4] = {
+  FLAG_Z, FLAG_CY, FLAG_P, FLAG_S
+};
+
+/* Writable address of executable code */
+static uint8_t *Writable(Jit *jit, const uint8_t *code)
+{
+  return jit->writable + (code - jit->arena);
+}
+
+static void EmitBytes(Jit *jit, const uint8_t *bytes, int n)
+{
+  memcpy(Writable(jit, jit->top), bytes, n);
+  jit->top += n;
+}
+
+static void EmitImmediate(Jit *jit, uint64_t value, int n)
+{
+  // x86 is little endian like the 8080
+  memcpy(Writable(jit, jit->top), &value, n);
+  jit->top += n;
+}
+
+/* Reserve a rel32 field, returns its location */
+static uint8_t *EmitRel32(Jit *jit)
+{
+  uint8_t *field = jit->top;
+  jit->top += 4;
+  return field;
+}
+
+static void PatchRel32(Jit *jit, uint8_t *field, const uint8_t *target)
+{
+  int32_t rel = (int32_t)(target - (field + 4));
+  memcpy(Writable(jit, field), &rel, 4);
+}
+
+static void AddFixup(Jit *jit, int kind, uint8_t *field, uint16_t target,
+                     uint8_t skipped)
+{
+  JitFixup *fixup = &jit->fixups[jit->nfixups++];
+  fixup->kind = kind;
+  fixup->field = field;
+  fixup->resume = jit->top;
+  fixup->target = target;
+  fixup->skipped = skipped;
+}
+
+/* jmp to native code */
+static void EmitJump(Jit *jit, const uint8_t *target)
+{
+  EMIT(0xe9);
+  PatchRel32(jit, EmitRel32(jit), target);
+}
+
+/* Jump(cc < 0) or conditional jump(x86 cc) to the block at target */
+static void EmitLink(Jit *jit, int cc, uint16_t target)
+{
+  if (cc < 0) {
+    EMIT(0xe9);
+  }
+  else {
+    EMIT(0x0f, (uint8_t)(0x80 | cc));
+  }
+  AddFixup(jit, JIT_LINK, EmitRel32(jit), target, 0);
+}
+
+/* Add the cycles of the instructions emitted so far to r15 */
+static void EmitCycles(Jit *jit)
+{
+  if (jit->pending > 127) {
+    EMIT(0x49, 0x81, 0xc7); // add r15, imm32
+    EmitImmediate(jit, jit->pending, 4);
+  }
+  else if (jit->pending > 0) {
+    EMIT(0x49, 0x83, 0xc7, (uint8_t)jit->pending); // add r15, imm8
+  }
+  jit->pending = 0;
+}
+
+/* Call a C function with the state as first argument */
+static void EmitCall(Jit *jit, uintptr_t function)
+{
+  EMIT(0x48, 0x89, 0xdf); // mov rdi, rbx
+  EMIT(0x49, 0xbb); // mov r11, imm64
+  EmitImmediate(jit, function, 8);
+  EMIT(0x41, 0xff, 0xd3); // call r11
+}
+
+/* reg = guest register r */
+static void EmitLoadRegister(Jit *jit, int reg, int r)
+{
+  EMIT(0x0f, 0xb6, (uint8_t)(0x43 | reg << 3), RegisterOffsets[r]);
+}
+
+/* guest register r = low byte of reg(eax, ecx or edx) */
+static void EmitStoreRegister(Jit *jit, int reg, int r)
+{
+  EMIT(0x88, (uint8_t)(0x43 | reg << 3), RegisterOffsets[r]);
+}
+
+/* eax = register pair BC, DE, HL or SP */
+static void EmitLoadPair(Jit *jit, int rp)
+{
+  if (rp == 3) {
+    EMIT(0x0f, 0xb7, 0x43, FIELD(sp)); // movzx eax, word [sp]
+  }
+  else {
+    EMIT(0x0f, 0xb7, 0x43, RegisterOffsets[rp * 2]); // High byte first
+    EMIT(0x66, 0xc1, 0xc0, 0x08); // rol ax, 8
+  }
+}
+
+/* Register pair BC, DE, HL or SP = ax */
+static void EmitStorePair(Jit *jit, int rp)
+{
+  if (rp != 3) {
+    EMIT(0x66, 0xc1, 0xc0, 0x08); // rol ax, 8
+  }
+  EMIT(0x66, 0x89, 0x43, rp == 3 ? FIELD(sp) : RegisterOffsets[rp * 2]);
+}
+
+/* eax = (SP + delta) & 0xffff */
+static void EmitStackAddress(Jit *jit, int delta)
+{
+  EMIT(0x0f, 0xb7, 0x43, FIELD(sp));
+  if (delta != 0) {
+    EMIT(0x83, 0xc0, (uint8_t)delta, 0x0f, 0xb7, 0xc0);
+  }
+}
+
+/* reg = memory[eax] */
+static void EmitLoadMemory(Jit *jit, int reg)
+{
+  EMIT(0x41, 0x0f, 0xb6, (uint8_t)(reg << 3 | 4), 0x04);
+}
+
+/*
+  memory[eax] = cl
+  A store into translated code calls TranslatedWrite from a stub and
+  leaves the block once the instruction is complete
+*/
+static void EmitStore(Jit *jit)
+{
+  EMIT(0x41, 0x88, 0x0c, 0x04); // mov [r12+rax], cl
+  EMIT(0x80, 0xbc, 0x05); // cmp byte [rbp+rax+code], 0
+  EmitImmediate(jit, offsetof(Jit, code), 4);
+  EMIT(0x00, 0x0f, 0x85); // jne stub
+  uint8_t *field = EmitRel32(jit);
+  AddFixup(jit, JIT_WRITTEN, field, 0, 0);
+}
+
+/* Push a 16 bit value on the guest stack */
+static void EmitPushValue(Jit *jit, uint16_t value)
+{
+  EmitStackAddress(jit, -1);
+  EMIT(0xb9); // mov ecx, imm32
+  EmitImmediate(jit, value >> 8, 4);
+  EmitStore(jit);
+  EmitStackAddress(jit, -2);
+  EMIT(0xb9);
+  EmitImmediate(jit, value & 0xff, 4);
+  EmitStore(jit);
+  EMIT(0x66, 0x83, 0x6b, FIELD(sp), 0x02); // sub word [sp], 2
+}
+
+/* Pop the return address and continue there */
+static void EmitReturn(Jit *jit)
+{
+  EmitStackAddress(jit, 0);
+  EmitLoadMemory(jit, X86_ECX);
+  EmitStackAddress(jit, 1);
+  EmitLoadMemory(jit, X86_EDX);
+  EMIT(0x66, 0x83, 0x43, FIELD(sp), 0x02); // add word [sp], 2
+  EMIT(0xc1, 0xe2, 0x08, 0x09, 0xd1, 0x89, 0xc8); // eax = edx << 8 | ecx
+  EmitJump(jit, jit->dispatch);
+}
+
+/*
+  Test the condition of a conditional jump, call or return
+  returns: x86 condition code of the condition not being met
+*/
+static int EmitCondition(Jit *jit, uint8_t op)
+{
+  int condition = (op >> 3) & 7;
+
+  EMIT(0xf6, 0x43, FIELD(cc), ConditionMasks[condition >> 1]);
+  return (condition & 1) ? 0x4 : 0x5; // jz when the flag must be set
+}
+
+/*
+  ADD, ADC, SUB, SBB, ANA, XRA, ORA or CMP of a register, M(src 6)
+  or an immediate(src 8)
+*/
+static void EmitArithmetic(Jit *jit, int kind, int src, uint8_t value)
+{
+  if (src == 6) {
+    EmitLoadPair(jit, 2);
+    EmitLoadMemory(jit, X86_ESI);
+  }
+  else if (src == 8) {
+    EMIT(0xbe); // mov esi, imm32
+    EmitImmediate(jit, value, 4);
+  }
+  else {
+    EmitLoadRegister(jit, X86_ESI, src);
+  }
+
+  if (kind == 1 || kind == 3) {
+    EMIT(0x0f, 0xb6, 0x53, FIELD(cc), 0x83, 0xe2, 0x01); // edx = cy
+  }
+  else if (kind == 0 || kind == 2 || kind == 7) {
+    EMIT(0x31, 0xd2); // edx = 0
+  }
+
+  switch (kind) {
+    case 0: case 1: EmitCall(jit, (uintptr_t)Add); break;
+    case 4: EmitCall(jit, (uintptr_t)And); break;
+    case 5: EmitCall(jit, (uintptr_t)Xor); break;
+    case 6: EmitCall(jit, (uintptr_t)Or); break;
+    default: EmitCall(jit, (uintptr_t)Subtract); break;
+  }
+
+  if (kind == 2 || kind == 3) {
+    EmitStoreRegister(jit, X86_EAX, 7);
+  }
+}
+
+/* Emit one instruction that does not end the block */
+static void EmitInstruction(Jit *jit, uint8_t *memory, uint16_t addr)
+{
+  uint8_t op = memory[addr];
+  uint8_t lo = memory[(uint16_t)(addr + 1)];
+  uint8_t hi = memory[(uint16_t)(addr + 2)];
+  uint16_t word = (hi << 8) | lo;
+  int dst = (op >> 3) & 7;
+  int src = op & 7;
+  int rp = (op >> 4) & 3;
+
+  if (op >= 0x40 && op < 0x80) { // MOV
+    if (src == 6) {
+      EmitLoadPair(jit, 2);
+      EmitLoadMemory(jit, X86_ECX);
+      EmitStoreRegister(jit, X86_ECX, dst);
+    }
+    else if (dst == 6) {
+      EmitLoadPair(jit, 2);
+      EmitLoadRegister(jit, X86_ECX, src);
+      EmitStore(jit);
+    }
+    else {
+      EmitLoadRegister(jit, X86_ECX, src);
+      EmitStoreRegister(jit, X86_ECX, dst);
+    }
+    return;
+  }
+  if (op >= 0x80 && op < 0xc0) {
+    EmitArithmetic(jit, dst, src, 0);
+    return;
+  }
+  if ((op & 0xc7) == 0xc6) { // ADI ... CPI
+    EmitArithmetic(jit, dst, 8, lo);
+    return;
+  }
+
+  switch (op & 0xcf) {
+    case 0x01: // LXI
+      {
+        if (rp == 3) {
+          EMIT(0x66, 0xc7, 0x43, FIELD(sp), lo, hi);
+        }
+        else {
+          EMIT(0xc6, 0x43, RegisterOffsets[rp * 2], hi);
+          EMIT(0xc6, 0x43, RegisterOffsets[rp * 2 + 1], lo);
+        }
+      } return;
+    case 0x03: // INX
+    case 0x0b: // DCX
+      {
+        EmitLoadPair(jit, rp);
+        EMIT(0x66, 0xff, (op & 0x08) ? 0xc8 : 0xc0); // dec/inc ax
+        EmitStorePair(jit, rp);
+      } return;
+    case 0x09: // DAD
+      {
+        EmitLoadPair(jit, rp);
+        EMIT(0x89, 0xc2); // mov edx, eax
+        EmitLoadPair(jit, 2);
+        EMIT(0x01, 0xd0, 0x89, 0xc2, 0xc1, 0xea, 0x10); // edx = carry
+        EMIT(0x80, 0x63, FIELD(cc), 0xfe, 0x08, 0x53, FIELD(cc));
+        EMIT(0x0f, 0xb7, 0xc0);
+        EmitStorePair(jit, 2);
+      } return;
+    case 0xc1: // POP
+      {
+        EmitStackAddress(jit, 0);
+        EmitLoadMemory(jit, X86_ECX);
+        if (rp == 3) {
+          EMIT(0x83, 0xe1, 0xd5, 0x88, 0x4b, FIELD(cc)); // Flags
+        }
+        else {
+          EmitStoreRegister(jit, X86_ECX, rp * 2 + 1);
+        }
+        EmitStackAddress(jit, 1);
+        EmitLoadMemory(jit, X86_ECX);
+        EmitStoreRegister(jit, X86_ECX, rp == 3 ? 7 : rp * 2);
+        EMIT(0x66, 0x83, 0x43, FIELD(sp), 0x02); // add word [sp], 2
+      } return;
+    case 0xc5: // PUSH
+      {
+        EmitStackAddress(jit, -1);
+        EmitLoadRegister(jit, X86_ECX, rp == 3 ? 7 : rp * 2);
+        EmitStore(jit);
+        EmitStackAddress(jit, -2);
+        if (rp == 3) {
+          EMIT(0x0f, 0xb6, 0x4b, FIELD(cc), 0x83, 0xc9, 0x02); // Flags
+        }
+        else {
+          EmitLoadRegister(jit, X86_ECX, rp * 2 + 1);
+        }
+        EmitStore(jit);
+        EMIT(0x66, 0x83, 0x6b, FIELD(sp), 0x02); // sub word [sp], 2
+      } return;
+  }
+
+  switch (op & 0xc7) {
+    case 0x04: // INR
+    case 0x05: // DCR
+      {
+        uintptr_t function = (op & 1) ? (uintptr_t)Decrement :
+                                        (uintptr_t)Increment;
+        if (dst == 6) {
+          EmitLoadPair(jit, 2);
+          EmitLoadMemory(jit, X86_ESI);
+          EmitCall(jit, function);
+          EMIT(0x89, 0xc1); // mov ecx, eax
+          EmitLoadPair(jit, 2);
+          EmitStore(jit);
+        }
+        else {
+          EmitLoadRegister(jit, X86_ESI, dst);
+          EmitCall(jit, function);
+          EmitStoreRegister(jit, X86_EAX, dst);
+        }
+      } return;
+    case 0x06: // MVI
+      {
+        if (dst == 6) {
+          EmitLoadPair(jit, 2);
+          EMIT(0xb9);
+          EmitImmediate(jit, lo, 4);
+          EmitStore(jit);
+        }
+        else {
+          EMIT(0xc6, 0x43, RegisterOffsets[dst], lo);
+        }
+      } return;
+  }
+
+  switch (op) {
+    case 0x02: // STAX B
+    case 0x12: // STAX D
+      {
+        EmitLoadPair(jit, rp);
+        EmitLoadRegister(jit, X86_ECX, 7);
+        EmitStore(jit);
+      } break;
+    case 0x0a: // LDAX B
+    case 0x1a: // LDAX D
+      {
+        EmitLoadPair(jit, rp);
+        EmitLoadMemory(jit, X86_ECX);
+        EmitStoreRegister(jit, X86_ECX, 7);
+      } break;
+    case 0x22: // SHLD addr
+      {
+        EMIT(0xb8);
+        EmitImmediate(jit, word, 4);
+        EmitLoadRegister(jit, X86_ECX, 5);
+        EmitStore(jit);
+        EMIT(0xb8);
+        EmitImmediate(jit, (uint16_t)(word + 1), 4);
+        EmitLoadRegister(jit, X86_ECX, 4);
+        EmitStore(jit);
+      } break;
+    case 0x2a: // LHLD addr
+      {
+        EMIT(0xb8);
+        EmitImmediate(jit, word, 4);
+        EmitLoadMemory(jit, X86_ECX);
+        EmitStoreRegister(jit, X86_ECX, 5);
+        EMIT(0xb8);
+        EmitImmediate(jit, (uint16_t)(word + 1), 4);
+        EmitLoadMemory(jit, X86_ECX);
+        EmitStoreRegister(jit, X86_ECX, 4);
+      } break;
+    case 0x32: // STA addr
+      {
+        EMIT(0xb8);
+        EmitImmediate(jit, word, 4);
+        EmitLoadRegister(jit, X86_ECX, 7);
+        EmitStore(jit);
+      } break;
+    case 0x3a: // LDA addr
+      {
+        EMIT(0xb8);
+        EmitImmediate(jit, word, 4);
+        EmitLoadMemory(jit, X86_ECX);
+        EmitStoreRegister(jit, X86_ECX, 7);
+      } break;
+    case 0x07: // RLC
+      {
+        EMIT(0x0f, 0xb6, 0x43, FIELD(a), 0xd0, 0xc0, 0x88, 0x43, FIELD(a));
+        EMIT(0x24, 0x01, 0x80, 0x63, FIELD(cc), 0xfe, 0x08, 0x43, FIELD(cc));
+      } break;
+    case 0x0f: // RRC
+      {
+        EMIT(0x0f, 0xb6, 0x43, FIELD(a), 0xd0, 0xc8, 0x88, 0x43, FIELD(a));
+        EMIT(0xc0, 0xe8, 0x07, 0x80, 0x63, FIELD(cc), 0xfe,
+             0x08, 0x43, FIELD(cc));
+      } break;
+    case 0x17: // RAL
+      {
+        EMIT(0x0f, 0xb6, 0x4b, FIELD(cc), 0x83, 0xe1, 0x01);
+        EMIT(0x0f, 0xb6, 0x43, FIELD(a), 0x01, 0xc0, 0x09, 0xc8);
+        EMIT(0x88, 0x43, FIELD(a), 0xc1, 0xe8, 0x08);
+        EMIT(0x80, 0x63, FIELD(cc), 0xfe, 0x08, 0x43, FIELD(cc));
+      } break;
+    case 0x1f: // RAR
+      {
+        EMIT(0x0f, 0xb6, 0x4b, FIELD(cc), 0x83, 0xe1, 0x01, 0xc1, 0xe1, 0x07);
+        EMIT(0x0f, 0xb6, 0x43, FIELD(a), 0x89, 0xc2, 0xd1, 0xe8, 0x09, 0xc8);
+        EMIT(0x88, 0x43, FIELD(a), 0x83, 0xe2, 0x01);
+        EMIT(0x80, 0x63, FIELD(cc), 0xfe, 0x08, 0x53, FIELD(cc));
+      } break;
+    case 0x27: // DAA
+      {
+        EmitCall(jit, (uintptr_t)DecimalAdjust);
+      } break;
+    case 0x2f: // CMA
+      {
+        EMIT(0xf6, 0x53, FIELD(a));
+      } break;
+    case 0x37: // STC
+      {
+        EMIT(0x80, 0x4b, FIELD(cc), 0x01);
+      } break;
+    case 0x3f: // CMC
+      {
+        EMIT(0x80, 0x73, FIELD(cc), 0x01);
+      } break;
+    case 0xe3: // XTHL
+      {
+        EmitStackAddress(jit, 0);
+        EmitLoadMemory(jit, X86_EDX);
+        EmitLoadRegister(jit, X86_ECX, 5);
+        EmitStore(jit);
+        EmitStoreRegister(jit, X86_EDX, 5);
+        EmitStackAddress(jit, 1);
+        EmitLoadMemory(jit, X86_EDX);
+        EmitLoadRegister(jit, X86_ECX, 4);
+        EmitStore(jit);
+        EmitStoreRegister(jit, X86_EDX, 4);
+      } break;
+    case 0xeb: // XCHG
+      {
+        EMIT(0x0f, 0xb7, 0x43, FIELD(d), 0x0f, 0xb7, 0x4b, FIELD(h));
+        EMIT(0x66, 0x89, 0x4b, FIELD(d), 0x66, 0x89, 0x43, FIELD(h));
+      } break;
+    case 0xf9: // SPHL
+      {
+        EmitLoadPair(jit, 2);
+        EmitStorePair(jit, 3);
+      } break;
+    case 0xf3: // DI
+      {
+        EMIT(0xc6, 0x43, FIELD(int_enable), 0x00);
+      } break;
+    case 0xfb: // EI
+      {
+        EMIT(0xc6, 0x43, FIELD(int_enable), 0x01);
+        EmitCycles(jit);
+        EMIT(0x4c, 0x89, 0x7b, FIELD(ei_cycles)); // mov [ei_cycles], r15
+      } break;
+    case 0xd3: // OUT D8
+      {
+        /* Devices see the cycle counter after the instruction */
+        EmitCycles(jit);
+        EMIT(0x4c, 0x89, 0x7b, FIELD(cycles)); // mov [cycles], r15
+        EMIT(0xbe, memory[(uint16_t)(addr + 1)], 0x00, 0x00, 0x00); // port
+        EMIT(0x0f, 0xb6, 0x53, FIELD(a)); // movzx edx, byte [a]
+        EmitCall(jit, (uintptr_t)WritePort);
+      } break;
+    case 0xdb: // IN D8
+      {
+        EmitCycles(jit);
+        EMIT(0x4c, 0x89, 0x7b, FIELD(cycles)); // mov [cycles], r15
+        EMIT(0xbe, memory[(uint16_t)(addr + 1)], 0x00, 0x00, 0x00); // port
+        EmitCall(jit, (uintptr_t)ReadPort);
+        EMIT(0x88, 0x43, FIELD(a)); // mov [a], al
+      } break;
+    default: // NOP and undocumented opcodes
+      break;
+  }
+}
+
+/* Emit the instruction ending a block: jumps, calls, returns and HLT */
+static void EmitTransfer(Jit *jit, uint8_t *memory, uint16_t addr)
+{
+  uint8_t op = memory[addr];
+  uint16_t target = memory[(uint16_t)(addr + 1)] |
+                    (memory[(uint16_t)(addr + 2)] << 8);
+
+  EmitCycles(jit);
+  if (op == 0x76) { // HLT
+    EMIT(0xc6, 0x43, FIELD(halted), 0x01, 0x66, 0xc7, 0x43, FIELD(pc));
+    EmitImmediate(jit, (uint16_t)(addr + 1), 2);
+    EmitJump(jit, jit->exit);
+  }
+  else if (op == 0xc3) { // JMP
+    EmitLink(jit, -1, target);
+  }
+  else if (op == 0xc9) { // RET
+    EmitReturn(jit);
+  }
+  else if (op == 0xcd) { // CALL
+    EmitPushValue(jit, addr + 3);
+    EmitLink(jit, -1, target);
+  }
+  else if (op == 0xe9) { // PCHL
+    EmitLoadPair(jit, 2);
+    EmitJump(jit, jit->dispatch);
+  }
+  else if ((op & 0xc7) == 0xc7) { // RST
+    EmitPushValue(jit, addr + 1);
+    EmitLink(jit, -1, op & 0x38);
+  }
+  else if ((op & 0xc7) == 0xc2) { // Jcc
+    EmitLink(jit, EmitCondition(jit, op) ^ 1, target);
+    EmitLink(jit, -1, addr + 3);
+  }
+  else { // Ccc and Rcc
+    int call = (op & 0xc7) == 0xc4;
+    EmitLink(jit, EmitCondition(jit, op), addr + (call ? 3 : 1));
+    EMIT(0x49, 0x83, 0xc7, 0x06); // Condition met
+    if (call) {
+      EmitPushValue(jit, addr + 3);
+      EmitLink(jit, -1, target);
+    }
+    else {
+      EmitReturn(jit);
+    }
+  }
+}
+
+/*
+ * Function: CreateJit
+ * -------------------
+ *  Maps the arena and emits the routines shared by all blocks
+ *  No page is writable and executable at once: the arena is a shared
+ *  memory file(memfd on Linux, shm_open elsewhere) mapped executable
+ *  for running and, at another address, writable for emitting, so
+ *  translating never changes page protections
+ *
+ *  returns: pointer to the translator, NULL when executable memory
+ *  can't be mapped(the interpreter is used instead)
+ */
+static Jit *CreateJit(void)
+{
+  Jit *jit = calloc(1, sizeof(Jit));
+  if (jit == NULL) {
+    return NULL;
+  }
+#ifdef __linux__
+  int fd = memfd_create("i8080-jit", MFD_CLOEXEC);
+#else
+  char name[32];
+  snprintf(name, sizeof(name), "/i8080-jit-%lx",
+           (unsigned long)((uintptr_t)jit ^ (uintptr_t)getpid()));
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) {
+    shm_unlink(name);
+  }
+#endif
+  if (fd < 0) {
+    free(jit);
+    return NULL;
+  }
+  jit->arena = MAP_FAILED;
+  jit->writable = MAP_FAILED;
+  if (ftruncate(fd, JIT_ARENA_BYTES) == 0) {
+    jit->arena = mmap(NULL, JIT_ARENA_BYTES, PROT_READ | PROT_EXEC,
+                      MAP_SHARED, fd, 0);
+    jit->writable = mmap(NULL, JIT_ARENA_BYTES, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (jit->arena == MAP_FAILED || jit->writable == MAP_FAILED) {
+    if (jit->arena != MAP_FAILED) {
+      munmap(jit->arena, JIT_ARENA_BYTES);
+    }
+    if (jit->writable != MAP_FAILED) {
+      munmap(jit->writable, JIT_ARENA_BYTES);
+    }
+    free(jit);
+    return NULL;
+  }
+  jit->top = jit->arena;
+
+  /* enter(state, budget, cycle_limit, code, jit) */
+  jit->enter = (void *)jit->top;
+  EMIT(0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57); // push
+  EMIT(0x48, 0x83, 0xec, 0x08); // Align the stack for calls
+  EMIT(0x48, 0x89, 0xfb); // mov rbx, rdi
+  EMIT(0x4c, 0x89, 0xc5); // mov rbp, r8
+  EMIT(0x4c, 0x8b, 0x67, FIELD(memory)); // mov r12, [rdi+memory]
+  EMIT(0x49, 0x89, 0xf5); // mov r13, rsi
+  EMIT(0x49, 0x89, 0xd6); // mov r14, rdx
+  EMIT(0x4c, 0x8b, 0x7f, FIELD(cycles)); // mov r15, [rdi+cycles]
+  EMIT(0xff, 0xe1); // jmp rcx
+
+  /* Continue at the guest address in eax, leave if it isn't translated */
+  jit->dispatch = jit->top;
+  EMIT(0x66, 0x89, 0x43, FIELD(pc)); // mov [pc], ax
+  EMIT(0x48, 0x8b, 0x4c, 0xc5, 0x00); // mov rcx, [rbp+rax*8]
+  EMIT(0x48, 0x85, 0xc9, 0x74, 0x02); // test rcx, rcx; jz exit
+  EMIT(0xff, 0xe1); // jmp rcx
+
+  /* Return the remaining budget */
+  jit->exit = jit->top;
+  EMIT(0x4c, 0x89, 0x7b, FIELD(cycles)); // mov [cycles], r15
+  EMIT(0x4c, 0x89, 0xe8); // mov rax, r13
+  EMIT(0x48, 0x83, 0xc4, 0x08);
+  EMIT(0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5d, 0x5b, 0xc3);
+
+  jit->first = jit->top;
+  return jit;
+}
+
+/*
+ * Function: FlushJit
+ * ------------------
+ *  Drops every translated block and empties the arena
+ *  Must not be called while translated code is running
+ *
+ *  jit: translator
+ *
+ *  returns: void
+ */
+static void FlushJit(Jit *jit)
+{
+  memset(jit->entry, 0, sizeof(jit->entry));
+  memset(jit->code, 0, sizeof(jit->code));
+  memset(jit->size, 0, sizeof(jit->size));
+  memset(jit->incoming, 0, sizeof(jit->incoming));
+  jit->nlinks = 0;
+  jit->top = jit->first;
+  jit->flushes++;
+}
+
+/*
+ * Function: TranslateBlock
+ * ------------------------
+ *  Translates the straight-line run of instructions starting at pc
+ *  into x86-64 code, ending after the first jump, call, return, RST,
+ *  PCHL or HLT. Jumps to known addresses are chained straight to the
+ *  translated target once it exists
+ *
+ *  A block only runs when the whole of it fits the instruction budget
+ *  and no instruction but the last would start at or past the cycle
+ *  limit, otherwise the interpreter steps to the limit
+ *
+ *  jit: translator
+ *  memory: memory of Intel8080 machine
+ *  pc: address of the first instruction
+ *
+ *  returns: native code of the block, NULL when the instruction at pc
+ *  is left to the interpreter
+ */
+static uint8_t *TranslateBlock(Jit *jit, uint8_t *memory, uint16_t pc)
+{
+  uint16_t addrs[BLOCK_INSTRUCTIONS];
+  int n = 0;
+  int ended = 0; // Last instruction transfers control
+  uint32_t head = 0; // Cycles of all instructions but the last
+  uint16_t addr = pc;
+
+  while (n < BLOCK_INSTRUCTIONS && !ended) {
+    uint8_t op = memory[addr];
+    if (n > 0) {
+      head += Opcodes[memory[addrs[n - 1]]].cycles;
+    }
+    addrs[n++] = addr;
+    addr += Opcodes[op].length;
+    ended = Opcodes[op].flow != I8080_FLOW_NEXT;
+  }
+  if (n == 0) {
+    return NULL;
+  }
+
+  if (jit->arena + JIT_ARENA_BYTES - jit->top < JIT_BLOCK_CODE ||
+      jit->nlinks + 2 > JIT_LINKS) {
+    FlushJit(jit);
+  }
+  jit->nfixups = 0;
+  jit->pending = 0;
+
+  /* Check the budget and the cycle limit */
+  uint8_t *block = jit->top;
+  EMIT(0x49, 0x83, 0xfd, (uint8_t)n, 0x0f, 0x82); // cmp r13, n; jb
+  AddFixup(jit, JIT_REFUSE, EmitRel32(jit), pc, 0);
+  EMIT(0x49, 0x8d, 0x87); // lea rax, [r15+head]
+  EmitImmediate(jit, head, 4);
+  EMIT(0x4c, 0x39, 0xf0, 0x0f, 0x83); // cmp rax, r14; jae
+  AddFixup(jit, JIT_REFUSE, EmitRel32(jit), pc, 0);
+  EMIT(0x49, 0x83, 0xed, (uint8_t)n); // sub r13, n
+
+  for (int i = 0; i < n; i++) {
+    uint8_t op = memory[addrs[i]];
+
+    if (ended && i == n - 1) {
+      jit->pending += Opcodes[op].cycles;
+      EmitTransfer(jit, memory, addrs[i]);
+      break;
+    }
+
+    int stores = jit->nfixups;
+    jit->pending += Opcodes[op].cycles;
+    EmitInstruction(jit, memory, addrs[i]);
+
+    /* Leave after a store into translated code */
+    if (jit->nfixups != stores) {
+      uint16_t next = i + 1 < n ? addrs[i + 1] : addr;
+      EmitCycles(jit);
+      EMIT(0x80, 0xbd); // cmp byte [rbp+written], 0
+      EmitImmediate(jit, offsetof(Jit, written), 4);
+      EMIT(0x00, 0x0f, 0x85);
+      AddFixup(jit, JIT_EXIT, EmitRel32(jit), next, n - 1 - i);
+    }
+
+    /* Leave when a device stopped the machine */
+    if (op == 0xd3 || op == 0xdb) {
+      uint16_t next = i + 1 < n ? addrs[i + 1] : addr;
+      EMIT(0x83, 0x7b, FIELD(error), 0x00, 0x0f, 0x85); // cmp [error], 0; jne
+      AddFixup(jit, JIT_STOP, EmitRel32(jit), next, n - 1 - i);
+    }
+
+    /* Leave after EI when a request waits for it */
+    if (op == 0xfb) {
+      uint16_t next = i + 1 < n ? addrs[i + 1] : addr;
+      EMIT(0x80, 0x7b, FIELD(irq), 0x00, 0x0f, 0x85); // cmp [irq], 0; jne
+      AddFixup(jit, JIT_STOP, EmitRel32(jit), next, n - 1 - i);
+    }
+  }
+  if (!ended) {
+    EmitCycles(jit);
+    EmitLink(jit, -1, addr);
+  }
+
+  /* Stubs */
+  for (int i = 0; i < jit->nfixups; i++) {
+    JitFixup *fixup = &jit->fixups[i];
+
+    PatchRel32(jit, fixup->field, jit->top);
+    switch (fixup->kind) {
+      case JIT_REFUSE:
+        {
+          EMIT(0x66, 0xc7, 0x43, FIELD(pc));
+          EmitImmediate(jit, fixup->target, 2);
+          EmitJump(jit, jit->exit);
+        } break;
+      case JIT_WRITTEN:
+        {
+          EMIT(0x50, 0x51, 0x52, 0x56, 0x89, 0xc6); // Save, esi = addr
+          EmitCall(jit, (uintptr_t)TranslatedWrite);
+          EMIT(0x5e, 0x5a, 0x59, 0x58);
+          EmitJump(jit, fixup->resume);
+        } break;
+      case JIT_EXIT:
+        {
+          EMIT(0xc6, 0x85); // mov byte [rbp+written], 0
+          EmitImmediate(jit, offsetof(Jit, written), 4);
+          EMIT(0x00, 0x49, 0x83, 0xc5, fixup->skipped); // add r13, skipped
+          EMIT(0xb8);
+          EmitImmediate(jit, fixup->target, 4);
+          EmitJump(jit, jit->dispatch);
+        } break;
+      case JIT_STOP:
+        {
+          EMIT(0x49, 0x83, 0xc5, fixup->skipped); // add r13, skipped
+          EMIT(0x66, 0xc7, 0x43, FIELD(pc));
+          EmitImmediate(jit, fixup->target, 2);
+          EmitJump(jit, jit->exit);
+        } break;
+      case JIT_LINK:
+        {
+          JitLink *link = &jit->links[jit->nlinks++];
+          link->field = fixup->field;
+          link->stub = jit->top;
+          link->next = jit->incoming[fixup->target];
+          jit->incoming[fixup->target] = link;
+          if (jit->entry[fixup->target] != NULL) {
+            PatchRel32(jit, link->field, jit->entry[fixup->target]);
+          }
+          EMIT(0xb8);
+          EmitImmediate(jit, fixup->target, 4);
+          EmitJump(jit, jit->dispatch);
+        } break;
+    }
+  }
+
+  /* Publish the block and chain the jumps waiting for it */
+  jit->entry[pc] = block;
+  jit->size[pc] = (uint16_t)(addr - pc);
+  for (int i = 0; i < jit->size[pc]; i++) {
+    jit->code[(uint16_t)(pc + i)]++;
+  }
+  for (JitLink *link = jit->incoming[pc]; link != NULL; link = link->next) {
+    PatchRel32(jit, link->field, block);
+  }
+  jit->blocks++;
+
+  return block;
+}
+
+/*
+ * Function: InvalidateTranslations
+ * --------------------------------
+ *  Drops every translated block covering a byte that was written
+ *  Jumps chained into them go back through their stubs. The native code
+ *  is left in place, it may still be running and is reclaimed by the
+ *  next flush
+ *
+ *  jit: translator
+ *  addr: address that was written
+ *
+ *  returns: void
+ */
+static void InvalidateTranslations(Jit *jit, uint16_t addr)
+{
+  for (int i = 0; i < BLOCK_BYTES; i++) {
+    uint16_t start = addr - i;
+
+    if (jit->entry[start] != NULL && i < jit->size[start]) {
+      jit->entry[start] = NULL;
+      for (int j = 0; j < jit->size[start]; j++) {
+        jit->code[(uint16_t)(start + j)]--;
+      }
+      for (JitLink *link = jit->incoming[start]; link != NULL;
+           link = link->next) {
+        PatchRel32(jit, link->field, link->stub);
+      }
+      jit->invalidations++;
+    }
+  }
+}
+
+/*
+ * Function: TranslatedWrite
+ * -------------------------
+ *  Called by translated code after it stored into translated code
+ *
+ *  state: pointer to current state of machine
+ *  addr: address that was written
+ *
+ *  returns: void
+ */
+static void TranslatedWrite(States *state, uint16_t addr)
+{
+  InvalidateTranslations(state->jit, addr);
+  state->jit->written = 1;
+}
+
+/*
+ * Function: ExecuteTranslated
+ * ---------------------------
+ *  Same contract as Execute, running translated blocks
+ *  Instructions that can't be translated, and the instructions close
+ *  to the count or cycle limit, are stepped by the interpreter
+ *
+ *  state: pointer to current state of machine
+ *  count: maximum number of instructions to execute
+ *  cycle_limit: value of the cycle counter to stop at
+ *
+ *  returns: number of instructions executed
+ */
+static uint64_t ExecuteTranslated(States *state, uint64_t count, uint64_t cycle_limit)
+{
+  Jit *jit = state->jit;
+  uint64_t executed = 0;
+
+  while (executed < count && state->cycles < cycle_limit &&
+         state->halted == 0 && state->error == I8080_OK &&
+         !(state->irq != 0 && state->int_enable)) {
+    uint8_t *code = jit->entry[state->pc];
+    uint64_t left = count - executed;
+
+    if (code == NULL) {
+      code = TranslateBlock(jit, state->memory, state->pc);
+    }
+    if (code != NULL) {
+      uint64_t rest = jit->enter(state, left, cycle_limit, code, jit);
+      jit->written = 0;
+      if (rest != left) {
+        executed += left - rest;
+        continue;
+      }
+    }
+    executed += Execute(state, 1, cycle_limit);
+    jit->interpreted++;
+  }
+
+  return executed;
+}
+
+#undef EMIT
+#undef FIELD
+#endif
+
+/*
+ * Function: Execute
+ * -----------------
+ *  Emulates the Intel8080 CPU architecture from given instructions
+ *  Instructions run back to back until count instructions have been
+ *  executed, the cycle counter reaches cycle_limit or the processor halts
+ *  Interrupts are left to Emulator and EmulateCycles, an EI finding a
+ *  raised request ends the run
+ *
+ *  Opcodes are dispatched by a switch inside the loop.
+ *  Define THREADED_DISPATCH to have every opcode handler jump straight
+ *  to the next handler through a table of labels(GCC computed gotos)
+ *
+ *  Define BLOCK_CACHE to fetch instructions from decoded blocks
+ *  (state->cache, attached on first use) instead of memory. Every write
+ *  to memory goes through WRITE, which drops the blocks covering the
+ *  written byte
+ *
+ *  state: pointer to current state of machine
+ *  count: maximum number of instructions to execute
+ *  cycle_limit: value of the cycle counter to stop at
+ *
+ *  returns: number of instructions executed, state->error tells why
+ *           the core stopped early if it had to
+ */
+uint64_t Execute(States *state, uint64_t count, uint64_t cycle_limit)
+{
+  uint64_t executed = 0;
+  uint8_t *opcode;
+  uint16_t pc; // Location of current instruction(for tracing)
+  uint64_t cycles = state->cycles; // Kept in a register
+  void (*trace)(States *state, uint16_t pc) = state->trace; // In a register
+
+  if (count == 0 || cycles >= cycle_limit || state->halted || state->error) {
+    return 0;
+  }
+
+#ifdef BLOCK_CACHE
+  if (state->cache == NULL && AttachBlockCache(state) != I8080_OK) {
+    state->error = I8080_ERROR_MEMORY;
+    return 0;
+  }
+  BlockCache *cache = state->cache;
+  Decoded *insn = NULL; // Decoded instruction being executed
+  Decoded *last = NULL; // Last instruction of the current block
+  uint64_t hits = 0; // Lookups found in place, added to the cache's
+
+  /*
+    Step through the current block, look up the next one after its last
+    instruction. Only the last can transfer control, so the others
+    always fall through to the next decoded instruction
+  */
+  #define FETCH() \
+    if (insn == last) { \
+      Block *block = cache->blocks[state->pc]; \
+      if (block != NULL && cache->retired == NULL) { \
+        hits++; \
+      } \
+      else if ((block = LookupBlock(cache, state->memory, state->pc, \
+                                    HANDLERS)) == NULL) { \
+        state->error = I8080_ERROR_MEMORY; \
+        goto done; \
+      } \
+      insn = block->code; \
+      last = &block->code[block->length - 1]; \
+    } \
+    else { \
+      insn++; \
+    } \
+    pc = state->pc; \
+    opcode = insn->bytes; \
+    state->pc += 1; \
+    cycles += insn->cycles
+  #define HANDLER insn->handler
+
+  /* Store to memory, dropping decoded blocks of the written byte */
+  #define WRITE(addr, value) \
+    do { \
+      uint16_t address = (addr); \
+      state->memory[address] = (value); \
+      if (cache->pages[address >> 8] != 0 && cache->code[address] != 0) { \
+        InvalidateBlocks(cache, address); \
+        last = insn; \
+      } \
+    } while (0)
+#else
+  uint8_t wrap[3]; // Instruction straddling the end of memory
+
+  /* Fetch next opcode and account for its cycles */
+  #define FETCH() \
+    pc = state->pc; \
+    opcode = &state->memory[pc]; \
+    if (pc > 0xfffd) { /* Operands wrap around to address 0 */ \
+      wrap[0] = opcode[0]; \
+      wrap[1] = state->memory[(uint16_t)(pc + 1)]; \
+      wrap[2] = state->memory[(uint16_t)(pc + 2)]; \
+      opcode = wrap; \
+    } \
+    state->pc += 1; \
+    cycles += Opcodes[*opcode].cycles
+  #define HANDLER dispatch[*opcode]
+
+#ifdef JIT
+  /* Store to memory, dropping translated blocks of the written byte */
+  #define WRITE(addr, value) \
+    do { \
+      uint16_t address = (addr); \
+      state->memory[address] = (value); \
+      if (state->jit != NULL && state->jit->code[address] != 0) { \
+        InvalidateTranslations(state->jit, address); \
+      } \
+    } while (0)
+#else
+  /* Store to memory */
+  #define WRITE(addr, value) state->memory[(uint16_t)(addr)] = (value)
+#endif
+#endif
+
+  /* Leave after the current instruction */
+  #define LEAVE() \
+    do { \
+      executed++; \
+      if (trace != NULL) { \
+        state->cycles = cycles; \
+        trace(state, pc); \
+      } \
+      goto done; \
+    } while (0)
+
+#ifdef THREADED_DISPATCH
+  static const void *dispatch[256] = {
+    &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03,
+    &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+    &&op_0x08, &&op_0x09, &&op_0x0a, &&op_0x0b,
+    &&op_0x0c, &&op_0x0d, &&op_0x0e, &&op_0x0f,
+    &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13,
+    &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+    &&op_0x18, &&op_0x19, &&op_0x1a, &&op_0x1b,
+    &&op_0x1c, &&op_0x1d, &&op_0x1e, &&op_0x1f,
+    &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23,
+    &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+    &&op_0x28, &&op_0x29, &&op_0x2a, &&op_0x2b,
+    &&op_0x2c, &&op_0x2d, &&op_0x2e, &&op_0x2f,
+    &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33,
+    &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+    &&op_0x38, &&op_0x39, &&op_0x3a, &&op_0x3b,
+    &&op_0x3c, &&op_0x3d, &&op_0x3e, &&op_0x3f,
+    &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43,
+    &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+    &&op_0x48, &&op_0x49, &&op_0x4a, &&op_0x4b,
+    &&op_0x4c, &&op_0x4d, &&op_0x4e, &&op_0x4f,
+    &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53,
+    &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+    &&op_0x58, &&op_0x59, &&op_0x5a, &&op_0x5b,
+    &&op_0x5c, &&op_0x5d, &&op_0x5e, &&op_0x5f,
+    &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63,
+    &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+    &&op_0x68, &&op_0x69, &&op_0x6a, &&op_0x6b,
+    &&op_0x6c, &&op_0x6d, &&op_0x6e, &&op_0x6f,
+    &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73,
+    &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+    &&op_0x78, &&op_0x79, &&op_0x7a, &&op_0x7b,
+    &&op_0x7c, &&op_0x7d, &&op_0x7e, &&op_0x7f,
+    &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83,
+    &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+    &&op_0x88, &&op_0x89, &&op_0x8a, &&op_0x8b,
+    &&op_0x8c, &&op_0x8d, &&op_0x8e, &&op_0x8f,
+    &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93,
+    &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+    &&op_0x98, &&op_0x99, &&op_0x9a, &&op_0x9b,
+    &&op_0x9c, &&op_0x9d, &&op_0x9e, &&op_0x9f,
+    &&op_0xa0, &&op_0xa1, &&op_0xa2, &&op_0xa3,
+    &&op_0xa4, &&op_0xa5, &&op_0xa6, &&op_0xa7,
+    &&op_0xa8, &&op_0xa9, &&op_0xaa, &&op_0xab,
+    &&op_0xac, &&op_0xad, &&op_0xae, &&op_0xaf,
+    &&op_0xb0, &&op_0xb1, &&op_0xb2, &&op_0xb3,
+    &&op_0xb4, &&op_0xb5, &&op_0xb6, &&op_0xb7,
+    &&op_0xb8, &&op_0xb9, &&op_0xba, &&op_0xbb,
+    &&op_0xbc, &&op_0xbd, &&op_0xbe, &&op_0xbf,
+    &&op_0xc0, &&op_0xc1, &&op_0xc2, &&op_0xc3,
+    &&op_0xc4, &&op_0xc5, &&op_0xc6, &&op_0xc7,
+    &&op_0xc8, &&op_0xc9, &&op_0xca, &&op_0xcb,
+    &&op_0xcc, &&op_0xcd, &&op_0xce, &&op_0xcf,
+    &&op_0xd0, &&op_0xd1, &&op_0xd2, &&op_0xd3,
+    &&op_0xd4, &&op_0xd5, &&op_0xd6, &&op_0xd7,
+    &&op_0xd8, &&op_0xd9, &&op_0xda, &&op_0xdb,
+    &&op_0xdc, &&op_0xdd, &&op_0xde, &&op_0xdf,
+    &&op_0xe0, &&op_0xe1, &&op_0xe2, &&op_0xe3,
+    &&op_0xe4, &&op_0xe5, &&op_0xe6, &&op_0xe7,
+    &&op_0xe8, &&op_0xe9, &&op_0xea, &&op_0xeb,
+    &&op_0xec, &&op_0xed, &&op_0xee, &&op_0xef,
+    &&op_0xf0, &&op_0xf1, &&op_0xf2, &&op_0xf3,
+    &&op_0xf4, &&op_0xf5, &&op_0xf6, &&op_0xf7,
+    &&op_0xf8, &&op_0xf9, &&op_0xfa, &&op_0xfb,
+    &&op_0xfc, &&op_0xfd, &&op_0xfe, &&op_0xff
+  };
+
+  /* Fetch next opcode and jump to its handler */
+  #define HANDLERS dispatch
+  #define OPCODE(n) op_##n:
+  #define NEXT \
+    if (trace != NULL) { \
+      state->cycles = cycles; \
+      trace(state, pc); \
+    } \
+    if (++executed == count || cycles >= cycle_limit) { \
+      goto done; \
+    } \
+    FETCH(); \
+    goto *HANDLER
+
+  FETCH();
+  goto *HANDLER;
+  {
+#else
+  #define HANDLERS NULL
+  #define OPCODE(n) case n:
+  #define NEXT break
+
+  while (executed < count && cycles < cycle_limit) {
+    FETCH();
+    switch(*opcode)
+    {
+#endif
+    OPCODE(0x00) NEXT;// NOP
+    OPCODE(0x01) // LXI B,D16
+        {
+          state->c = opcode[1];
+          state->b = opcode[2];
+          state-> pc += 2;//Advance by 2 bytes
+        } NEXT;
+    OPCODE(0x02) // STAX B
+        {
+          uint16_t addr = ((state->b) << 8) | (state->c);
+          WRITE(addr, state->a);
+        } NEXT;
+    OPCODE(0x03) // INX B
+        {
+          uint16_t answer = ( ((state->b) << 8) | (state->c) ) + 1;
+          state->b = (answer >> 8) & 0xff;
+          state->c = answer & 0xff;
+        } NEXT;
+    OPCODE(0x04) // INR B
+        {
+          state->b = Increment(state, state->b);
+        } NEXT;
+    OPCODE(0x05) // DCR B
+        {
+          state->b = Decrement(state, state->b);
+        } NEXT;
+    OPCODE(0x06) // MVI B,D8
+        {
+          state->b = opcode[1];
+          state->pc++;
+        } NEXT;
+    OPCODE(0x07) // RLC
+        {
+          uint8_t x = state->a;
+          state->a = ((x&0x80) >> 7) | (x << 1);
+          state->cc.cy = ((x&0x80) == 0x80);
+        }NEXT;
+    OPCODE(0x08) NEXT; // NOP
+    OPCODE(0x09) // DAD B
+        {
+          uint32_t rp = ((state->b)<< 8) | (state->c); // set B to MSByte
+          uint32_t hl = ((state->h)<< 8) | (state->l); // set H to MSByte
+          uint32_t answer = hl + rp; // Add HL + BC
+          state->cc.cy = (answer > 0xffff);
+          /* move MSByte to LSByte and clear upper half*/
+          state->h = ( (answer>>8) & 0xff);
+          state->l = (answer & 0xff); // Clear upper half
+        } NEXT;
+    OPCODE(0x0a) // LDAX B
+        {
+          uint16_t rp_addr = ((state->b) << 8) | (state->c);
+          state->a = state->memory[rp_addr];
+        } NEXT;
+    OPCODE(0x0b) // DCX B
+        {
+          uint16_t answer = ( ((state->b) << 8) | (state->c)) - 1;
+          state->b = (answer >> 8) & 0xff;
+          state->c = answer&0xff;
+        } NEXT;
+    OPCODE(0x0c) // INR C
+        {
+          state->c = Increment(state, state->c);
+        } NEXT;
+    OPCODE(0x0d) // DCR C
+        {
+          state->c = Decrement(state, state->c);
+        } NEXT;
+    OPCODE(0x0e) // MVI C,D8
+        {
+          state->c = opcode[1];
+          state->pc++;
+        } NEXT;
+    OPCODE(0x0f) // RRC
+        {
+          uint8_t x = state->a;
+          state->a = ((x & 1) << 7) | (x >> 1);
+          state->cc.cy = (1 == (x&1));
+        } NEXT;
+    OPCODE(0x10) NEXT; // NOP
+    OPCODE(0x11) // LXI D,D16
+        {
+          state->e = opcode[1];
+          state->d = opcode[2];
+          state-> pc += 2;
+        } NEXT;
+    OPCODE(0x12) // STAX D
+        {
+          uint16_t addr = ((state->d) << 8) | (state->e);
+          WRITE(addr, state->a);
+        } NEXT;
+    OPCODE(0x13) // INX D
+        {
+          uint16_t answer = ( ((state->d) << 8) | (state->e) ) + 1;
+          state->d = ((answer >> 8) & 0xff);
+          state->e = (answer & 0xff);
+        } NEXT;
+    OPCODE(0x14) // INR D
+        {
+          state->d = Increment(state, state->d);
+        } NEXT;
+    OPCODE(0x15) // DCR D
+        {
+          state->d = Decrement(state, state->d);
+        } NEXT;
+    OPCODE(0x16) // MVI D,D8
+        {
+          state->d = opcode[1];
+          state->pc++;
+        } NEXT;
+    OPCODE(0x17) // RAL
+        {
+          uint8_t x = state->a;
+          state->a = ((state->cc.cy)&0x01) | (x << 1);
+          state->cc.cy = ((x&0x80) == 0x80);
+        } NEXT;
+    OPCODE(0x18) NEXT; // NOP
+    OPCODE(0x19) // DAD D
+        {
+          uint32_t rp = ((state->d)<< 8) | (state->e);
+          uint32_t hl = ((state->h)<< 8) | (state->l);
+          uint32_t answer = hl + rp; // Add HL + DE
+          state->cc.cy = (answer > 0xffff);
+          state->h = ( (answer>>8) & 0xff);
+          state->l = (answer & 0xff);
+        } NEXT;
+    OPCODE(0x1a) // LDAX D
+        {
+          uint16_t rp_addr = ((state->d) << 8) | (state->e);
+          state->a = state->memory[rp_addr];
+        } NEXT;
+    OPCODE(0x1b) // DCX D
+        {
+          uint16_t answer = ( ((state->d) << 8) | (state->e)) - 1;
+          state->d = (answer >> 8) & 0xff;
+          state->e = answer&0xff;
+        } NEXT;
+    OPCODE(0x1c) // INR E
+        {
+          state->e = Increment(state, state->e);
+        } NEXT;
+    OPCODE(0x1d) // DCR E
+        {
+          state->e = Decrement(state, state->e);
+        } NEXT;
+    OPCODE(0x1e) // MVI E,D8
+        {
+          state->e = opcode[1];
+          state->pc++;
+        } NEXT;
+    OPCODE(0x1f) // RAR
+        {
+          uint8_t x = state->a;
+          state->a = ((state->cc.cy) << 7) | (x >> 1);
+          state->cc.cy = (1 == (x&1));
+        } NEXT;
+    OPCODE(0x20) NEXT; // NOP
+    OPCODE(0x21) // LXI H,D16
+        {
+          state->l = opcode[1];
+          state->h = opcode[2];
+          state-> pc += 2;
+        } NEXT;
+    OPCODE(0x22) // SHLD addr
+        {
+          uint16_t addr = (opcode[2] << 8) | opcode[1];
+          WRITE(addr, state->l);
+          WRITE(addr + 1, state->h);
+          state->pc += 2;
+        } NEXT;
+    OPCODE(0x23) // INX H
+        {
+          uint16_t rp = ((state->h) << 8) | (state->l);
+          uint16_t answer = rp + 1;
+          state->h = ((answer >> 8) & 0xff);
+          state->l = (answer & 0xff);
+        } NEXT;
+    OPCODE(0x24) // INR H
+        {
+          state->h = Increment(state, state->h);
+        } NEXT;
+    OPCODE(0x25) // DCR H
+        {
+          state->h = Decrement(state, state->h);
+        } NEXT;
+    OPCODE(0x26) // MVI H,D8
+        {
+          state->h = opcode[1];
+          state->pc++;
+        } NEXT;
+    OPCODE(0x27) // DAA
+        {
+          DecimalAdjust(state);
+        } NEXT;
+    OPCODE(0x28) NEXT; // NOP
+    OPCODE(0x29) // DAD H
+        {
+          uint32_t hl = ((state->h)<< 8) | (state->l);
+          uint32_t answer = hl + hl; // Add HL + HL
+          state->cc.cy = (answer > 0xffff);
+          state->h = ( (answer>>8) & 0xff);
+          state->l = (answer & 0xff);
+        } NEXT;
+    OPCODE(0x2a) // LHLD addr
+        {
+          uint16_t addr = (opcode[2] << 8)| opcode[1];
+          state->l = state->memory[addr];
+          state->h = state->memory[(uint16_t)(addr + 1)];
+          state->pc += 2;
+        } NEXT;
+    OPCODE(0x2b) // DCX H
+        {
+          uint16_t answer = ( ((state->h) << 8) | (state->l)) - 1;
+          state->h = (answer >> 8) & 0xff;
+          state->l = answer&0xff;
+        } NEXT;
+    OPCODE(0x2c) // INR L
+        {
+          state->l = Increment(state, state->l);
+        } NEXT;
+    OPCODE(0x2d) // DCR L
+        {
+          state->l = Decrement(state, state->l);
+        } NEXT;
+    OPCODE(0x2e) // MVI L,D8
+        {
+          state->l = opcode[1];
+          state->pc++;
+        } NEXT;
+    OPCODE(0x2f) // CMA
+        {
+          state->a = ~state->a;
+        } NEXT;
+    OPCODE(0x30) NEXT; // NOP
+    OPCODE(0x31) // LXI SP,D16
+        {
+          state->sp = ((opcode[2] << 8) | opcode[1]);
+          state->pc += 2;
+        } NEXT;
+    OPCODE(0x32) // STA addr
+        {
+          uint16_t addr = ((opcode[2] << 8) | opcode[1]); // Form address
+          WRITE(addr, state->a); // Load Acc to addr location
+          state->pc += 2;
+        } NEXT;
+    OPCODE(0x33) // INX SP
+        {
+          state->sp = (state->sp) + 1;
+        } NEXT;
+    OPCODE(0x34) // INR M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, Increment(state, state->memory[addr]));
+        } NEXT;
+    OPCODE(0x35) // DCR M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, Decrement(state, state->memory[addr]));
+        } NEXT;
+    OPCODE(0x36) // MVI M,D8
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, opcode[1]);
+          state->pc++;
+        } NEXT;
+    OPCODE(0x37) // STC
+        {
+          state->cc.cy = 1; // set carry
+        } NEXT;
+    OPCODE(0x38) NEXT; // NOP
+    OPCODE(0x39) // DAD SP
+        {
+          uint32_t hl = ((state->h)<< 8) | (state->l);
+          uint32_t answer = hl + state->sp; // Add HL + SP
+          state->cc.cy = (answer > 0xffff);
+          state->h = ( (answer>>8) & 0xff);
+          state->l = (answer & 0xff);
+        } NEXT;
+    OPCODE(0x3a) // LDA addr
+        {
+          uint16_t addr = ((opcode[2] << 8) | opcode[1]);
+          state->a = state->memory[addr];
+          state->pc +=2;
+        } NEXT;
+    OPCODE(0x3b) // DCX SP
+        {
+          state->sp = (state->sp) - 1;
+        } NEXT;
+    OPCODE(0x3c) // INR A
+        {
+          state->a = Increment(state, state->a);
+        } NEXT;
+    OPCODE(0x3d) // DCR A
+        {
+          state->a = Decrement(state, state->a);
+        } NEXT;
+    OPCODE(0x3e) // MVI A,D8
+        {
+          state->a = opcode[1];
+          state->pc++;
+        } NEXT;
+    OPCODE(0x3f) // CMC
+        {
+          state->cc.cy = ~(state->cc.cy); // Complement carry
+        } NEXT;
+    OPCODE(0x40) // MOV B,B
+        {
+          state->b = state->b;
+        } NEXT;
+    OPCODE(0x41) // MOV B,C
+        {
+          state->b = state->c;
+        } NEXT;
+    OPCODE(0x42) // MOV B,D
+        {
+          state->b = state->d;
+        } NEXT;
+    OPCODE(0x43) // MOV B,E
+        {
+          state->b = state->e;
+        } NEXT;
+    OPCODE(0x44) // MOV B,H
+        {
+          state->b = state->h;
+        } NEXT;
+    OPCODE(0x45) // MOV B,L
+        {
+          state->b = state->l;
+        } NEXT;
+    OPCODE(0x46) // MOV B,M
+        {
+          uint16_t addr = ((state->h) << 8)|(state->l);
+          state->b = state->memory[addr];
+        } NEXT;
+    OPCODE(0x47) // MOV B,A
+        {
+          state->b = state->a;
+        } NEXT;
+    OPCODE(0x48) // MOV C,B
+        {
+          state->c = state->b;
+        } NEXT;
+    OPCODE(0x49) // MOV C,C
+        {
+          state->c = state->c;
+        } NEXT;
+    OPCODE(0x4a) // MOV C,D
+        {
+          state->c = state->d;
+        } NEXT;
+    OPCODE(0x4b) // MOV C,E
+        {
+          state->c = state->e;
+        } NEXT;
+    OPCODE(0x4c) // MOV C,H
+        {
+          state->c = state->h;
+        } NEXT;
+    OPCODE(0x4d) // MOV C,L
+        {
+          state->c = state->l;
+        } NEXT;
+    OPCODE(0x4e) // MOV C,M
+        {
+          uint16_t addr = ((state->h) << 8)|(state->l);
+          state->c = state->memory[addr];
+        } NEXT;
+    OPCODE(0x4f) // MOV C,A
+        {
+          state->c = state->a;
+        } NEXT;
+    OPCODE(0x50) // MOV D,B
+        {
+          state->d = state->b;
+        } NEXT;
+    OPCODE(0x51) // MOV D,C
+        {
+          state->d = state->c;
+        } NEXT;
+    OPCODE(0x52) // MOV D,D
+        {
+          state->d = state->d;
+        } NEXT;
+    OPCODE(0x53) // MOV D,E
+        {
+          state->d = state->e;
+        } NEXT;
+    OPCODE(0x54) // MOV D,H
+        {
+          state->d = state->h;
+        } NEXT;
+    OPCODE(0x55) // MOV D,L
+        {
+          state->d = state->l;
+        } NEXT;
+    OPCODE(0x56) // MOV D,M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          state->d = state->memory[addr];
+        } NEXT;
+    OPCODE(0x57) // MOV D,A
+        {
+          state->d = state->a;
+        } NEXT;
+    OPCODE(0x58) // MOV E,B
+        {
+          state->e = state->b;
+        } NEXT;
+    OPCODE(0x59) // MOV E,C
+        {
+          state->e = state->c;
+        } NEXT;
+    OPCODE(0x5a) // MOV E,D
+        {
+          state->e = state->d;
+        } NEXT;
+    OPCODE(0x5b) // MOV E,E
+        {
+          state->e = state->e;
+        } NEXT;
+    OPCODE(0x5c) // MOV E,H
+        {
+          state->e = state->h;
+        } NEXT;
+    OPCODE(0x5d) // MOV E,L
+        {
+          state->e = state->l;
+        } NEXT;
+    OPCODE(0x5e) // MOV E,M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          state->e = state->memory[addr];
+        } NEXT;
+    OPCODE(0x5f) // MOV E,A
+        {
+          state->e = state->a;
+        } NEXT;
+    OPCODE(0x60) // MOV H,B
+        {
+          state->h = state->b;
+        } NEXT;
+    OPCODE(0x61) // MOV H,C
+        {
+          state->h = state->c;
+        } NEXT;
+    OPCODE(0x62) // MOV H,D
+        {
+          state->h = state->d;
+        } NEXT;
+    OPCODE(0x63) // MOV H,E
+        {
+          state->h = state->e;
+        } NEXT;
+    OPCODE(0x64) // MOV H,H
+        {
+          state->h = state->h;
+        } NEXT;
+    OPCODE(0x65) // MOV H,L
+        {
+          state->h = state->l;
+        } NEXT;
+    OPCODE(0x66) // MOV H,M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          state->h = state->memory[addr];
+        } NEXT;
+    OPCODE(0x67) // MOV H,A
+        {
+          state->h = state->a;
+        } NEXT;
+    OPCODE(0x68) // MOV L,B
+        {
+          state->l = state->b;
+        } NEXT;
+    OPCODE(0x69)  // MOV L,C
+        {
+          state->l = state->c;
+        } NEXT;
+    OPCODE(0x6a) // MOV L,D
+        {
+          state->l = state->d;
+        } NEXT;
+    OPCODE(0x6b) // MOV L,E
+        {
+          state->l = state->e;
+        } NEXT;
+    OPCODE(0x6c) // MOV L,H
+        {
+          state->l = state->h;
+        } NEXT;
+    OPCODE(0x6d) // MOV L,L
+        {
+          state->l = state->l;
+        } NEXT;
+    OPCODE(0x6e) // MOV L,M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          state->l = state->memory[addr];
+        } NEXT;
+    OPCODE(0x6f) // MOV L,A
+        {
+          state->l = state->a;
+        } NEXT;
+    OPCODE(0x70) // MOV M,B
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, state->b);
+        } NEXT;
+    OPCODE(0x71) // MOV M,C
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, state->c);
+        } NEXT;
+    OPCODE(0x72) // MOV M,D
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, state->d);
+        } NEXT;
+    OPCODE(0x73) // MOV M,E
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, state->e);
+        } NEXT;
+    OPCODE(0x74) // MOV M,H
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, state->h);
+        } NEXT;
+    OPCODE(0x75) // MOV M,L
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, state->l);
+        } NEXT;
+    OPCODE(0x76) // HLT
+        {
+          state->halted = 1; // The registers and flag are unaffected
+          executed++;
+          if (trace != NULL) {
+            state->cycles = cycles;
+            trace(state, pc);
+          }
+          goto done;
+        }
+    OPCODE(0x77) // MOV M,A
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          WRITE(addr, state->a);
+        } NEXT;
+    OPCODE(0x78) // MOV A,B
+        {
+          state->a = state->b;
+        } NEXT;
+    OPCODE(0x79) // MOV A,C
+        {
+          state->a = state->c;
+        } NEXT;
+    OPCODE(0x7a) // MOV A,D
+        {
+          state->a = state->d;
+        } NEXT;
+    OPCODE(0x7b) // MOV A,E
+        {
+          state->a = state->e;
+        } NEXT;
+    OPCODE(0x7c) // MOV A,H
+        {
+          state->a = state->h;
+        } NEXT;
+    OPCODE(0x7d) // MOV A,L
+        {
+          state->a = state->l;
+        } NEXT;
+    OPCODE(0x7e) // MOV A,M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          state->a = state->memory[addr];
+        } NEXT;
+    OPCODE(0x7f) // MOV A,A
+        {
+          state->a = state->a;
+        } NEXT;
+    OPCODE(0x80) // ADD B
+        {
+          Add(state, state->b, 0);
+        } NEXT;
+    OPCODE(0x81) // ADD C
+        {
+          Add(state, state->c, 0);
+        } NEXT;
+    OPCODE(0x82) // ADD D
+        {
+          Add(state, state->d, 0);
+        } NEXT;
+    OPCODE(0x83) // ADD E
+        {
+          Add(state, state->e, 0);
+        } NEXT;
+    OPCODE(0x84) // ADD H
+        {
+          Add(state, state->h, 0);
+        } NEXT;
+    OPCODE(0x85) // ADD L
+        {
+          Add(state, state->l, 0);
+        } NEXT;
+    OPCODE(0x86) // ADD M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          Add(state, state->memory[addr], 0);
+        } NEXT;
+    OPCODE(0x87) // ADD A
+        {
+          Add(state, state->a, 0);
+        } NEXT;
+    OPCODE(0x88) // ADC B
+        {
+          Add(state, state->b, state->cc.cy);
+        } NEXT;
+    OPCODE(0x89) // ADC C
+        {
+          Add(state, state->c, state->cc.cy);
+        } NEXT;
+    OPCODE(0x8a) // ADC D
+        {
+          Add(state, state->d, state->cc.cy);
+        } NEXT;
+    OPCODE(0x8b) // ADC E
+        {
+          Add(state, state->e, state->cc.cy);
+        } NEXT;
+    OPCODE(0x8c) // ADC H
+        {
+          Add(state, state->h, state->cc.cy);
+        } NEXT;
+    OPCODE(0x8d) // ADC L
+        {
+          Add(state, state->l, state->cc.cy);
+        } NEXT;
+    OPCODE(0x8e) // ADC M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          Add(state, state->memory[addr], state->cc.cy);
+        } NEXT;
+    OPCODE(0x8f) // ADC A
+        {
+          Add(state, state->a, state->cc.cy);
+        } NEXT;
+    OPCODE(0x90) // SUB B
+        {
+          state->a = Subtract(state, state->b, 0);
+        } NEXT;
+    OPCODE(0x91) // SUB C
+        {
+          state->a = Subtract(state, state->c, 0);
+        } NEXT;
+    OPCODE(0x92) // SUB D
+        {
+          state->a = Subtract(state, state->d, 0);
+        } NEXT;
+    OPCODE(0x93) // SUB E
+        {
+          state->a = Subtract(state, state->e, 0);
+        } NEXT;
+    OPCODE(0x94) // SUB H
+        {
+          state->a = Subtract(state, state->h, 0);
+        } NEXT;
+    OPCODE(0x95) // SUB L
+        {
+          state->a = Subtract(state, state->l, 0);
+        } NEXT;
+    OPCODE(0x96) // SUB M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          state->a = Subtract(state, state->memory[addr], 0);
+        } NEXT;
+    OPCODE(0x97) // SUB A
+        {
+          state->a = Subtract(state, state->a, 0);
+        } NEXT;
+    OPCODE(0x98) // SBB B
+        {
+          state->a = Subtract(state, state->b, state->cc.cy);
+        } NEXT;
+    OPCODE(0x99) // SBB C
+        {
+          state->a = Subtract(state, state->c, state->cc.cy);
+        } NEXT;
+    OPCODE(0x9a) // SBB D
+        {
+          state->a = Subtract(state, state->d, state->cc.cy);
+        } NEXT;
+    OPCODE(0x9b) // SBB E
+        {
+          state->a = Subtract(state, state->e, state->cc.cy);
+        } NEXT;
+    OPCODE(0x9c) // SBB H
+        {
+          state->a = Subtract(state, state->h, state->cc.cy);
+        } NEXT;
+    OPCODE(0x9d) // SBB L
+        {
+          state->a = Subtract(state, state->l, state->cc.cy);
+        } NEXT;
+    OPCODE(0x9e) // SBB M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          state->a = Subtract(state, state->memory[addr], state->cc.cy);
+        } NEXT;
+    OPCODE(0x9f) // SBB A
+        {
+          state->a = Subtract(state, state->a, state->cc.cy);
+        } NEXT;
+    OPCODE(0xa0) // ANA B
+        {
+          And(state, state->b);
+        } NEXT;
+    OPCODE(0xa1) // ANA C
+        {
+          And(state, state->c);
+        } NEXT;
+    OPCODE(0xa2) // ANA D
+        {
+          And(state, state->d);
+        } NEXT;
+    OPCODE(0xa3) // ANA E
+        {
+          And(state, state->e);
+        } NEXT;
+    OPCODE(0xa4) // ANA H
+        {
+          And(state, state->h);
+        } NEXT;
+    OPCODE(0xa5) // ANA L
+        {
+          And(state, state->l);
+        } NEXT;
+    OPCODE(0xa6) // ANA M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          And(state, state->memory[addr]);
+        } NEXT;
+    OPCODE(0xa7) // ANA A
+        {
+          And(state, state->a);
+        } NEXT;
+    OPCODE(0xa8) // XRA B
+        {
+          Xor(state, state->b);
+        } NEXT;
+    OPCODE(0xa9) // XRA C
+        {
+          Xor(state, state->c);
+        } NEXT;
+    OPCODE(0xaa) // XRA D
+        {
+          Xor(state, state->d);
+        } NEXT;
+    OPCODE(0xab) // XRA E
+        {
+          Xor(state, state->e);
+        } NEXT;
+    OPCODE(0xac) // XRA H
+        {
+          Xor(state, state->h);
+        } NEXT;
+    OPCODE(0xad) // XRA L
+        {
+          Xor(state, state->l);
+        } NEXT;
+    OPCODE(0xae) // XRA M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          Xor(state, state->memory[addr]);
+        } NEXT;
+    OPCODE(0xaf) // XRA A
+        {
+          Xor(state, state->a);
+        } NEXT;
+    OPCODE(0xb0) // ORA B
+        {
+          Or(state, state->b);
+        } NEXT;
+    OPCODE(0xb1) // ORA C
+        {
+          Or(state, state->c);
+        } NEXT;
+    OPCODE(0xb2) // ORA D
+        {
+          Or(state, state->d);
+        } NEXT;
+    OPCODE(0xb3) // ORA E
+        {
+          Or(state, state->e);
+        } NEXT;
+    OPCODE(0xb4) // ORA H
+        {
+          Or(state, state->h);
+        } NEXT;
+    OPCODE(0xb5) // ORA L
+        {
+          Or(state, state->l);
+        } NEXT;
+    OPCODE(0xb6) // ORA M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          Or(state, state->memory[addr]);
+        } NEXT;
+    OPCODE(0xb7) // ORA A
+        {
+          Or(state, state->a);
+        } NEXT;
+    OPCODE(0xb8) // CMP B
+        {
+          Subtract(state, state->b, 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xb9) // CMP C
+        {
+          Subtract(state, state->c, 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xba) // CMP D
+        {
+          Subtract(state, state->d, 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xbb) // CMP E
+        {
+          Subtract(state, state->e, 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xbc) // CMP H
+        {
+          Subtract(state, state->h, 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xbd) // CMP L
+        {
+          Subtract(state, state->l, 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xbe) // CMP M
+        {
+          uint16_t addr = ((state->h) << 8) | (state->l);
+          Subtract(state, state->memory[addr], 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xbf) // CMP A
+        {
+          Subtract(state, state->a, 0); // Only flags are affected
+        } NEXT;
+    OPCODE(0xc0) // RNZ
+        {
+          if(state->cc.z == 0){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xc1) // POP B
+        {
+          state->c = state->memory[state->sp];
+          state->b = state->memory[(uint16_t)(state->sp+1)];
+          state->sp += 2;
+        } NEXT;
+    OPCODE(0xc2) // JNZ addr
+        {
+          if(state->cc.z == 0){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xc3) // JMP addr
+        {
+          state->pc = (opcode[2]<<8) | opcode[1];
+        } NEXT;
+    OPCODE(0xc4) // CNZ addr
+        {
+          if (state->cc.z == 0) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xc5) // PUSH B
+        {
+          WRITE(state->sp-1, state->b);
+          WRITE(state->sp-2, state->c);
+          state->sp = state->sp - 2;
+        } NEXT;
+    OPCODE(0xc6) // ADI D8
+        {
+          Add(state, opcode[1], 0);
+          state->pc++;
+        } NEXT;
+    OPCODE(0xc7) // RST 0
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 0;
+        } NEXT;
+    OPCODE(0xc8) // RZ
+        {
+          if(state->cc.z == 1){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xc9) // RET
+        {
+          state->pc = state->memory[state->sp] |
+                          (state->memory[(uint16_t)(state->sp+1)]<<8);
+          state->sp += 2;
+        } NEXT;
+    OPCODE(0xca) // JZ addr
+        {
+          if(state->cc.z == 1){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xcb) NEXT; // NOP
+    OPCODE(0xcc) // CZ addr
+        {
+          if (state->cc.z == 1) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xcd) // CALL addr
+        {
+          uint16_t ret = state->pc+2;
+          uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+          WRITE(state->sp-1, (ret>>8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = target;
+        } NEXT;
+    OPCODE(0xce) // ACI D8
+        {
+          Add(state, opcode[1], state->cc.cy);
+          state->pc++;
+        } NEXT;
+    OPCODE(0xcf) // RST 1
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 1;
+        } NEXT;
+    OPCODE(0xd0) // RNC
+        {
+          if(state->cc.cy == 0){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xd1) // POP D
+        {
+          state->e = state->memory[state->sp];
+          state->d = state->memory[(uint16_t)(state->sp+1)];
+          state->sp += 2;
+        } NEXT;
+    OPCODE(0xd2) // JNC addr
+        {
+          if(state->cc.cy == 0){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xd3) // OUT D8
+        {
+          state->cycles = cycles; // Timestamp seen by the device
+          WritePort(state, opcode[1], state->a);
+          state->pc++;
+          if (state->error != I8080_OK) {
+            LEAVE(); // A device stopped the machine
+          }
+        } NEXT;
+    OPCODE(0xd4) // CNC addr
+        {
+          if (state->cc.cy == 0) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xd5) // PUSH D
+        {
+          WRITE(state->sp-1, state->d);
+          WRITE(state->sp-2, state->e);
+          state->sp = state->sp - 2;
+        } NEXT;
+    OPCODE(0xd6) // SUI D8
+        {
+          state->a = Subtract(state, opcode[1], 0);
+          state->pc++;
+        } NEXT;
+    OPCODE(0xd7) // RST 2
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 2;
+        } NEXT;
+    OPCODE(0xd8) // RC
+        {
+          if(state->cc.cy == 1){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xd9) NEXT; // NOP
+    OPCODE(0xda) // JC addr
+        {
+          if(state->cc.cy == 1){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xdb) // IN D8
+        {
+          state->cycles = cycles; // Timestamp seen by the device
+          state->a = ReadPort(state, opcode[1]);
+          state->pc++;
+          if (state->error != I8080_OK) {
+            LEAVE(); // A device stopped the machine
+          }
+        } NEXT;
+    OPCODE(0xdc) // CC addr
+        {
+          if (state->cc.cy == 1) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xdd) NEXT; // NOP
+    OPCODE(0xde) // SBI D8
+        {
+          state->a = Subtract(state, opcode[1], state->cc.cy);
+          state->pc++;
+        } NEXT;
+    OPCODE(0xdf) // RST 3
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 3;
+        } NEXT;
+    OPCODE(0xe0) // RPO
+        {
+          if(state->cc.p == 0){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xe1) // POP H
+        {
+          state->l = state->memory[state->sp];
+          state->h = state->memory[(uint16_t)(state->sp+1)];
+          state->sp += 2;
+        } NEXT;
+    OPCODE(0xe2) // JPO addr
+        {
+          if(state->cc.p == 0){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xe3) // XTHL
+        {
+          uint8_t temp_low = state->l;
+          uint8_t temp_high = state->h;
+          state->l = state->memory[state->sp];
+          WRITE(state->sp, temp_low);
+          state->h = state->memory[(uint16_t)(state->sp+1)];
+          WRITE(state->sp+1, temp_high);
+        } NEXT;
+    OPCODE(0xe4) // CPO addr
+        {
+          if (state->cc.p == 0) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xe5) // PUSH H
+        {
+          WRITE(state->sp-1, state->h);
+          WRITE(state->sp-2, state->l);
+          state->sp = state->sp - 2;
+        } NEXT;
+    OPCODE(0xe6) // ANI D8
+        {
+          And(state, opcode[1]);
+          state->pc++;
+        } NEXT;
+    OPCODE(0xe7) // RST 4
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 4;
+        } NEXT;
+    OPCODE(0xe8) // RPE
+        {
+          if(state->cc.p == 1){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xe9) // PCHL
+        {
+          state->pc = (state->l) | ((state->h) << 8);
+        } NEXT;
+    OPCODE(0xea) // JPO addr
+        {
+          if(state->cc.p == 1){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xeb) // XCHG
+        {
+          uint8_t rh_temp = state->h; // Temp for higher register
+          uint8_t rl_temp = state->l; // Temp for lower register
+          state->h = state->d; // Swap H for D
+          state->d = rh_temp;
+          state->l = state->e; // Swap L for E
+          state->e = rl_temp;
+        } NEXT;
+    OPCODE(0xec) // CPE addr
+        {
+          if (state->cc.p == 1) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xed) NEXT; // NOP
+    OPCODE(0xee) // XRI D8
+        {
+          Xor(state, opcode[1]);
+          state->pc++;
+        } NEXT;
+    OPCODE(0xef) // RST 5
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 5;
+        } NEXT;
+    OPCODE(0xf0) // RP
+        {
+          if(state->cc.s == 0){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xf1) // POP PSW
+        {
+          state->cc.psw = state->memory[state->sp] & 0xd5;
+          state->a = state->memory[(uint16_t)(state->sp+1)];
+          state->sp += 2;
+        } NEXT;
+    OPCODE(0xf2) // JP addr
+        {
+          if(state->cc.s == 0){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xf3) // DI
+        {
+          state->int_enable = 0; // Double check
+        } NEXT;
+    OPCODE(0xf4) // CP addr
+        {
+          if (state->cc.s == 0) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xf5) // PUSH PSW
+        {
+          WRITE(state->sp-1, state->a);
+          WRITE(state->sp-2, state->cc.psw | 0x02);
+          state->sp = state->sp - 2;
+        } NEXT;
+    OPCODE(0xf6) // ORI D8
+        {
+          Or(state, opcode[1]);
+          state->pc++;
+        } NEXT;
+    OPCODE(0xf7) // RST 6
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 6;
+        } NEXT;
+    OPCODE(0xf8) // RM
+        {
+          if(state->cc.s == 1){
+            cycles += 6; // Condition met
+            state->pc = state->memory[state->sp] |
+                            (state->memory[(uint16_t)(state->sp+1)]<<8);
+            state->sp += 2;
+          }
+        } NEXT;
+    OPCODE(0xf9) // SPHL
+        {
+          state->sp = ((state->h) << 8) | (state->l);
+        } NEXT;
+    OPCODE(0xfa) // JM addr
+        {
+          if(state->cc.s == 1){
+            state->pc = (opcode[2] << 8) | opcode[1];
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xfb) // EI
+        {
+          state->int_enable = 1;
+          state->ei_cycles = cycles;
+          if (state->irq != 0) {
+            LEAVE(); // Let Run take the request after one instruction
+          }
+        } NEXT;
+    OPCODE(0xfc) // CM addr
+        {
+          if (state->cc.s == 1) {
+            cycles += 6; // Condition met
+            uint16_t ret = state->pc+2;
+            uint16_t target = (opcode[2]<<8) | opcode[1]; // Read before the push
+            WRITE(state->sp-1, (ret>>8) & 0xff);
+            WRITE(state->sp-2, (ret & 0xff));
+            state->sp = state->sp - 2;
+            state->pc = target;
+          }
+          else {
+            state->pc += 2;
+          }
+        } NEXT;
+    OPCODE(0xfd) NEXT; // NOP
+    OPCODE(0xfe) // CPI D8
+        {
+          Subtract(state, opcode[1], 0); // Only flags are affected
+          state->pc++;
+        } NEXT;
+    OPCODE(0xff) // RST 7
+        {
+          uint16_t ret = state->pc;
+          WRITE(state->sp-1, (ret >> 8) & 0xff);
+          WRITE(state->sp-2, (ret & 0xff));
+          state->sp = state->sp - 2;
+          state->pc = 8 * 7;
+        } NEXT;
+#ifdef THREADED_DISPATCH
+  }
+#else
+    }
+
+    if (trace != NULL) {
+      state->cycles = cycles;
+      trace(state, pc);
+    }
+    executed++;
+  }
+#endif
+
+done:
+  state->cycles = cycles;
+#ifdef BLOCK_CACHE
+  cache->hits += hits;
+#endif
+  return executed;
+  #undef FETCH
+  #undef HANDLER
+  #undef HANDLERS
+  #undef WRITE
+  #undef LEAVE
+  #undef OPCODE
+  #undef NEXT
+}
+
+/*
+ * Function: Interrupt
+ * -------------------
+ *  Raises an interrupt request now, the processor takes it as RST vector
+ *  once interrupts are enabled. A newer request replaces a waiting one
+ *  Raised from a port handler, it's seen when the core next stops(a
+ *  scheduled interrupt or the end of the run)
+ *
+ *  state: state of Intel8080 machine
+ *  vector: RST number(0-7)
+ *
+ *  returns: void
+ */
+void Interrupt(States *state, uint8_t vector)
+{
+  state->irq = (vector & 7) + 1;
+}
+
+/*
+ * Function: ScheduleInterrupt
+ * ---------------------------
+ *  Raises an interrupt request when the cycle counter reaches cycles,
+ *  then every period cycles if period isn't 0. The cores stop at the
+ *  earliest scheduled cycle as they stop at a cycle limit, so waiting
+ *  interrupts cost nothing per instruction(one check per JIT block)
+ *
+ *  state: state of Intel8080 machine
+ *  cycles: cycle counter at which the request is raised
+ *  period: cycles between requests, 0 to raise it once
+ *  vector: RST number(0-7)
+ *
+ *  returns: I8080_OK or I8080_ERROR_SIZE if I8080_SCHEDULED interrupts
+ *           are already waiting
+ */
+int ScheduleInterrupt(States *state, uint64_t cycles, uint32_t period,
+                      uint8_t vector)
+{
+  int i = state->nscheduled;
+
+  if (i == I8080_SCHEDULED) {
+    return I8080_ERROR_SIZE;
+  }
+  // Insert after the interrupts due at the same cycle or earlier
+  while (i > 0 && state->scheduled[i - 1].cycles > cycles) {
+    state->scheduled[i] = state->scheduled[i - 1];
+    i--;
+  }
+  state->scheduled[i].cycles = cycles;
+  state->scheduled[i].period = period;
+  state->scheduled[i].vector = vector & 7;
+  state->nscheduled++;
+
+  return I8080_OK;
+}
+
+/*
+ * Function: RaiseScheduled
+ * ------------------------
+ *  Raises the scheduled interrupts the cycle counter has reached and
+ *  schedules the periodic ones again
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: void
+ */
+static void RaiseScheduled(States *state)
+{
+  while (state->nscheduled > 0 &&
+         state->scheduled[0].cycles <= state->cycles) {
+    ScheduledInterrupt due = state->scheduled[0];
+
+    state->nscheduled--;
+    memmove(&state->scheduled[0], &state->scheduled[1],
+            sizeof(ScheduledInterrupt) * state->nscheduled);
+    state->irq = due.vector + 1;
+    if (due.period != 0) {
+      ScheduleInterrupt(state, due.cycles + due.period, due.period,
+                        due.vector);
+    }
+  }
+}
+
+/*
+ * Function: Deliver
+ * -----------------
+ *  Takes the raised request: a halted processor wakes up, interrupts are
+ *  disabled and RST vector runs(pushes PC and jumps to vector * 8)
+ *  A request the replayed log doesn't have stays raised, untaken
+ *
+ *  state: state of Intel8080 machine
+ *
+ *  returns: void
+ */
+static void Deliver(States *state)
+{
+  uint8_t vector = state->irq - 1;
+
+  if (LogInterrupt(state, vector) != I8080_OK) {
+    return;
+  }
+  state->irq = 0;
+  state->int_enable = 0;
+  state->halted = 0;
+  WriteMemory(state, state->sp - 1, state->pc >> 8);
+  WriteMemory(state, state->sp - 2, state->pc & 0xff);
+  state->sp -= 2;
+  state->pc = vector * 8;
+  state->cycles += 11; // Cycles of RST
+}
+
+/*
+ * Function: Run
+ * -------------
+ *  Runs the fastest core attached to the machine, stopping at every
+ *  scheduled interrupt to raise it and delivering the requests the
+ *  processor accepts. A halted processor with interrupts enabled idles
+ *  until the next scheduled interrupt
+ *
+ *  state: pointer to current state of machine
+ *  count: maximum number of instructions to execute
+ *  cycle_limit: value of the cycle counter to stop at
+ *
+ *  returns: number of instructions executed
+ */
+static uint64_t Run(States *state, uint64_t count, uint64_t cycle_limit)
+{
+  uint64_t executed = 0;
+
+  while (executed < count && state->error == I8080_OK) {
+    RaiseScheduled(state);
+    if (state->irq != 0 && state->int_enable) {
+      if (state->cycles != state->ei_cycles) {
+        Deliver(state);
+        continue;
+      }
+      if (state->cycles >= cycle_limit) {
+        break;
+      }
+      executed += Execute(state, 1, cycle_limit); // EI waits one instruction
+      state->ei_cycles = UINT64_MAX;
+      continue;
+    }
+    if (state->cycles >= cycle_limit) {
+      break;
+    }
+
+    uint64_t limit = cycle_limit;
+    if (state->nscheduled > 0 && state->scheduled[0].cycles < limit) {
+      limit = state->scheduled[0].cycles;
+    }
+    if (state->halted) {
+      if (!state->int_enable || limit == cycle_limit) {
+        break; // Nothing wakes it up before the limit
+      }
+      state->cycles = limit;
+      continue;
+    }
+
+#ifdef JIT
+    if (state->jit != NULL && state->trace == NULL) {
+      executed += ExecuteTranslated(state, count - executed, limit);
+      continue;
+    }
+#endif
+    executed += Execute(state, count - executed, limit);
+  }
+
+  return executed;
+}
+
+/*
+ * Function: Emulator
+ * --------------------
+ *  Emulates instructions until count instructions have been executed
+ *  or the processor halts, delivering interrupts on the way
+ *
+ *  state: pointer to current state of machine
+ *  count: maximum number of instructions to execute
+ *
+ *  returns: number of instructions executed
+ */
+uint64_t Emulator(States *state, uint64_t count)
+{
+  return Run(state, count, UINT64_MAX);
+}
+
+/*
+ * Function: EmulateCycles
+ * -----------------------
+ *  Emulates instructions until a budget of clock cycles is used up,
+ *  delivering interrupts on the way
+ *  The last instruction may run past the budget, a halted processor
+ *  idles for the rest of it
+ *
+ *  state: pointer to current state of machine
+ *  budget: number of clock cycles(T-states) to run
+ *
+ *  returns: number of cycles executed past the budget(overshoot)
+ */
+uint32_t EmulateCycles(States *state, uint32_t budget)
+{
+  uint64_t target = state->cycles + budget;
+
+  Run(state, UINT64_MAX, target);
+  if (state->cycles < target) {
+    state->cycles = target; // Halted
+  }
+
+  return state->cycles - target;
+}
+
+/*
+ * Function: Disassemble
+ * ---------------------
+ *  Writes an instruction as 8080 assembly, like "MVI B,$3f" or
+ *  "JMP $18d4", undocumented opcodes are written as data("DB $08")
+ *  Operands past the end of memory wrap around to address 0
+ *
+ *  memory: 64 KB of the machine
+ *  pc: address of the instruction
+ *  text: I8080_TEXT_SIZE bytes receiving the text
+ *
+ *  returns: size in bytes of the instruction
+ */
+int Disassemble(const uint8_t *memory, uint16_t pc, char *text)
+{
+  static const char hex[16] = "0123456789abcdef";
+  const Opcode *opcode = &Opcodes[memory[pc]];
+  const char *mnemonic = opcode->mnemonic;
+  uint16_t value = memory[pc];
+  int digits = 2;
+
+  if (mnemonic == NULL) {
+    mnemonic = "DB ";
+  }
+  else if (opcode->operand == I8080_OPERAND_BYTE) {
+    value = memory[(uint16_t)(pc + 1)];
+  }
+  else if (opcode->operand == I8080_OPERAND_WORD) {
+    value = memory[(uint16_t)(pc + 1)] | memory[(uint16_t)(pc + 2)] << 8;
+    digits = 4;
+  }
+  else {
+    digits = 0;
+  }
+
+  while (*mnemonic != '\0') {
+    *text++ = *mnemonic++;
+  }
+  if (digits > 0) {
+    *text++ = '$';
+    for (int i = digits - 1; i >= 0; i--) {
+      *text++ = hex[(value >> (i * 4)) & 0xf];
+    }
+  }
+  *text = '\0';
+
+  return opcode->length;
+}
+
+/*
+ * Function: Assemble
+ * ------------------
+ *  Assembles 8080 source into memory, the opcodes taken from the same
+ *  table Disassemble writes from, so listings assemble back into the
+ *  bytes they came from
+ *  A line is [address] [label:] [instruction or directive] [; comment].
+ *  The address column of a listing("0100 MVI A,$3f") must match where
+ *  the line goes. Directives are ORG, EQU(name EQU value), DB(values
+ *  and 'strings' or "strings", a quote inside doubled), DW, DS(skips
+ *  bytes) and END. The values of ORG, DS and EQU can only use symbols
+ *  defined above them. Values are sums and differences of numbers($ff,
+ *  0xff, 0ffh, 255, 'c' or "c"), symbols and $, the address of the
+ *  line. Mnemonics and registers are case insensitive, symbols aren't
+ *
+ *  source: text, lines ended by newlines
+ *  memory: 64 KB receiving the code, bytes not assembled are left alone
+ *  low: receives the lowest address written
+ *  high: receives the highest address written + 1(low when none)
+ *  line: receives the line of the error, 0 on success
+ *
+ *  returns: I8080_OK, I8080_ERROR_SYNTAX, I8080_ERROR_SIZE(past 64 KB)
+ *           or I8080_ERROR_MEMORY
+ */
+int Assemble(const char *source, uint8_t *memory, uint32_t *low,
+             uint32_t *high, int *line)
+{
+  Assembler as;
+  char buffer[ASSEMBLER_LINE];
+  int number = 0;
+
+  memset(&as, 0, sizeof(Assembler));
+  as.memory = memory;
+  as.low = 0x10000;
+  as.size = ASSEMBLER_SYMBOLS;
+  as.symbols = calloc(as.size, sizeof(AsmSymbol));
+  if (as.symbols == NULL) {
+    as.error = I8080_ERROR_MEMORY;
+  }
+
+  for (as.pass = 1; as.pass <= 2 && as.error == I8080_OK; as.pass++) {
+    const char *text = source;
+    as.pc = 0;
+    as.done = 0;
+    number = 0;
+
+    while (*text != '\0' && !as.done && as.error == I8080_OK) {
+      size_t length = strcspn(text, "\n");
+      number++;
+      if (length >= ASSEMBLER_LINE) {
+        as.error = I8080_ERROR_SYNTAX;
+        break;
+      }
+      memcpy(buffer, text, length);
+      buffer[length] = '\0';
+      text += length + (text[length] == '\n');
+
+      AssembleLine(&as, buffer);
+    }
+  }
+
+  *line = as.error == I8080_OK ? 0 : number;
+  *low = as.low <= 0xffff ? as.low : 0;
+  *high = as.low <= 0xffff ? as.high : 0;
+  free(as.symbols);
+
+  return as.error;
+}
+
+/*
+ * Function: FindSymbol
+ * --------------------
+ *  Looks a symbol up in the hash table(FNV-1a, linear probing)
+ *
+ *  as: assembler
+ *  name: symbol
+ *
+ *  returns: its slot, or the free slot where it would go
+ */
+static AsmSymbol *FindSymbol(Assembler *as, const char *name)
+{
+  uint32_t hash = 2166136261u;
+
+  for (const char *p = name; *p != '\0'; p++) {
+    hash = (hash ^ (uint8_t)*p) * 16777619u;
+  }
+  for (uint32_t i = hash & (as->size - 1); ; i = (i + 1) & (as->size - 1)) {
+    AsmSymbol *symbol = &as->symbols[i];
+    if (symbol->name[0] == '\0' || strcmp(symbol->name, name) == 0) {
+      return symbol;
+    }
+  }
+}
+
+/*
+ * Function: DefineSymbol
+ * ----------------------
+ *  Gives a symbol its value. The first pass rejects symbols defined
+ *  twice, the second only updates values known by then(EQU)
+ *
+ *  as: assembler
+ *  name: symbol
+ *  value: its value
+ *
+ *  returns: void
+ */
+static void DefineSymbol(Assembler *as, const char *name, uint16_t value)
+{
+  AsmSymbol *symbol = FindSymbol(as, name);
+
+  if (symbol->name[0] != '\0') {
+    if (as->pass == 1) {
+      as->error = I8080_ERROR_SYNTAX;
+    }
+    symbol->value = value;
+    return;
+  }
+
+  /* Grow the table when half full, then insert */
+  if ((as->count + 1) * 2 > as->size) {
+    AsmSymbol *old = as->symbols;
+    uint32_t size = as->size;
+    as->symbols = calloc(size * 2, sizeof(AsmSymbol));
+    if (as->symbols == NULL) {
+      as->symbols = old;
+      as->error = I8080_ERROR_MEMORY;
+      return;
+    }
+    as->size = size * 2;
+    for (uint32_t i = 0; i < size; i++) {
+      if (old[i].name[0] != '\0') {
+        *FindSymbol(as, old[i].name) = old[i];
+      }
+    }
+    free(old);
+    symbol = FindSymbol(as, name);
+  }
+  strcpy(symbol->name, name);
+  symbol->value = value;
+  as->count++;
+}
+
+/*
+ * Function: Evaluate
+ * ------------------
+ *  Evaluates a value: terms added or subtracted, each a number, a
+ *  character constant, a symbol or $. Symbols not defined yet read 0
+ *  in the first pass and set as->undefined
+ *
+ *  as: assembler
+ *  text: the value, without surrounding blanks
+ *  value: receives the value
+ *
+ *  returns: 0 on success, -1 if it isn't a value
+ */
+static int Evaluate(Assembler *as, const char *text, int32_t *value)
+{
+  const char *p = text;
+  int32_t sum = 0;
+  int sign = 1;
+
+  for (;;) {
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '-' || *p == '+') {
+      sign = *p++ == '-' ? -sign : sign;
+      continue;
+    }
+
+    int32_t term = 0;
+    if (*p == '$' && !isxdigit((uint8_t)p[1])) { // Address of the line
+      term = as->pc;
+      p++;
+    }
+    else if ((*p == '\'' || *p == '"') && p[1] == *p && p[2] == *p &&
+             p[3] == *p) { // The quote itself, doubled
+      term = (uint8_t)*p;
+      p += 4;
+    }
+    else if ((*p == '\'' || *p == '"') && p[1] != '\0' && p[2] == *p) {
+      term = (uint8_t)p[1];
+      p += 3;
+    }
+    else if (*p == '$' || isdigit((uint8_t)*p)) {
+      int base = 10;
+      const char *start = p;
+      if (*p == '$') {
+        base = 16;
+        start = p + 1;
+      }
+      else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        start = p + 2;
+      }
+      const char *end = start;
+      while (isalnum((uint8_t)*end)) {
+        end++;
+      }
+      const char *stop = end;
+      if (base == 10 && (end[-1] == 'h' || end[-1] == 'H')) {
+        base = 16; // 0ffh
+        stop = end - 1;
+      }
+      if (stop == start) {
+        return -1;
+      }
+      for (const char *d = start; d < stop; d++) {
+        int digit = isdigit((uint8_t)*d) ? *d - '0' :
+                    isxdigit((uint8_t)*d) ? tolower((uint8_t)*d) - 'a' + 10 :
+                    base;
+        if (digit >= base || term > 0xffff) {
+          return -1;
+        }
+        term = term * base + digit;
+      }
+      p = end;
+    }
+    else if (isalpha((uint8_t)*p) || *p == '_' || *p == '.') {
+      char name[ASSEMBLER_NAME];
+      size_t length = 0;
+      while (isalnum((uint8_t)p[length]) || p[length] == '_' ||
+             p[length] == '.') {
+        length++;
+      }
+      if (length >= ASSEMBLER_NAME) {
+        return -1;
+      }
+      memcpy(name, p, length);
+      name[length] = '\0';
+      p += length;
+
+      AsmSymbol *symbol = FindSymbol(as, name);
+      if (symbol->name[0] != '\0') {
+        term = symbol->value;
+      }
+      else if (as->pass == 1) {
+        as->undefined = 1;
+      }
+      else {
+        return -1;
+      }
+    }
+    else {
+      return -1;
+    }
+    sum += sign * term;
+    sign = 1;
+
+    while (*p == ' ' || *p == '\t') {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
+    }
+    if (*p != '+' && *p != '-') {
+      return -1;
+    }
+  }
+
+  *value = sum;
+  return 0;
+}
+
+/*
+ * Function: Emit
+ * --------------
+ *  Writes the next byte of code(second pass) and moves past it
+ *
+ *  as: assembler
+ *  byte: byte to write
+ *
+ *  returns: void
+ */
+static void Emit(Assembler *as, uint8_t byte)
+{
+  if (as->pc > 0xffff) {
+    as->error = I8080_ERROR_SIZE;
+    return;
+  }
+  if (as->pass == 2) {
+    as->memory[as->pc] = byte;
+    as->low = as->pc < as->low ? as->pc : as->low;
+    as->high = as->pc + 1 > as->high ? as->pc + 1 : as->high;
+  }
+  as->pc++;
+}
+
+/*
+ * Function: AssembleLine
+ * ----------------------
+ *  Assembles a line of source(Assemble), setting as->error when it
+ *  can't
+ *
+ *  as: assembler
+ *  line: the line, changed while it's taken apart
+ *
+ *  returns: void
+ */
+static void AssembleLine(Assembler *as, char *line)
+{
+  static const char *registers[] = { "B", "C", "D", "E", "H", "L", "M",
+                                     "A", "SP", "PSW" };
+  char *operands[ASSEMBLER_OPERANDS];
+  int count = 0;
+  char *p = line;
+
+  /* Cut the comment, outside of quotes */
+  for (char quote = 0; *p != '\0'; p++) {
+    if (*p == '\'' || *p == '"') {
+      quote = quote == 0 ? *p : quote == *p ? 0 : quote;
+    }
+    else if (*p == ';' && quote == 0) {
+      *p = '\0';
+      break;
+    }
+  }
+  p = line + strspn(line, " \t\r");
+
+  /* Address column of a listing, unless it's a name being defined */
+  size_t digits = 0;
+  while (isxdigit((uint8_t)p[digits])) {
+    digits++;
+  }
+  if (digits >= 4 && (p[digits] == ' ' || p[digits] == '\t')) {
+    char *next = p + digits + strspn(p + digits, " \t");
+    if (strncasecmp(next, "EQU", 3) != 0 || isalnum((uint8_t)next[3])) {
+      if (strtoul(p, NULL, 16) != as->pc) {
+        as->error = I8080_ERROR_SYNTAX;
+        return;
+      }
+      p = next;
+    }
+  }
+
+  /* Label and mnemonic(or name of an EQU) */
+  char word[ASSEMBLER_NAME];
+  size_t length = 0;
+  while (isalnum((uint8_t)p[length]) || p[length] == '_' ||
+         p[length] == '.') {
+    length++;
+  }
+  if (length >= ASSEMBLER_NAME || (length == 0 && *p != '\0' &&
+                                   *p != '\r')) {
+    as->error = I8080_ERROR_SYNTAX;
+    return;
+  }
+  memcpy(word, p, length);
+  word[length] = '\0';
+  p += length;
+  if (*p == ':') {
+    if (isdigit((uint8_t)word[0])) {
+      as->error = I8080_ERROR_SYNTAX;
+      return;
+    }
+    DefineSymbol(as, word, as->pc);
+    AssembleLine(as, p + 1);
+    return;
+  }
+  p += strspn(p, " \t\r");
+
+  /* Operands, split at the commas outside of quotes */
+  char *name = NULL; // Symbol defined by EQU
+  if (strncasecmp(p, "EQU", 3) == 0 && !isalnum((uint8_t)p[3])) {
+    name = word;
+    p += 3;
+  }
+  for (char quote = 0, *start = p; ; p++) {
+    if (*p == '\'' || *p == '"') {
+      quote = quote == 0 ? *p : quote == *p ? 0 : quote;
+    }
+    else if ((*p == ',' && quote == 0) || *p == '\0') {
+      char end = *p;
+      char *last = p;
+      *p = '\0';
+      while (last > start && isspace((uint8_t)last[-1])) {
+        *--last = '\0';
+      }
+      start += strspn(start, " \t");
+      if (*start == '\0' && (end == ',' || count > 0)) {
+        as->error = I8080_ERROR_SYNTAX;
+        return;
+      }
+      if (*start != '\0') {
+        if (count == ASSEMBLER_OPERANDS) {
+          as->error = I8080_ERROR_SYNTAX;
+          return;
+        }
+        operands[count++] = start;
+      }
+      if (end == '\0') {
+        break;
+      }
+      start = p + 1;
+    }
+  }
+
+  int32_t value;
+  as->undefined = 0;
+  if (name != NULL) {
+    /* Lines above have used its value, so it can't change later */
+    if (isdigit((uint8_t)name[0]) || count != 1 ||
+        Evaluate(as, operands[0], &value) < 0 || as->undefined) {
+      as->error = I8080_ERROR_SYNTAX;
+      return;
+    }
+    DefineSymbol(as, name, value);
+    return;
+  }
+  if (length == 0) {
+    return; // Blank line or a label alone
+  }
+  for (char *c = word; *c != '\0'; c++) {
+    *c = toupper((uint8_t)*c);
+  }
+
+  /* Directives */
+  if (strcmp(word, "ORG") == 0 || strcmp(word, "DS") == 0) {
+    if (count != 1 || Evaluate(as, operands[0], &value) < 0 ||
+        as->undefined) {
+      as->error = I8080_ERROR_SYNTAX;
+      return;
+    }
+    value += word[0] == 'D' ? as->pc : 0;
+    if (value < 0 || value > 0x10000) {
+      as->error = I8080_ERROR_SIZE;
+      return;
+    }
+    as->pc = value;
+    return;
+  }
+  if (strcmp(word, "END") == 0) {
+    as->done = 1;
+    return;
+  }
+  if (strcmp(word, "DB") == 0 || strcmp(word, "DW") == 0) {
+    for (int i = 0; i < count && as->error == I8080_OK; i++) {
+      char *item = operands[i];
+      size_t size = strlen(item);
+      /* A string, with its quote doubled inside it('it''s') */
+      char quote = item[0];
+      size_t j = 1;
+      if (word[1] == 'B' && size >= 2 && (quote == '\'' || quote == '"') &&
+          item[size - 1] == quote) {
+        while (j + 1 < size && (item[j] != quote ||
+                                (item[j + 1] == quote && j + 2 < size))) {
+          j += item[j] == quote ? 2 : 1;
+        }
+      }
+      if (j > 1 && j + 1 == size) {
+        for (j = 1; j + 1 < size; j++) {
+          Emit(as, item[j]);
+          j += item[j] == quote;
+        }
+        continue;
+      }
+      if (Evaluate(as, item, &value) < 0 || value < -32768 ||
+          value > 0xffff || (word[1] == 'B' && (value < -128 ||
+                                                value > 0xff))) {
+        as->error = I8080_ERROR_SYNTAX;
+        return;
+      }
+      Emit(as, value);
+      if (word[1] == 'W') {
+        Emit(as, value >> 8);
+      }
+    }
+    return;
+  }
+
+  /*
+    Instructions: registers are written like the table("MOV B,C"), the
+    last operand otherwise is the value after the mnemonic("MVI B,")
+  */
+  char key[ASSEMBLER_LINE];
+  int regs = 0;
+  for (int i = 0; i < count; i++) {
+    for (int r = 0; r < 10; r++) {
+      if (strcasecmp(operands[i], registers[r]) == 0) {
+        operands[i] = (char *)registers[r];
+        regs += i == regs;
+        break;
+      }
+    }
+  }
+
+  const Opcode *found = NULL;
+  int op;
+  for (int with_value = 0; with_value < 2 && found == NULL; with_value++) {
+    /* First every operand in the mnemonic(RST 7), then a value last */
+    int named = with_value ? count - 1 : count;
+    if (named < 0 || (with_value && regs < named)) {
+      continue;
+    }
+    char *k = key + sprintf(key, "%s%s", word, count > 0 ? " " : "");
+    for (int i = 0; i < named; i++) {
+      k += sprintf(k, "%s%s", operands[i], i + 1 < count ? "," : "");
+    }
+    for (op = 0; op < 256; op++) {
+      if (Opcodes[op].mnemonic != NULL &&
+          (Opcodes[op].operand != I8080_OPERAND_NONE) == with_value &&
+          strcmp(Opcodes[op].mnemonic, key) == 0) {
+        found = &Opcodes[op];
+        break;
+      }
+    }
+  }
+  if (found == NULL) {
+    as->error = I8080_ERROR_SYNTAX;
+    return;
+  }
+
+  value = 0;
+  if (found->operand != I8080_OPERAND_NONE &&
+      (Evaluate(as, operands[count - 1], &value) < 0 || value < -32768 ||
+       value > 0xffff || (found->operand == I8080_OPERAND_BYTE &&
+                          (value < -128 || value > 0xff)))) {
+    as->error = I8080_ERROR_SYNTAX;
+    return;
+  }
+  Emit(as, op);
+  if (found->operand != I8080_OPERAND_NONE) {
+    Emit(as, value);
+  }
+  if (found->operand == I8080_OPERAND_WORD) {
+    Emit(as, value >> 8);
+  }
+}
@@ -0,0 +1,204 @@
+/*
+  License: DOWHATEVERYOUWANT
+
+  libi8080: embeddable Intel 8080 CPU core
+
+  Every machine is an independent States context working on 64 KB of
+  memory owned by the caller. The library keeps no global state, never
+  exits the process and does no I/O of its own(except the file functions
+  ReadIntoMemory, SaveSnapshot, LoadSnapshot and the input recorder), so
+  any number of machines can run in one process
+
+  Build the library once with the same core options as the programs:
+    gcc -O2 -c -fPIC [-DTHREADED_DISPATCH] [-DBLOCK_CACHE] [-DJIT] i8080.c
+    ar rcs libi8080.a i8080.o(static) or gcc -shared i8080.o -o libi8080.so
+  or compile i8080.c along with the program
+*/
+#ifndef I8080_H
+#define I8080_H
+
+#include <stdint.h>
+
+
+/* Error codes(States.error and return values) */
+#define I8080_OK 0
+#define I8080_ERROR_MEMORY -1 // Allocation failed
+#define I8080_ERROR_FILE -2 // Image can't be opened or read
+#define I8080_ERROR_SIZE -3 // Image doesn't fit in memory
+#define I8080_ERROR_UNSUPPORTED -4 // Core option not built into the library
+#define I8080_ERROR_REPLAY -5 // Replayed machine left the recorded session
+#define I8080_ERROR_SYNTAX -6 // Source line can't be assembled(Assemble)
+
+/* Interrupts waiting for their cycle(ScheduleInterrupt) */
+#define I8080_SCHEDULED 8
+
+/* Control flow of an opcode(Opcode.flow) */
+#define I8080_FLOW_NEXT 0 // Goes on with the next instruction
+#define I8080_FLOW_JUMP 1 // JMP to the operand
+#define I8080_FLOW_BRANCH 2 // Conditional jump to the operand
+#define I8080_FLOW_CALL 3 // CALL of the operand
+#define I8080_FLOW_CALL_IF 4 // Conditional call of the operand
+#define I8080_FLOW_RETURN 5 // RET
+#define I8080_FLOW_RETURN_IF 6 // Conditional return
+#define I8080_FLOW_RESTART 7 // RST, calls the opcode & 0x38
+#define I8080_FLOW_INDIRECT 8 // PCHL, jumps to HL
+#define I8080_FLOW_HALT 9 // HLT
+
+/* Operand following an opcode(Opcode.operand) */
+#define I8080_OPERAND_NONE 0
+#define I8080_OPERAND_BYTE 1 // 8 bit value or port
+#define I8080_OPERAND_WORD 2 // 16 bit value or address, low byte first
+
+/* Text of the longest instruction(Disassemble) and its terminator */
+#define I8080_TEXT_SIZE 16
+
+
+/* Struct definitions */
+typedef union ConditionFlags {
+  struct {
+    uint8_t cy:1; // Carry condtion bit
+    uint8_t pad1:1; // Padding bit(always 1 when pushed)
+    uint8_t p:1; // Parity condtion bit
+    uint8_t pad3:1; // Padding bit
+    uint8_t ac:1; // Auxiliary carry condtion bit
+    uint8_t pad5:1; // Padding bit
+    uint8_t z:1; // Zero condition bit
+    uint8_t s:1; // Sign condtion bit
+  };
+  uint8_t psw; // All flags in Intel8080 PSW layout(S Z 0 AC 0 P 1 CY)
+} ConditionFlags;
+
+/* Port handlers, context is the pointer given when mapping the port */
+typedef uint8_t (*InputHandler)(void *context, uint8_t port);
+typedef void (*OutputHandler)(void *context, uint8_t port, uint8_t value);
+
+/*
+  I/O port dispatch table(InitPorts, MapInput, MapOutput)
+  IN and OUT index it with the port number, an unmapped port(NULL
+  handler) reads 0 and ignores writes without leaving the core
+  One table can serve any number of machines
+*/
+typedef struct Ports {
+  InputHandler input[256];
+  void *input_context[256];
+  OutputHandler output[256];
+  void *output_context[256];
+} Ports;
+
+/*
+  What the cores know about an opcode(Opcodes), the mnemonic includes
+  everything but the operand: "MVI B," then the byte, "JMP " the word
+*/
+typedef struct Opcode {
+  const char *mnemonic; // NULL for the undocumented opcodes(NOPs)
+  uint8_t length; // Size in bytes with the operand
+  uint8_t cycles; // Clock cycles(T-states), condition not met
+  uint8_t taken; // Clock cycles when a conditional CALL or RET is taken
+  uint8_t flags; // Condition flags written, as PSW bits
+  uint8_t flow; // I8080_FLOW_*
+  uint8_t operand; // I8080_OPERAND_*
+} Opcode;
+
+typedef struct ScheduledInterrupt {
+  uint64_t cycles; // Cycle counter at which the request is raised
+  uint32_t period; // Cycles until it's raised again, 0 for once
+  uint8_t vector; // RST number(0-7)
+} ScheduledInterrupt;
+
+typedef struct States {
+  uint8_t a; // Accumulator register
+  uint8_t b; // Register B(register pair BC)
+  uint8_t c; // Register C
+  uint8_t d; // Register D(register pair DE)
+  uint8_t e; // Register E
+  uint8_t h; // Register H(register pair HL)
+  uint8_t l; // Register L
+  uint16_t sp; // Stack pointer
+  uint16_t pc; // Program counter
+  uint8_t *memory; // 64 KB owned by the caller
+  union ConditionFlags cc;
+  uint8_t int_enable; // Enable feature(for particular OpCodes)
+  uint8_t halted; // Set by HLT, the processor is stopped
+  uint64_t cycles; // Clock cycles(T-states) executed
+  struct BlockCache *cache; // Decoded blocks(AttachBlockCache)
+  struct Jit *jit; // Translated blocks(AttachJit)
+  int error; // Set when the core had to stop, I8080_OK otherwise
+  /* Called after every instruction, NULL runs headless */
+  void (*trace)(struct States *state, uint16_t pc);
+  /* Devices on the I/O ports, NULL for none. Handlers run with the
+     cycle counter up to date */
+  Ports *ports;
+  struct Recorder *recorder; // Input log written or replayed
+  /*
+    Interrupts, delivered by Emulator and EmulateCycles(not Execute)
+    A raised request waits until interrupts are enabled, and for one
+    more instruction after EI
+  */
+  uint64_t ei_cycles; // Cycle counter right after the last EI
+  uint8_t irq; // RST number + 1 of the raised request, 0 for none
+  int nscheduled;
+  ScheduledInterrupt scheduled[I8080_SCHEDULED]; // Soonest first
+} States;
+
+/* Counters of the attached block cache or JIT */
+typedef struct Statistics {
+  uint64_t hits; // Lookups finding a decoded block
+  uint64_t misses; // Lookups decoding a new block
+  uint64_t blocks; // Blocks translated
+  uint64_t invalidations; // Blocks dropped by writes into their code
+  uint64_t flushes; // Times the JIT arena was emptied
+  uint64_t interpreted; // Instructions the JIT left to the interpreter
+} Statistics;
+
+/* Saved machine(TakeSnapshot) */
+typedef struct Snapshot Snapshot;
+
+/* Log of the inputs of a session(StartRecording, StartReplay) */
+typedef struct Recorder Recorder;
+
+
+/* Metadata of every opcode */
+extern const Opcode Opcodes[256];
+
+
+/* Function declarations */
+void InitState(States *state, uint8_t *memory);
+void ResetState(States *state);
+void ReleaseState(States *state);
+int AttachBlockCache(States *state);
+int AttachJit(States *state);
+void ReadStatistics(const States *state, Statistics *stats);
+void InitPorts(Ports *ports);
+void MapInput(Ports *ports, uint8_t port, InputHandler handler,
+              void *context);
+void MapOutput(Ports *ports, uint8_t port, OutputHandler handler,
+               void *context);
+void WriteMemory(States *state, uint16_t addr, uint8_t value);
+void CopyIntoMemory(States *state, const uint8_t *image);
+int ReadIntoMemory(uint8_t *memory, const char *filename, uint32_t offset);
+int TakeSnapshot(const States *state, const void *devices, uint32_t size,
+                 Snapshot **snapshot);
+void FreeSnapshot(Snapshot *snapshot);
+int RestoreSnapshot(const Snapshot *snapshot, States *state, void *devices,
+                    uint32_t size);
+int ForkSnapshot(const Snapshot *snapshot, States *child, void *devices,
+                 uint32_t size);
+void ReleaseMemory(uint8_t *memory);
+int SaveSnapshot(const Snapshot *snapshot, const char *filename);
+int LoadSnapshot(const char *filename, Snapshot **snapshot);
+int StartRecording(States *state, const char *filename);
+int StartReplay(States *state, const char *filename);
+int LogInterrupt(States *state, uint8_t vector);
+int NextInterrupt(const States *state, uint64_t *cycles, uint8_t *vector);
+int StopRecorder(States *state, uint64_t *events);
+void Interrupt(States *state, uint8_t vector);
+int ScheduleInterrupt(States *state, uint64_t cycles, uint32_t period,
+                      uint8_t vector);
+uint64_t Execute(States *state, uint64_t count, uint64_t cycle_limit);
+uint64_t Emulator(States *state, uint64_t count);
+uint32_t EmulateCycles(States *state, uint32_t budget);
+int Disassemble(const uint8_t *memory, uint16_t pc, char *text);
+int Assemble(const char *source, uint8_t *memory, uint32_t *low,
+             uint32_t *high, int *line);
+
+#endif
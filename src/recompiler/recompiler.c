@@ -0,0 +1,961 @@
+/*
+  License: DOWHATEVERYOUWANT
+
+  Static recompiler for Intel 8080 ROM images
+
+  Walks the code reachable from the entry points of a fixed image and
+  writes a C translation unit with one label per basic block. Registers
+  live in local variables, so the C compiler keeps them in host registers
+
+  Jumps to addresses known at translation time are plain gotos. Computed
+  jumps(PCHL, RET) go through a switch on the guest address, and code
+  that wasn't found statically(RAM, jump tables, patched code) runs on an
+  interpreter emitted from the same instruction templates
+
+  Usage:
+    ./recompiler [-cpm] [-o origin] [-e entry] [-p addr=value] image... > rom.c
+    gcc -O2 rom.c -o rom
+    ./rom [-n N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "../libi8080/i8080.h"
+
+
+/* Definitions */
+#define MAX_ENTRIES 64
+#define MAX_PATCHES 64
+
+
+/* Instruction templates are formatted into buffers of this size */
+#define STATEMENT_SIZE 512
+
+
+/* Operands of register fields B, C, D, E, H, L, M, A */
+static const char *Registers[8] = {
+  "b", "c", "d", "e", "h", "l", "memory[HL]", "a"
+};
+
+/* Register pairs BC, DE, HL and SP as high/low byte names */
+static const char *PairHigh[3] = { "b", "d", "h" };
+static const char *PairLow[3] = { "c", "e", "l" };
+static const char *Pairs[4] = { "BC", "DE", "HL", "sp" };
+
+/* Conditions NZ, Z, NC, C, PO, PE, P, M */
+static const char *Conditions[8] = {
+  "(!(f & 0x40))", "(f & 0x40)", "(!(f & 0x01))", "(f & 0x01)",
+  "(!(f & 0x04))", "(f & 0x04)", "(!(f & 0x80))", "(f & 0x80)"
+};
+
+
+/* Image being translated */
+uint8_t memory[0x10000];
+uint32_t origin = 0; // Load address of the image
+uint32_t size = 0; // Bytes loaded
+int cpm = 0; // CP/M program: BDOS calls at 5, warm boot at 0
+
+/* Result of the walk */
+uint8_t Leader[0x10000]; // A basic block starts at the address
+uint8_t Visited[0x10000]; // Address was decoded as the start of an instruction
+uint8_t Code[0x10000]; // Byte belongs to translated code
+
+
+/* Function declarations */
+void ReadImage(char *filename);
+int Loaded(uint16_t addr);
+int EndsBlock(uint8_t op, uint16_t addr);
+void Walk(uint16_t *entries, int count);
+int Statement(char *out, uint8_t op, const char *byte, const char *word);
+void EmitGoto(uint16_t target);
+void EmitBlock(uint16_t start);
+void EmitInterpreter(void);
+void EmitRuntime(char **files, int nfiles);
+void EmitRun(void);
+void EmitMain(uint16_t entry);
+uint16_t Word(uint16_t addr);
+
+
+int main(int argc, char **argv)
+{
+  uint16_t entries[MAX_ENTRIES];
+  int nentries = 0;
+  uint32_t patches[MAX_PATCHES][2];
+  int npatches = 0;
+  char *files[argc];
+  int nfiles = 0;
+  int origin_set = 0;
+
+  /* Parse options */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-cpm") == 0) {
+      cpm = 1;
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      origin = strtoul(argv[++i], NULL, 0) & 0xffff;
+      origin_set = 1;
+    }
+    else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc &&
+             nentries < MAX_ENTRIES) {
+      entries[nentries++] = strtoul(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc &&
+             npatches < MAX_PATCHES) {
+      char *value;
+      patches[npatches][0] = strtoul(argv[++i], &value, 0) & 0xffff;
+      patches[npatches][1] = strtoul(value + (*value == '='), NULL, 0);
+      npatches++;
+    }
+    else if (argv[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [-cpm] [-o origin] [-e entry] "
+              "[-p addr=value] image...\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    else {
+      files[nfiles++] = argv[i];
+    }
+  }
+  if (nfiles == 0) {
+    fprintf(stderr, "No image given\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* CP/M programs load at 0x100 */
+  if (cpm && !origin_set) {
+    origin = 0x100;
+  }
+  for (int i = 0; i < nfiles; i++) {
+    ReadImage(files[i]);
+  }
+  for (int i = 0; i < npatches; i++) {
+    memory[patches[i][0]] = patches[i][1];
+  }
+
+  /* Default entry points: CP/M start or reset and RST vectors */
+  if (nentries == 0) {
+    if (cpm) {
+      entries[nentries++] = origin;
+    }
+    else {
+      for (int vector = 0; vector < 0x40; vector += 8) {
+        entries[nentries++] = vector;
+      }
+    }
+  }
+  Walk(entries, nentries);
+
+  EmitRuntime(files, nfiles);
+  EmitRun();
+  EmitMain(entries[0]);
+
+  return 0;
+}
+
+
+/* Function implementation */
+
+/*
+ * Function:  ReadImage
+ * --------------------
+ *  Appends a binary file to the image
+ *
+ *  filename: name of the file to read
+ *
+ *  returns: void - exits if the file can't be read or no room is left
+ *  below $10000, a file running past $ffff is truncated
+ */
+void ReadImage(char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "Can't open %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  if (origin + size >= 0x10000) {
+    fprintf(stderr, "%s doesn't fit, the image already reaches $ffff\n",
+            filename);
+    exit(EXIT_FAILURE);
+  }
+  size_t room = 0x10000 - (origin + size);
+  size_t read = fread(&memory[origin + size], 1, room, fp);
+  if (ferror(fp)) {
+    fprintf(stderr, "Can't read %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  if (read == room && fgetc(fp) != EOF) {
+    fprintf(stderr, "%s truncated at $ffff\n", filename);
+  }
+  fclose(fp);
+  size += read;
+}
+
+/*
+ * Function:  Loaded
+ * -----------------
+ *  Tells if an address belongs to the image(translated code may only
+ *  come from there, everything else is RAM)
+ *
+ *  addr: guest address
+ *
+ *  returns: 1 if the address was loaded, else 0
+ */
+int Loaded(uint16_t addr)
+{
+  return addr >= origin && addr < origin + size;
+}
+
+/*
+ * Function:  Word
+ * ---------------
+ *  Reads the 16 bit operand of the instruction at addr
+ *
+ *  addr: address of the instruction
+ *
+ *  returns: operand value
+ */
+uint16_t Word(uint16_t addr)
+{
+  return memory[(uint16_t)(addr + 1)] | (memory[(uint16_t)(addr + 2)] << 8);
+}
+
+/*
+ * Function:  EndsBlock
+ * --------------------
+ *  Tells if an instruction transfers control(JMP, CALL, RET, RST, PCHL,
+ *  HLT and their conditional forms). BDOS calls in CP/M programs return
+ *  to the next instruction and don't end a block
+ *
+ *  op: opcode
+ *  addr: address of the instruction
+ *
+ *  returns: 1 if the instruction ends a basic block, else 0
+ */
+int EndsBlock(uint8_t op, uint16_t addr)
+{
+  if (cpm && op == 0xcd && Word(addr) == 5) {
+    return 0;
+  }
+  return Opcodes[op].flow != I8080_FLOW_NEXT;
+}
+
+/*
+ * Function:  Walk
+ * ---------------
+ *  Follows every jump, call and fall through from the entry points and
+ *  marks the first address of each basic block
+ *  Targets of RET and PCHL aren't known, except for return addresses,
+ *  which are leaders since every call falls through to them
+ *
+ *  entries: addresses execution may start at
+ *  count: number of entries
+ *
+ *  returns: void
+ */
+void Walk(uint16_t *entries, int count)
+{
+  uint16_t *work = malloc(sizeof(uint16_t) * 0x30000);
+  int top = 0;
+
+  for (int i = 0; i < count; i++) {
+    work[top++] = entries[i];
+  }
+
+  while (top > 0) {
+    uint16_t addr = work[--top];
+
+    if (!Loaded(addr)) {
+      continue;
+    }
+    Leader[addr] = 1;
+
+    while (Loaded(addr) && !Visited[addr]) {
+      uint8_t op = memory[addr];
+      uint8_t flow = Opcodes[op].flow;
+      uint16_t next = addr + Opcodes[op].length;
+
+      Visited[addr] = 1;
+      for (int i = 0; i < Opcodes[op].length; i++) {
+        Code[(uint16_t)(addr + i)] = 1;
+      }
+      if (!EndsBlock(op, addr)) {
+        addr = next;
+        continue;
+      }
+
+      if (Opcodes[op].operand == I8080_OPERAND_WORD) { // JMP, CALL and cc
+        if (!(cpm && op == 0xcd && Word(addr) == 0)) {
+          work[top++] = Word(addr);
+        }
+      }
+      else if (flow == I8080_FLOW_RESTART) {
+        work[top++] = op & 0x38;
+      }
+      if (flow != I8080_FLOW_JUMP && flow != I8080_FLOW_RETURN &&
+          flow != I8080_FLOW_INDIRECT) {
+        work[top++] = next; // Condition not met, return address or HLT
+      }
+      break;
+    }
+
+    /* Joined code decoded earlier, which must start a block too */
+    if (Loaded(addr) && Visited[addr]) {
+      Leader[addr] = 1;
+    }
+  }
+
+  free(work);
+}
+
+/*
+ * Function:  Statement
+ * --------------------
+ *  Formats the C statement of an instruction that doesn't transfer control
+ *  Operands are C expressions, literals for translated blocks and memory
+ *  reads for the interpreter
+ *
+ *  out: buffer of STATEMENT_SIZE bytes
+ *  op: opcode
+ *  byte: 8 bit operand expression
+ *  word: 16 bit operand expression
+ *
+ *  returns: 1 if the statement stores to memory, else 0
+ */
+int Statement(char *out, uint8_t op, const char *byte, const char *word)
+{
+  int dst = (op >> 3) & 7;
+  int src = op & 7;
+  int rp = (op >> 4) & 3;
+  static const char *Alu[8] = {
+    "ADD(%s, 0);", "ADD(%s, f & 1);", "SUB(%s, 0);", "SUB(%s, f & 1);",
+    "ANA(%s);", "XRA(%s);", "ORA(%s);", "CMP(%s);"
+  };
+
+  out[0] = '\0';
+  if (op >= 0x40 && op < 0x80) { // MOV
+    if (dst == 6) {
+      snprintf(out, STATEMENT_SIZE, "STORE(HL, %s);", Registers[src]);
+      return 1;
+    }
+    snprintf(out, STATEMENT_SIZE, "%s = %s;", Registers[dst], Registers[src]);
+    return 0;
+  }
+  if (op >= 0x80 && op < 0xc0) {
+    snprintf(out, STATEMENT_SIZE, Alu[dst], Registers[src]);
+    return 0;
+  }
+  if ((op & 0xc7) == 0xc6) { // ADI ... CPI
+    snprintf(out, STATEMENT_SIZE, Alu[dst], byte);
+    return 0;
+  }
+
+  switch (op & 0xcf) {
+    case 0x01: // LXI
+      if (rp == 3) {
+        snprintf(out, STATEMENT_SIZE, "sp = %s;", word);
+      }
+      else {
+        snprintf(out, STATEMENT_SIZE, "%s = %s >> 8; %s = %s & 0xff;",
+                 PairHigh[rp], word, PairLow[rp], word);
+      }
+      return 0;
+    case 0x03: // INX
+      if (rp == 3) {
+        snprintf(out, STATEMENT_SIZE, "sp++;");
+      }
+      else {
+        snprintf(out, STATEMENT_SIZE, "if (++%s == 0) %s++;",
+                 PairLow[rp], PairHigh[rp]);
+      }
+      return 0;
+    case 0x0b: // DCX
+      if (rp == 3) {
+        snprintf(out, STATEMENT_SIZE, "sp--;");
+      }
+      else {
+        snprintf(out, STATEMENT_SIZE, "if (%s-- == 0) %s--;",
+                 PairLow[rp], PairHigh[rp]);
+      }
+      return 0;
+    case 0x09: // DAD
+      snprintf(out, STATEMENT_SIZE, "DAD(%s);", Pairs[rp]);
+      return 0;
+    case 0xc1: // POP
+      if (rp == 3) {
+        snprintf(out, STATEMENT_SIZE, "f = memory[sp] & 0xd5; "
+                 "a = memory[(uint16_t)(sp + 1)]; sp += 2;");
+      }
+      else {
+        snprintf(out, STATEMENT_SIZE, "%s = memory[sp]; "
+                 "%s = memory[(uint16_t)(sp + 1)]; sp += 2;",
+                 PairLow[rp], PairHigh[rp]);
+      }
+      return 0;
+    case 0xc5: // PUSH
+      snprintf(out, STATEMENT_SIZE, "STORE((uint16_t)(sp - 1), %s); "
+               "STORE((uint16_t)(sp - 2), %s); sp -= 2;",
+               rp == 3 ? "a" : PairHigh[rp],
+               rp == 3 ? "f | 0x02" : PairLow[rp]);
+      return 1;
+  }
+
+  switch (op & 0xc7) {
+    case 0x04: // INR
+    case 0x05: // DCR
+      {
+        const char *name = (op & 1) ? "DCR" : "INR";
+        if (dst == 6) {
+          snprintf(out, STATEMENT_SIZE, "{ uint8_t m_ = memory[HL]; %s(m_); "
+                   "STORE(HL, m_); }", name);
+          return 1;
+        }
+        snprintf(out, STATEMENT_SIZE, "%s(%s);", name, Registers[dst]);
+      } return 0;
+    case 0x06: // MVI
+      if (dst == 6) {
+        snprintf(out, STATEMENT_SIZE, "STORE(HL, %s);", byte);
+        return 1;
+      }
+      snprintf(out, STATEMENT_SIZE, "%s = %s;", Registers[dst], byte);
+      return 0;
+  }
+
+  switch (op) {
+    case 0x02: // STAX B
+    case 0x12: // STAX D
+      snprintf(out, STATEMENT_SIZE, "STORE(%s, a);", Pairs[rp]);
+      return 1;
+    case 0x0a: // LDAX B
+    case 0x1a: // LDAX D
+      snprintf(out, STATEMENT_SIZE, "a = memory[%s];", Pairs[rp]);
+      return 0;
+    case 0x22: // SHLD
+      snprintf(out, STATEMENT_SIZE, "STORE(%s, l); "
+               "STORE((uint16_t)(%s + 1), h);", word, word);
+      return 1;
+    case 0x2a: // LHLD
+      snprintf(out, STATEMENT_SIZE, "l = memory[%s]; "
+               "h = memory[(uint16_t)(%s + 1)];", word, word);
+      return 0;
+    case 0x32: // STA
+      snprintf(out, STATEMENT_SIZE, "STORE(%s, a);", word);
+      return 1;
+    case 0x3a: // LDA
+      snprintf(out, STATEMENT_SIZE, "a = memory[%s];", word);
+      return 0;
+    case 0x07: // RLC
+      snprintf(out, STATEMENT_SIZE, "f = (f & ~1) | (a >> 7); "
+               "a = (uint8_t)(a << 1 | a >> 7);");
+      return 0;
+    case 0x0f: // RRC
+      snprintf(out, STATEMENT_SIZE, "f = (f & ~1) | (a & 1); "
+               "a = (uint8_t)(a >> 1 | a << 7);");
+      return 0;
+    case 0x17: // RAL
+      snprintf(out, STATEMENT_SIZE, "{ uint8_t c_ = f & 1; "
+               "f = (f & ~1) | (a >> 7); a = (uint8_t)(a << 1 | c_); }");
+      return 0;
+    case 0x1f: // RAR
+      snprintf(out, STATEMENT_SIZE, "{ uint8_t c_ = f & 1; "
+               "f = (f & ~1) | (a & 1); a = (uint8_t)(a >> 1 | c_ << 7); }");
+      return 0;
+    case 0x27: // DAA
+      snprintf(out, STATEMENT_SIZE, "DAA();");
+      return 0;
+    case 0x2f: // CMA
+      snprintf(out, STATEMENT_SIZE, "a = ~a;");
+      return 0;
+    case 0x37: // STC
+      snprintf(out, STATEMENT_SIZE, "f |= 1;");
+      return 0;
+    case 0x3f: // CMC
+      snprintf(out, STATEMENT_SIZE, "f ^= 1;");
+      return 0;
+    case 0xe3: // XTHL
+      snprintf(out, STATEMENT_SIZE, "{ uint8_t t_ = l; l = memory[sp]; "
+               "STORE(sp, t_); t_ = h; h = memory[(uint16_t)(sp + 1)]; "
+               "STORE((uint16_t)(sp + 1), t_); }");
+      return 1;
+    case 0xeb: // XCHG
+      snprintf(out, STATEMENT_SIZE, "{ uint8_t t_ = h; h = d; d = t_; "
+               "t_ = l; l = e; e = t_; }");
+      return 0;
+    case 0xf9: // SPHL
+      snprintf(out, STATEMENT_SIZE, "sp = HL;");
+      return 0;
+    case 0xf3: // DI
+      snprintf(out, STATEMENT_SIZE, "int_enable = 0;");
+      return 0;
+    case 0xfb: // EI
+      snprintf(out, STATEMENT_SIZE, "int_enable = 1;");
+      return 0;
+    case 0xd3: // OUT
+      snprintf(out, STATEMENT_SIZE, "PortOut(%s, a);", byte);
+      return 0;
+    case 0xdb: // IN
+      snprintf(out, STATEMENT_SIZE, "a = PortIn(%s);", byte);
+      return 0;
+    case 0xcd: // CALL 5 of a CP/M program(other calls end blocks)
+      snprintf(out, STATEMENT_SIZE, "Bdos(c, DE);");
+      return 0;
+  }
+
+  return 0; // NOP and undocumented opcodes
+}
+
+/*
+ * Function:  EmitGoto
+ * -------------------
+ *  Continues at a guest address, straight to its block when translated
+ *
+ *  target: guest address
+ *
+ *  returns: void
+ */
+void EmitGoto(uint16_t target)
+{
+  if (Leader[target]) {
+    printf("goto L_%04x;", target);
+  }
+  else {
+    printf("{ pc = 0x%04x; goto dispatch; }", target);
+  }
+}
+
+/*
+ * Function:  EmitBlock
+ * --------------------
+ *  Emits a basic block: a check that the whole block fits the instruction
+ *  budget, then every instruction up to the first transfer of control
+ *  or the start of the next block
+ *
+ *  start: address of the first instruction
+ *
+ *  returns: void
+ */
+void EmitBlock(uint16_t start)
+{
+  char statement[STATEMENT_SIZE];
+  char text[I8080_TEXT_SIZE];
+  char byte[8], word[8];
+  int count = 0;
+  uint16_t addr = start;
+
+  /* Count the instructions */
+  do {
+    uint8_t op = memory[addr];
+    count++;
+    if (EndsBlock(op, addr)) {
+      break;
+    }
+    addr += Opcodes[op].length;
+  } while (Loaded(addr) && !Leader[addr]);
+
+  printf("L_%04x:\n", start);
+  printf("  if (executed + %d > budget) { pc = 0x%04x; goto step; }\n",
+         count, start);
+
+  addr = start;
+  for (int i = 0; i < count; i++) {
+    uint8_t op = memory[addr];
+    uint16_t next = addr + Opcodes[op].length;
+    uint16_t target = Word(addr);
+
+    Disassemble(memory, addr, text);
+    printf("  // %04x %s\n", addr, text);
+    printf("  STEP(%d); ", Opcodes[op].cycles);
+
+    snprintf(byte, sizeof(byte), "0x%02x", memory[(uint16_t)(addr + 1)]);
+    snprintf(word, sizeof(word), "0x%04x", target);
+
+    if (op == 0x76) { // HLT
+      printf("halted = 1; pc = 0x%04x; goto dispatch;\n", next);
+    }
+    else if (op == 0xc3) { // JMP
+      EmitGoto(target);
+      printf("\n");
+    }
+    else if ((op & 0xc7) == 0xc2) { // Jcc
+      printf("if %s ", Conditions[(op >> 3) & 7]);
+      EmitGoto(target);
+      printf("\n  ");
+      EmitGoto(next);
+      printf("\n");
+    }
+    else if (cpm && op == 0xcd && target == 0) { // Warm boot
+      printf("exit(EXIT_SUCCESS);\n");
+    }
+    else if (op == 0xcd && EndsBlock(op, addr)) { // CALL
+      printf("PUSH(0x%04x); ", next);
+      EmitGoto(target);
+      printf("\n");
+    }
+    else if ((op & 0xc7) == 0xc4) { // Ccc
+      printf("if %s { cycles += 6; PUSH(0x%04x); ",
+             Conditions[(op >> 3) & 7], next);
+      EmitGoto(target);
+      printf(" }\n  ");
+      EmitGoto(next);
+      printf("\n");
+    }
+    else if (op == 0xc9) { // RET
+      printf("pc = POP(); goto dispatch;\n");
+    }
+    else if ((op & 0xc7) == 0xc0) { // Rcc
+      printf("if %s { cycles += 6; pc = POP(); goto dispatch; }\n  ",
+             Conditions[(op >> 3) & 7]);
+      EmitGoto(next);
+      printf("\n");
+    }
+    else if ((op & 0xc7) == 0xc7) { // RST
+      printf("PUSH(0x%04x); ", next);
+      EmitGoto(op & 0x38);
+      printf("\n");
+    }
+    else if (op == 0xe9) { // PCHL
+      printf("pc = HL; goto dispatch;\n");
+    }
+    else {
+      int stores = Statement(statement, op, byte, word);
+      printf("%s\n", statement);
+      /* Leave translated code once it has been written to */
+      if (stores) {
+        printf("  if (budget == 0) { pc = 0x%04x; goto dispatch; }\n", next);
+      }
+      if (i == count - 1) {
+        printf("  ");
+        EmitGoto(next);
+        printf("\n");
+      }
+    }
+    addr = next;
+  }
+  printf("\n");
+}
+
+/*
+ * Function:  EmitInterpreter
+ * --------------------------
+ *  Emits the fallback interpreter running one instruction at pc
+ *  It is built from the same templates as the translated blocks, with
+ *  operands read from memory
+ *
+ *  returns: void
+ */
+void EmitInterpreter(void)
+{
+  char statement[STATEMENT_SIZE];
+  const char *byte = "memory[(uint16_t)(pc + 1)]";
+  const char *word = "OPERAND";
+
+  printf("step:\n");
+  printf("  if (executed >= limit) {\n");
+  printf("    goto done;\n");
+  printf("  }\n");
+  printf("  switch (memory[pc]) {\n");
+  for (int op = 0; op < 0x100; op++) {
+    printf("    case 0x%02x: STEP(%d); ", op, Opcodes[op].cycles);
+    if (op == 0x76) {
+      printf("halted = 1; pc += 1; break;\n");
+    }
+    else if (op == 0xc3) {
+      printf("pc = OPERAND; break;\n");
+    }
+    else if ((op & 0xc7) == 0xc2) {
+      printf("pc = %s ? OPERAND : pc + 3; break;\n",
+             Conditions[(op >> 3) & 7]);
+    }
+    else if (op == 0xcd) {
+      if (cpm) {
+        printf("if (OPERAND == 5) { Bdos(c, DE); pc += 3; break; } "
+               "if (OPERAND == 0) exit(EXIT_SUCCESS);\n      ");
+      }
+      printf("{ uint16_t t_ = OPERAND; PUSH(pc + 3); pc = t_; } break;\n");
+    }
+    else if ((op & 0xc7) == 0xc4) {
+      printf("if %s { uint16_t t_ = OPERAND; cycles += 6; PUSH(pc + 3); "
+             "pc = t_; } else pc += 3; break;\n", Conditions[(op >> 3) & 7]);
+    }
+    else if (op == 0xc9) {
+      printf("pc = POP(); break;\n");
+    }
+    else if ((op & 0xc7) == 0xc0) {
+      printf("if %s { cycles += 6; pc = POP(); } else pc += 1; break;\n",
+             Conditions[(op >> 3) & 7]);
+    }
+    else if ((op & 0xc7) == 0xc7) {
+      printf("PUSH(pc + 1); pc = 0x%02x; break;\n", op & 0x38);
+    }
+    else if (op == 0xe9) {
+      printf("pc = HL; break;\n");
+    }
+    else {
+      Statement(statement, op, byte, word);
+      printf("%s pc += %d; break;\n", statement, Opcodes[op].length);
+    }
+  }
+  printf("  }\n");
+  printf("  goto dispatch;\n");
+}
+
+/*
+ * Function:  EmitRuntime
+ * ----------------------
+ *  Emits the header of the translation unit: the image, flag tables,
+ *  code ranges and the macros used by the instruction templates
+ *
+ *  files: names of the image files(for the header comment)
+ *  nfiles: number of files
+ *
+ *  returns: void
+ */
+void EmitRuntime(char **files, int nfiles)
+{
+  printf("/*\n  Generated by recompiler from");
+  for (int i = 0; i < nfiles; i++) {
+    printf(" %s", files[i]);
+  }
+  printf("\n  Do not edit, run the recompiler again instead\n*/\n");
+  printf("#include <stdio.h>\n#include <stdlib.h>\n#include <stdint.h>\n"
+         "#include <string.h>\n#include <time.h>\n\n");
+
+  printf("#define ORIGIN 0x%04x\n\n", origin);
+  printf("/* Image loaded at ORIGIN */\n");
+  printf("static const uint8_t Image[%u] = {", size);
+  for (uint32_t i = 0; i < size; i++) {
+    printf("%s0x%02x,", (i % 16) ? " " : "\n  ", memory[origin + i]);
+  }
+  printf("\n};\n\n");
+
+  /* Translated code, so stores into it can be detected */
+  printf("/* Address ranges covered by translated blocks */\n");
+  printf("static const uint16_t CodeRanges[][2] = {\n");
+  for (uint32_t i = 0; i < 0x10000; i++) {
+    if (Code[i]) {
+      uint32_t end = i;
+      while (end < 0x10000 && Code[end]) {
+        end++;
+      }
+      printf("  { 0x%04x, 0x%04x },\n", i, end - 1);
+      i = end;
+    }
+  }
+  printf("  { 0x0000, 0x0000 }\n};\n\n");
+
+  printf("/* Zero, sign and parity flags of every 8 bit result */\n");
+  printf("static const uint8_t ZSPTable[256] = {");
+  for (int i = 0; i < 256; i++) {
+    int parity = !(__builtin_popcount(i) & 1);
+    printf("%s0x%02x,", (i % 8) ? " " : "\n  ",
+           (i == 0 ? 0x40 : 0) | (i & 0x80) | (parity << 2));
+  }
+  printf("\n};\n");
+  printf("static const uint8_t ACAddTable[8] = "
+         "{ 0, 0x10, 0x10, 0x10, 0, 0, 0, 0x10 };\n");
+  printf("static const uint8_t ACSubTable[8] = "
+         "{ 0x10, 0x10, 0, 0x10, 0, 0x10, 0, 0 };\n\n");
+
+  printf("static uint8_t memory[0x10000];\n");
+  printf("static uint8_t Translated[0x10000];\n\n");
+
+  printf(
+    "typedef struct Machine {\n"
+    "  uint8_t a, b, c, d, e, h, l, f; // Registers, f in PSW layout\n"
+    "  uint16_t sp, pc;\n"
+    "  uint8_t int_enable, halted;\n"
+    "  uint64_t executed, cycles;\n"
+    "} Machine;\n\n");
+
+  printf(
+    "/* Ports have no devices yet, IN reads 0 like an unmapped port of "
+    "libi8080 */\n"
+    "static uint8_t PortIn(uint8_t port) { (void)port; return 0; }\n"
+    "static void PortOut(uint8_t port, uint8_t value) "
+    "{ (void)port; (void)value; }\n\n");
+
+  if (cpm) {
+    printf(
+      "/* CP/M BDOS call: C = 9 prints the string at DE, C = 2 a character */\n"
+      "static void Bdos(uint8_t c, uint16_t de)\n"
+      "{\n"
+      "  if (c == 9) {\n"
+      "    for (uint16_t i = de + 3; memory[i] != '$'; i++) {\n"
+      "      printf(\"%%c\", memory[i]);\n"
+      "    }\n"
+      "    printf(\"\\n\");\n"
+      "  }\n"
+      "  else if (c == 2) {\n"
+      "    printf(\"Print routine called\\n\");\n"
+      "  }\n"
+      "}\n\n");
+  }
+
+  printf(
+    "#define BC ((uint16_t)(b << 8 | c))\n"
+    "#define DE ((uint16_t)(d << 8 | e))\n"
+    "#define HL ((uint16_t)(h << 8 | l))\n"
+    "#define OPERAND ((uint16_t)(memory[(uint16_t)(pc + 2)] << 8 | "
+    "memory[(uint16_t)(pc + 1)]))\n"
+    "#define STEP(n) executed++, cycles += (n)\n"
+    "/* A store into translated code sends everything to the interpreter */\n"
+    "#define STORE(addr, value) do { uint16_t at_ = (addr); "
+    "memory[at_] = (value); if (Translated[at_]) budget = 0; } while (0)\n"
+    "#define PUSH(value) do { uint16_t v_ = (value); "
+    "STORE((uint16_t)(sp - 1), v_ >> 8); STORE((uint16_t)(sp - 2), v_ & 0xff); "
+    "sp -= 2; } while (0)\n"
+    "#define POP() (sp += 2, (uint16_t)(memory[(uint16_t)(sp - 2)] | "
+    "memory[(uint16_t)(sp - 1)] << 8))\n"
+    "#define ADD(v, carry) do { uint8_t v_ = (v); "
+    "uint16_t r_ = a + v_ + (carry); "
+    "f = ZSPTable[r_ & 0xff] | ACAddTable[((a & 8) >> 3) | ((v_ & 8) >> 2) | "
+    "((r_ & 8) >> 1)] | ((r_ >> 8) & 1); a = (uint8_t)r_; } while (0)\n"
+    "#define SUBTRACT(v, borrow) uint8_t v_ = (v); "
+    "uint16_t r_ = a - v_ - (borrow); "
+    "f = ZSPTable[r_ & 0xff] | ACSubTable[((a & 8) >> 3) | ((v_ & 8) >> 2) | "
+    "((r_ & 8) >> 1)] | ((r_ >> 8) & 1)\n"
+    "#define SUB(v, borrow) do { SUBTRACT(v, borrow); a = (uint8_t)r_; } "
+    "while (0)\n"
+    "#define CMP(v) do { SUBTRACT(v, 0); } while (0)\n"
+    "#define ANA(v) do { uint8_t v_ = (v); "
+    "uint8_t ac_ = ((a | v_) & 8) << 1; a &= v_; f = ZSPTable[a] | ac_; } "
+    "while (0)\n"
+    "#define XRA(v) do { a ^= (v); f = ZSPTable[a]; } while (0)\n"
+    "#define ORA(v) do { a |= (v); f = ZSPTable[a]; } while (0)\n"
+    "#define INR(x) do { x++; f = (f & 1) | ZSPTable[x] | "
+    "((x & 0x0f) == 0 ? 0x10 : 0); } while (0)\n"
+    "#define DCR(x) do { x--; f = (f & 1) | ZSPTable[x] | "
+    "((x & 0x0f) != 0x0f ? 0x10 : 0); } while (0)\n"
+    "#define DAD(rp) do { uint32_t r_ = HL + (rp); "
+    "f = (f & ~1) | (r_ >> 16); h = (uint8_t)(r_ >> 8); l = (uint8_t)r_; } "
+    "while (0)\n"
+    "#define DAA() do { uint8_t fix_ = 0, cy_ = f & 1; "
+    "if ((f & 0x10) || (a & 0x0f) > 9) fix_ += 0x06; "
+    "if ((f & 1) || (a >> 4) > 9 || ((a >> 4) >= 9 && (a & 0x0f) > 9)) "
+    "{ fix_ += 0x60; cy_ = 1; } "
+    "ADD(fix_, 0); f = (f & ~1) | cy_; } while (0)\n\n");
+}
+
+/*
+ * Function:  EmitRun
+ * ------------------
+ *  Emits Run(), holding every translated block, the dispatch switch
+ *  for computed jumps and the fallback interpreter
+ *
+ *  returns: void
+ */
+void EmitRun(void)
+{
+  printf(
+    "/*\n"
+    "  Runs until limit instructions have been executed or the processor\n"
+    "  halts. Blocks only run when they fit the limit, the interpreter\n"
+    "  steps up to it\n"
+    "*/\n"
+    "static void Run(Machine *m, uint64_t limit)\n"
+    "{\n"
+    "  uint8_t a = m->a, b = m->b, c = m->c, d = m->d, e = m->e;\n"
+    "  uint8_t h = m->h, l = m->l, f = m->f;\n"
+    "  uint16_t sp = m->sp, pc = m->pc;\n"
+    "  uint8_t int_enable = m->int_enable, halted = m->halted;\n"
+    "  uint64_t executed = m->executed, cycles = m->cycles;\n"
+    "  static uint64_t budget = UINT64_MAX; // 0 once code was written\n"
+    "\n"
+    "  if (budget != 0) {\n"
+    "    budget = limit;\n"
+    "  }\n"
+    "\n"
+    "dispatch:\n"
+    "  if (executed >= limit || halted) {\n"
+    "    goto done;\n"
+    "  }\n"
+    "  if (budget != 0) {\n"
+    "    switch (pc) {\n");
+  for (int addr = 0; addr < 0x10000; addr++) {
+    if (Leader[addr]) {
+      printf("      case 0x%04x: goto L_%04x;\n", addr, addr);
+    }
+  }
+  printf("    }\n  }\n");
+
+  EmitInterpreter();
+  printf("\n");
+
+  for (int addr = 0; addr < 0x10000; addr++) {
+    if (Leader[addr]) {
+      EmitBlock(addr);
+    }
+  }
+
+  printf(
+    "done:\n"
+    "  m->a = a; m->b = b; m->c = c; m->d = d; m->e = e;\n"
+    "  m->h = h; m->l = l; m->f = f;\n"
+    "  m->sp = sp; m->pc = pc;\n"
+    "  m->int_enable = int_enable; m->halted = halted;\n"
+    "  m->executed = executed; m->cycles = cycles;\n"
+    "}\n\n");
+}
+
+/*
+ * Function:  EmitMain
+ * -------------------
+ *  Emits main(), which loads the image, runs it and reports speed and
+ *  final state the same way as the emulators
+ *
+ *  entry: address execution starts at
+ *
+ *  returns: void
+ */
+void EmitMain(uint16_t entry)
+{
+  printf(
+    "static double Seconds(void)\n"
+    "{\n"
+    "  struct timespec ts;\n"
+    "  clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+    "  return ts.tv_sec + ts.tv_nsec / 1e9;\n"
+    "}\n\n"
+    "int main(int argc, char **argv)\n"
+    "{\n"
+    "  uint64_t limit = UINT64_MAX;\n"
+    "  Machine m = {0};\n"
+    "\n"
+    "  /* Parse options: -n N stops after N instructions */\n"
+    "  for (int i = 1; i < argc; i++) {\n"
+    "    if (strcmp(argv[i], \"-n\") == 0 && i + 1 < argc) {\n"
+    "      limit = strtoull(argv[++i], NULL, 0);\n"
+    "    }\n"
+    "    else {\n"
+    "      fprintf(stderr, \"Usage: %%s [-n instructions]\\n\", argv[0]);\n"
+    "      exit(EXIT_FAILURE);\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  memcpy(&memory[ORIGIN], Image, sizeof(Image));\n");
+  if (cpm) {
+    printf("  memory[0] = 0x76; // Warm boot(JMP $0000) lands on HLT\n");
+  }
+  printf(
+    "  for (int i = 0; CodeRanges[i][1] != 0; i++) {\n"
+    "    memset(&Translated[CodeRanges[i][0]], 1,\n"
+    "           CodeRanges[i][1] - CodeRanges[i][0] + 1);\n"
+    "  }\n"
+    "  m.pc = 0x%04x;\n"
+    "\n"
+    "  double start = Seconds();\n"
+    "  Run(&m, limit);\n"
+    "  double elapsed = Seconds() - start;\n"
+    "\n"
+    "  fprintf(stderr, \"%%llu instructions, %%llu cycles in %%.3f s \"\n"
+    "          \"(%%.2f MIPS, %%.1fx a 2 MHz 8080)\\n\",\n"
+    "          (unsigned long long)m.executed, (unsigned long long)m.cycles,\n"
+    "          elapsed, m.executed / elapsed / 1e6,\n"
+    "          m.cycles / elapsed / 2e6);\n"
+    "  fprintf(stderr, \"Final state: A=$%%02x BC=$%%02x%%02x DE=$%%02x%%02x \"\n"
+    "          \"HL=$%%02x%%02x SP=$%%04x PC=$%%04x PSW=$%%02x\\n\",\n"
+    "          m.a, m.b, m.c, m.d, m.e, m.h, m.l, m.sp, m.pc, m.f);\n"
+    "\n"
+    "  return 0;\n"
+    "}\n", entry);
+}
@@ -6,10 +6,20 @@
 
   An emulator based on the Intel8080 architecture
   We use the classical arcade game Space Invader to test the emulator
+  The CPU core lives in libi8080(../libi8080), the cabinet's hardware is
+  attached to its I/O ports and interrupts
 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "../libi8080/i8080.h"
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define VIDEO_SIMD // SSE2 and AVX2 renderers
+#endif
 
 
 /* Definitions */
@@ -18,65 +28,321 @@
 #define FILE_NAME3 "invaders.f"
 #define FILE_NAME4 "invaders.e"
 
+/* The video hardware interrupts twice a frame, 60 frames a second at 2 MHz */
+#define CYCLES_PER_FRAME 33333
+#define RST_MID_SCREEN 1 // Beam reaches the middle of the screen
+#define RST_VBLANK 2 // Beam reaches the bottom of the screen
+
+/* I/O ports of the shift register */
+#define PORT_SHIFT_AMOUNT 2 // OUT: bits to shift by(0-7)
+#define PORT_SHIFT_RESULT 3 // IN: the 8 bits selected
+#define PORT_SHIFT_DATA 4 // OUT: byte shifted in from the left
+
+/* Shift register accesses timed on their own(-b) */
+#define SHIFT_BENCH_ACCESSES 100000000
+
+/*
+  Video RAM: 224 lines of 256 pixels, 32 bytes a line and the lowest bit
+  first. The monitor is turned 90 degrees, so a line is a column of the
+  screen drawn from the bottom up
+*/
+#define VRAM_START 0x2400
+#define VRAM_LINE 32
+#define VRAM_SIZE (SCREEN_WIDTH * VRAM_LINE)
+#define SCREEN_WIDTH 224
+#define SCREEN_HEIGHT 256
+#define SCREEN_PIXELS (SCREEN_WIDTH * SCREEN_HEIGHT)
+
+/* Colour indices of the framebuffer(palette) */
+#define COLOUR_BLACK 0
+#define COLOUR_WHITE 1
+#define COLOUR_RED 2
+#define COLOUR_GREEN 3
+#define COLOURS 4
+
+/* Frames rendered by every renderer(-b) */
+#define RENDER_BENCH_FRAMES 20000
+
+/* Frame files(-d): binary PPM, or PNG of 2 bit palette indices */
+#define PPM_SIZE (32 + SCREEN_PIXELS * 3)
+#define PNG_ROW (1 + SCREEN_WIDTH / 4) // Filter byte and 4 pixels a byte
+#define PNG_DATA (SCREEN_HEIGHT * PNG_ROW)
+#define PNG_SIZE (8 + 25 + 12 + COLOURS * 3 + 12 + 11 + PNG_DATA + 12)
+#define PATH_SIZE 256
+
+/*
+  Real time pacing: a frame lasts CYCLES_PER_FRAME cycles of the 2 MHz
+  clock. The host sleeps until shortly before each frame's deadline and
+  spins through the rest, sleeps overshoot by tens of microseconds
+*/
+#define CPU_HZ 2000000.0
+#define SPIN_MARGIN 0.0005 // Seconds spun before a deadline
+#define MAX_BEHIND 4 // Frames late before the pacer gives up catching up
+#define JITTER_BUCKET 0.00001 // Histogram of wake up lateness, 10 us wide
+#define JITTER_BUCKETS 200
+
 
 /* Struct definitions */
-typedef struct ConditionFlags {
-  uint8_t z:1; // Zero condition bit
-  uint8_t s:1; // Sign condtion bit
-  uint8_t p:1; // Parity condtion bit
-  uint8_t cy:1; // Carry condtion bit
-  uint8_t ac:1; // Auxiliary carry condtion bit
-  uint8_t pad:3; // Padding bits
-} ConditionFlags;
-
-typedef struct States {
-  uint8_t a; // Accumulator register
-  uint8_t b; // Register B(register pair BC)
-  uint8_t c; // Register C
-  uint8_t d; // Register D(register pair DE)
-  uint8_t e; // Register E
-  uint8_t h; // Register H(register pair HL)
-  uint8_t l; // Register L
-  uint16_t sp; // Stack pointer
-  uint16_t pc; // Program counter
-  uint8_t *memory;
-  struct ConditionFlags cc;
-  uint8_t int_enable; // Enable feature(for particular OpCodes)
-} States;
+
+/*
+  External 16 bit shift register drawing the sprites at any bit offset
+  Each byte written lands in the upper half and pushes the previous one
+  to the lower half, reads return 8 bits starting offset bits from the top
+*/
+typedef struct ShiftRegister {
+  uint16_t value; // Last two bytes written
+  uint8_t offset; // Bits to shift by
+  uint64_t accesses; // Reads and writes(benchmark)
+} ShiftRegister;
+
+typedef struct Cabinet {
+  uint8_t inputs[3]; // Ports 0-2: buttons, coin slot and DIP switches
+  ShiftRegister shifter;
+} Cabinet;
+
+/* Converts video RAM into a frame of colour indices */
+typedef void (*Renderer)(const uint8_t *vram, const uint8_t *gel,
+                         uint8_t *frame);
+
+/*
+  Screen of the cabinet: 224x256 colour indices, top row first
+  The monitor is black and white, strips of coloured gel on the glass
+  give each area of the screen its colour
+*/
+typedef struct Video {
+  uint8_t gel[SCREEN_PIXELS]; // Colour of every pixel when it's lit
+  uint8_t frame[SCREEN_PIXELS];
+  Renderer render; // Fastest renderer of the host
+  const char *kernel; // Its name
+} Video;
+
+/* Writes rendered frames to files, without a display */
+typedef struct Dumper {
+  const char *prefix; // Files are prefix000000.ppm and on, NULL for none
+  int png; // PNG instead of PPM
+  int every; // Frames between two dumps
+  int changed; // Skip frames whose video RAM didn't change
+  int dumped; // vram holds the last frame dumped
+  uint8_t vram[VRAM_SIZE];
+  uint8_t *buffer; // Image of a file(PPM_SIZE)
+  uint64_t written; // Files written
+  double seconds; // Time spent encoding and writing
+} Dumper;
+
+/* Keeps the frames in step with the wall clock */
+typedef struct Pacer {
+  double period; // Seconds a frame
+  double spin; // Seconds spun instead of slept before a deadline
+  double deadline; // When the current frame ends
+  uint64_t frames; // Frames paced
+  uint64_t late; // Frames whose emulation overran their deadline
+  uint64_t resyncs; // Times the pacer dropped the frames it was behind
+  double jitter_sum; // Lateness of the wake ups, in seconds
+  double jitter_max;
+  uint64_t histogram[JITTER_BUCKETS + 1]; // Last bucket counts the rest
+} Pacer;
+
+/* RGB colours of the gel strips, by colour index */
+static const uint8_t palette[COLOURS][3] = {
+  { 0x00, 0x00, 0x00 }, { 0xff, 0xff, 0xff },
+  { 0xff, 0x20, 0x20 }, { 0x20, 0xff, 0x20 }
+};
 
 
 /* Function declarations */
-void IncompleteInstruction(States *state);
-int Parity8b(int x);
-int Parity16b(int x);
-void ReadIntoMemory(States *state, char *filename, uint32_t offset);
-int Disassembler(uint8_t *codebuffer, int pc);
-int Emulator(States *state);
+uint8_t ReadInputs(void *context, uint8_t port);
+void WriteShiftAmount(void *context, uint8_t port, uint8_t value);
+void WriteShiftData(void *context, uint8_t port, uint8_t value);
+uint8_t ReadShiftResult(void *context, uint8_t port);
+void BenchmarkShifter(States *state, Ports *ports, Cabinet *cabinet,
+                      int frames);
+void InitVideo(Video *video);
+void RenderFrame(Video *video, const uint8_t *memory);
+void RenderScalar(const uint8_t *vram, const uint8_t *gel, uint8_t *frame);
+#ifdef VIDEO_SIMD
+void RenderSse2(const uint8_t *vram, const uint8_t *gel, uint8_t *frame);
+void RenderAvx2(const uint8_t *vram, const uint8_t *gel, uint8_t *frame);
+#endif
+void BenchmarkRenderer(const uint8_t *memory);
+void RunFrames(States *state, uint64_t frames, int skip, Dumper *dumper,
+               Pacer *pacer);
+void InitPacer(Pacer *pacer, double spin);
+void PaceFrame(Pacer *pacer);
+void ReportPacer(const Pacer *pacer, double elapsed, double cpu);
+double JitterPercentile(const Pacer *pacer, double percentile);
+double CpuSeconds(void);
+int DumpFrame(Dumper *dumper, Video *video, const uint8_t *memory,
+              uint64_t frame);
+size_t EncodePpm(const uint8_t *frame, uint8_t *buffer);
+size_t EncodePng(const uint8_t *frame, uint8_t *buffer);
+size_t PngChunk(uint8_t *chunk, const char *type, uint32_t size);
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size);
+void PutBig32(uint8_t *p, uint32_t value);
+void TraceState(States *state, uint16_t pc);
+double Seconds(void);
 
 
 int main(int argc, char **argv){
 
-  int EOI = 0; // End Of Instruction
+  uint64_t count = 0; // Number of instructions executed
+  uint64_t limit = UINT64_MAX; // Instruction limit
+  int bench = 0; // Frames run to benchmark the shift register
+  uint64_t frames = 0; // Frames to run, 0 runs instructions
+  Dumper dumper = { NULL, 0, 1, 0, 0, { 0 }, NULL, 0, 0 };
+  double spin = SPIN_MARGIN; // Seconds spun before every frame deadline
+  int turbo = 0; // Frames rendered 1 in turbo, 0 paces in real time
+  void (*trace)(States *state, uint16_t pc) = NULL;
+
+  /*
+    Parse options: -t enables tracing, -n N stops after N instructions,
+    -b N measures the cost of the shift register over N frames, then of
+    rendering the screen, -f N runs N frames in real time(-s us spun
+    before each deadline) or as fast as possible rendering 1 in N(-x N),
+    -d prefix writes them to files(-o ppm or png), every Nth one(-e N) or
+    those that changed(-c)
+  */
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0) {
+      trace = TraceState;
+    }
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      limit = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      bench = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      frames = strtoull(argv[++i], NULL, 0);
+    }
+    else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      dumper.prefix = argv[++i];
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc &&
+             (strcmp(argv[i + 1], "ppm") == 0 ||
+              strcmp(argv[i + 1], "png") == 0)) {
+      dumper.png = strcmp(argv[++i], "png") == 0;
+    }
+    else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc &&
+             atoi(argv[i + 1]) > 0) {
+      dumper.every = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "-c") == 0) {
+      dumper.changed = 1;
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      spin = atof(argv[++i]) / 1e6;
+    }
+    else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc &&
+             atoi(argv[i + 1]) > 0) {
+      turbo = atoi(argv[++i]);
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-t] [-n instructions] [-b frames] "
+              "[-f frames] [-s us] [-x N] [-d prefix] [-o ppm|png] [-e N] "
+              "[-c]\n",
+              argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  /* Allocate and initialize memory */
-  States *state = calloc(1, sizeof(States));
-  /* Allocate for 16bits address/64Kbytes */
-  state->memory = malloc(0x10000);
+  /* Allocate for 16bits address/64Kbytes, the machine works on it */
+  uint8_t *memory = calloc(1, 0x10000);
+  States *state = malloc(sizeof(States));
+  InitState(state, memory);
+  state->trace = trace;
 
   /* Read Space Invaders according to memory mapping */
-  ReadIntoMemory(state, FILE_NAME1, 0);
-  ReadIntoMemory(state, FILE_NAME2, 0x800);
-  ReadIntoMemory(state, FILE_NAME3, 0x1000);
-  ReadIntoMemory(state, FILE_NAME4, 0x1800);
+  const char *files[4] = { FILE_NAME1, FILE_NAME2, FILE_NAME3, FILE_NAME4 };
+  for (int i = 0; i < 4; i++) {
+    if (ReadIntoMemory(memory, files[i], 0x800 * i) < 0) {
+      fprintf(stderr, "Can't read %s\n", files[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
 
   /*
-    Loop until end of program
-    Or until emulator reads incomplete instruction
+    Cabinet inputs, nothing pressed: bit 3 of port 1 always reads 1,
+    port 2 selects 3 ships and the extra ship at 1500 points
   */
-  while ( EOI == 0 ){
-    EOI = Emulator(state);
+  Cabinet cabinet = { { 0x0e, 0x08, 0x00 }, { 0, 0, 0 } };
+  Ports ports;
+  InitPorts(&ports);
+  for (int port = 0; port < 3; port++) {
+    MapInput(&ports, port, ReadInputs, &cabinet);
+  }
+  MapOutput(&ports, PORT_SHIFT_AMOUNT, WriteShiftAmount, &cabinet.shifter);
+  MapOutput(&ports, PORT_SHIFT_DATA, WriteShiftData, &cabinet.shifter);
+  MapInput(&ports, PORT_SHIFT_RESULT, ReadShiftResult, &cabinet.shifter);
+  state->ports = &ports;
+
+  /* Mid-screen and vblank interrupts, half a frame apart */
+  ScheduleInterrupt(state, CYCLES_PER_FRAME / 2, CYCLES_PER_FRAME,
+                    RST_MID_SCREEN);
+  ScheduleInterrupt(state, CYCLES_PER_FRAME, CYCLES_PER_FRAME, RST_VBLANK);
+
+  /* Run from the fastest core built into the library */
+  int error = AttachJit(state);
+  if (error == I8080_ERROR_MEMORY) {
+    fprintf(stderr, "Can't map executable memory, interpreting instead\n");
+  }
+  if (error != I8080_OK && AttachBlockCache(state) == I8080_ERROR_MEMORY) {
+    fprintf(stderr, "Can't allocate block cache, interpreting instead\n");
   }
 
+  if (bench > 0) {
+    BenchmarkShifter(state, &ports, &cabinet, bench);
+    BenchmarkRenderer(memory);
+    ReleaseState(state);
+    free(state);
+    free(memory);
+    return 0;
+  }
+
+  if (frames > 0 || dumper.prefix != NULL) {
+    Pacer pacer;
+    InitPacer(&pacer, spin);
+    RunFrames(state, frames > 0 ? frames : UINT64_MAX, turbo ? turbo : 1,
+              &dumper, turbo ? NULL : &pacer);
+  }
+  else {
+    /* Loop until the limit, or until the machine halts or fails */
+    double start = Seconds();
+    while (state->halted == 0 && state->error == I8080_OK && count < limit) {
+      count += Emulator(state, limit - count);
+    }
+    double elapsed = Seconds() - start;
+
+    fprintf(stderr, "%llu instructions, %llu cycles in %.3f s "
+            "(%.2f MIPS, %.1fx a 2 MHz 8080)\n",
+            (unsigned long long)count, (unsigned long long)state->cycles,
+            elapsed, count / elapsed / 1e6, state->cycles / elapsed / 2e6);
+  }
+  if (state->error != I8080_OK) {
+    fprintf(stderr, "Emulation stopped with error %d\n", state->error);
+  }
+
+  Statistics stats;
+  ReadStatistics(state, &stats);
+  if (state->jit != NULL) {
+    fprintf(stderr, "JIT: %llu blocks translated, %llu invalidations, "
+            "%llu flushes, %llu instructions interpreted\n",
+            (unsigned long long)stats.blocks,
+            (unsigned long long)stats.invalidations,
+            (unsigned long long)stats.flushes,
+            (unsigned long long)stats.interpreted);
+  }
+  if (state->cache != NULL) {
+    fprintf(stderr, "Block cache: %llu hits, %llu misses(%.2f%% hit rate), "
+            "%llu invalidations\n",
+            (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+            100.0 * stats.hits / (stats.hits + stats.misses),
+            (unsigned long long)stats.invalidations);
+  }
+
+  ReleaseState(state);
+  free(state);
+  free(memory);
+
   return 0;
 }
 
@@ -84,1048 +350,841 @@ int main(int argc, char **argv){
 /* Function implementation */
 
 /*
- * Function:  IncompleteInstruction
- * --------------------------------
- *  Halts emulation for any incomplete or uninplemented instruction
+ * Function: ReadInputs
+ * --------------------
+ *  Input ports 0-2 of the cabinet(IN handler)
  *
- *  state: state of Intel8080 machine
+ *  context: the cabinet
+ *  port: port read
  *
- *  returns: void - exits emulation
+ *  returns: state of the buttons, coin slot and DIP switches on the port
  */
-void IncompleteInstruction(States *state)
+uint8_t ReadInputs(void *context, uint8_t port)
 {
-  state->pc -= 1; // undoing PC increment
-  printf("Error: Incomplete Instruction-Emulation Halted\n");
-  Disassembler(state->memory, state->pc);
-  EXIT_FAILURE;
+  const Cabinet *cabinet = context;
+  return cabinet->inputs[port];
 }
 
 /*
- * Function: Parity8b
- * ------------------
- *  Tests wether an input is even or odd parity bit
+ * Function: WriteShiftAmount
+ * --------------------------
+ *  Sets how many bits the shift register shifts by(OUT handler)
  *
- *  x: 8 bit interger
+ *  context: the shift register
+ *  port: port written
+ *  value: shift amount in the low 3 bits
  *
- *  returns: 1 if even parity, else
- *           0
+ *  returns: void
  */
-int Parity8b(int x)
+void WriteShiftAmount(void *context, uint8_t port, uint8_t value)
 {
-  x ^= x >> 4;
-  x ^= x >> 1;
-  x ^= x >> 2;
-  return (~x) & 1;
+  ShiftRegister *shifter = context;
+  (void)port;
+
+  shifter->offset = value & 7;
+  shifter->accesses++;
 }
 
 /*
- * Function: Parity16b
- * -------------------
- *  Tests wether an input is even or odd parity bit
+ * Function: WriteShiftData
+ * ------------------------
+ *  Shifts a byte into the top of the shift register(OUT handler)
  *
- *  x: 16 bit integer
+ *  context: the shift register
+ *  port: port written
+ *  value: byte shifted in
  *
- *  returns: 1 if even parity, else
- *           0
+ *  returns: void
  */
-int Parity16b(int x)
+void WriteShiftData(void *context, uint8_t port, uint8_t value)
 {
-  x ^= x >> 8;
-  x ^= x >> 4;
-  x ^= x >> 1;
-  x ^= x >> 2;
-  return (~x) & 1;
+  ShiftRegister *shifter = context;
+  (void)port;
+
+  shifter->value = (value << 8) | (shifter->value >> 8);
+  shifter->accesses++;
 }
 
 /*
- * Function:  ReadIntoMemory
+ * Function: ReadShiftResult
  * -------------------------
- *  State machine of emulator
- *  Will read from ROM and store into memory
+ *  Reads the shift register(IN handler)
  *
- *  state: state of Intel8080 machine
+ *  context: the shift register
+ *  port: port read
  *
- *  returns: void - exits emulation
+ *  returns: the 8 bits starting offset bits below the top
  */
-void ReadIntoMemory(States *state, char *filename, uint32_t offset)
+uint8_t ReadShiftResult(void *context, uint8_t port)
 {
-  // Open file and verify status
-  FILE *fp = fopen(filename, "rb");
-  if(fp == NULL){
-    printf("Can't open %s\n", filename);
-    exit(EXIT_FAILURE);
+  ShiftRegister *shifter = context;
+  (void)port;
+
+  shifter->accesses++;
+  return (shifter->value >> (8 - shifter->offset)) & 0xff;
+}
+
+/*
+ * Function: BenchmarkShifter
+ * --------------------------
+ *  Runs frames of the game to count the shift register accesses per
+ *  frame, then times the same accesses through the port table alone,
+ *  giving the share of a frame spent in the shift register
+ *
+ *  state: state of Intel8080 machine, ready to run
+ *  ports: port dispatch table of the machine
+ *  cabinet: hardware of the machine
+ *  frames: frames to run
+ *
+ *  returns: void
+ */
+void BenchmarkShifter(States *state, Ports *ports, Cabinet *cabinet,
+                      int frames)
+{
+  ShiftRegister *shifter = &cabinet->shifter;
+  double start = Seconds();
+  for (int i = 0; i < frames; i++) {
+    EmulateCycles(state, CYCLES_PER_FRAME);
   }
+  double frame = (Seconds() - start) / frames;
+  double accesses = (double)shifter->accesses / frames;
 
-  // Get file size
-  fseek(fp, 0L, SEEK_END);
-  int fsize = ftell(fp);
+  /* The sprite routines write the amount, then data and read it back */
+  volatile uint8_t sink = 0; // Keeps the reads
+  start = Seconds();
+  for (int i = 0; i < SHIFT_BENCH_ACCESSES / 4; i++) {
+    ports->output[PORT_SHIFT_AMOUNT](ports->output_context[PORT_SHIFT_AMOUNT],
+                                     PORT_SHIFT_AMOUNT, i);
+    ports->output[PORT_SHIFT_DATA](ports->output_context[PORT_SHIFT_DATA],
+                                   PORT_SHIFT_DATA, i >> 3);
+    ports->output[PORT_SHIFT_DATA](ports->output_context[PORT_SHIFT_DATA],
+                                   PORT_SHIFT_DATA, sink);
+    sink += ports->input[PORT_SHIFT_RESULT](
+              ports->input_context[PORT_SHIFT_RESULT], PORT_SHIFT_RESULT);
+  }
+  double access = (Seconds() - start) / SHIFT_BENCH_ACCESSES;
 
-  // Return to beginning of file to read into memory buffer
-  fseek(fp, 0L, SEEK_SET);
-  uint8_t *buffer = &state->memory[offset];
+  printf("Emulated %d frames: %.1f us of host time per frame\n", frames,
+         frame * 1e6);
+  printf("Shift register: %.0f accesses per frame, %.2f ns per access, "
+         "%.2f us per frame(%.4f%% of a 60 Hz frame, %.1f%% of the "
+         "emulation)\n", accesses, access * 1e9, accesses * access * 1e6,
+         100.0 * accesses * access * 60, 100.0 * accesses * access / frame);
+}
 
-  // Read file into buffer
-  fread(buffer, fsize, 1, fp);
-  fclose(fp);
+/*
+ * Function: InitVideo
+ * -------------------
+ *  Lays the gel strips of the cabinet over the screen and picks the
+ *  fastest renderer of the host: red over the scores and the UFO, green
+ *  over the shields and the player, and over the ships left at the bottom
+ *
+ *  video: screen to set up
+ *
+ *  returns: void
+ */
+void InitVideo(Video *video)
+{
+  for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+      uint8_t colour = COLOUR_WHITE;
+      if (y >= 32 && y < 64) {
+        colour = COLOUR_RED;
+      }
+      else if ((y >= 184 && y < 240) || (y >= 240 && x >= 16 && x < 134)) {
+        colour = COLOUR_GREEN;
+      }
+      video->gel[y * SCREEN_WIDTH + x] = colour;
+    }
+  }
+  memset(video->frame, COLOUR_BLACK, SCREEN_PIXELS);
+
+  video->render = RenderScalar;
+  video->kernel = "scalar";
+#ifdef VIDEO_SIMD
+  video->render = RenderSse2;
+  video->kernel = "sse2";
+  if (__builtin_cpu_supports("avx2")) {
+    video->render = RenderAvx2;
+    video->kernel = "avx2";
+  }
+#endif
+}
+
+/*
+ * Function: RenderFrame
+ * ---------------------
+ *  Draws the video RAM of the machine into the frame
+ *
+ *  video: screen to draw
+ *  memory: 64 KB of the machine
+ *
+ *  returns: void
+ */
+void RenderFrame(Video *video, const uint8_t *memory)
+{
+  video->render(memory + VRAM_START, video->gel, video->frame);
 }
 
 /*
- * Function: Disassembler
+ * Function: RenderScalar
  * ----------------------
- *  Reads machine code and disassembles it to 8080 assembly instruction code
+ *  Reference renderer, one pixel at a time
  *
- *  codebuffer: pointer to the 8080 assembly ROM from a memory buffer
- *  pc: the current program counter
+ *  vram: video RAM(7 KB)
+ *  gel: colour of every lit pixel
+ *  frame: colour indices drawn
  *
- *  returns: returns the number of bytes
- *           required from the OpCode(to increment PC)
+ *  returns: void
  */
-int Disassembler(uint8_t *codebuffer, int pc)
+void RenderScalar(const uint8_t *vram, const uint8_t *gel, uint8_t *frame)
 {
-  uint8_t *code = &codebuffer[pc];
-  int opbytes = 1; // Default OpCode size in bytes
-
-  printf("%04x ", pc); // Prints current instruction location
-  switch(*code)
-  {
-    case 0x00: printf("NOP"); break;
-    case 0x01: printf("LXI B,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x02: printf("STAX B"); break;
-    case 0x03: printf("INX B"); break;
-    case 0x04: printf("INR B"); break;
-    case 0x05: printf("DCR B"); break;
-    case 0x06: printf("MVI B,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x07: printf("RLC"); break;
-    case 0x08: break; // Free OpCode
-    case 0x09: printf("DAD B"); break;
-    case 0x0a: printf("LDAX B"); break;
-    case 0x0b: printf("DCX B"); break;
-    case 0x0c: printf("INR C"); break;
-    case 0x0d: printf("DCR C"); break;
-    case 0x0e: printf("MCI C,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x0f: printf("RRC"); break;
-    case 0x10: break; // Free OpCode
-    case 0x11: printf("LXI D,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x12: printf("STAX D"); break;
-    case 0x13: printf("INX D"); break;
-    case 0x14: printf("INR D"); break;
-    case 0x15: printf("DCR D"); break;
-    case 0x16: printf("MVI D,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x17: printf("RAL"); break;
-    case 0x18: break; // Free OpCode
-    case 0x19: printf("DAD D"); break;
-    case 0x1a: printf("LDAX D"); break;
-    case 0x1b: printf("DCX D"); break;
-    case 0x1c: printf("INR E"); break;
-    case 0x1d: printf("DCR E"); break;
-    case 0x1e: printf("MVI E,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x1f: printf("RAR"); break;
-    case 0x20: break; // Free OpCode
-    case 0x21: printf("LXI H,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x22: printf("SHLD $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x23: printf("INX H"); break;
-    case 0x24: printf("INR H"); break;
-    case 0x25: printf("DCR H"); break;
-    case 0x26: printf("MVI H,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x27: printf("DAA"); // Allows decimal arithmetic
-    case 0x28: break; // Free OpCode
-    case 0x29: printf("DAD H"); break;
-    case 0x2a: printf("LHLD $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x2b: printf("DCX H"); break;
-    case 0x2c: printf("INR L"); break;
-    case 0x2d: printf("DCR L"); break;
-    case 0x2e: printf("MVI L,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x2f: printf("CMA"); break;
-    case 0x30: break; // Free OpCode
-    case 0x31: printf("LXI SP,$%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x32: printf("STA $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x33: printf("INX SP"); break;
-    case 0x34: printf("INR M"); break;
-    case 0x35: printf("DCR M"); break;
-    case 0x36: printf("MVI M,$%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x37: printf("STC"); break;
-    case 0x38: break; // Free OpCode
-    case 0x39: printf("DAD SP"); break;
-    case 0x3a: printf("LDA $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0x3b: printf("DCX SP"); break;
-    case 0x3c: printf("INR A"); break;
-    case 0x3d: printf("DCR A"); break;
-    case 0x3e: printf("MVI A, $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0x3f: printf("CMC"); break;
-    case 0x40: printf("MOV B,B"); break;
-    case 0x41: printf("MOV B,C"); break;
-    case 0x42: printf("MOV B,D"); break;
-    case 0x43: printf("MOV B,E"); break;
-    case 0x44: printf("MOV B,H"); break;
-    case 0x45: printf("MOV B,L"); break;
-    case 0x46: printf("MOV B,M"); break;
-    case 0x47: printf("MOV B,A"); break;
-    case 0x48: printf("MOV C,B"); break;
-    case 0x49: printf("MOV C,C"); break;
-    case 0x4a: printf("MOV C,D"); break;
-    case 0x4b: printf("MOV C,E"); break;
-    case 0x4c: printf("MOV C,H"); break;
-    case 0x4d: printf("MOV C,L"); break;
-    case 0x4e: printf("MOV C,M"); break;
-    case 0x4f: printf("MOV C,A"); break;
-    case 0x50: printf("MOV D,B"); break;
-    case 0x51: printf("MOV D,C"); break;
-    case 0x52: printf("MOV D,D"); break;
-    case 0x53: printf("MOV D,E"); break;
-    case 0x54: printf("MOV D,H"); break;
-    case 0x55: printf("MOV D,L"); break;
-    case 0x56: printf("MOV D,M"); break;
-    case 0x57: printf("MOV D,A"); break;
-    case 0x58: printf("MOV E,B"); break;
-    case 0x59: printf("MOV E,C"); break;
-    case 0x5a: printf("MOV E,D"); break;
-    case 0x5b: printf("MOV E,E"); break;
-    case 0x5c: printf("MOV E,H"); break;
-    case 0x5d: printf("MOV E,L"); break;
-    case 0x5e: printf("MOV E,M"); break;
-    case 0x5f: printf("MOV E,A"); break;
-    case 0x60: printf("MOV H,B"); break;
-    case 0x61: printf("MOV H,C");	break;
-    case 0x62: printf("MOV H,D"); break;
-    case 0x63: printf("MOV H,E"); break;
-    case 0x64: printf("MOV H,H"); break;
-    case 0x65: printf("MOV H,L"); break;
-    case 0x66: printf("MOV H,M"); break;
-    case 0x67: printf("MOV H,A"); break;
-    case 0x68: printf("MOV L,B"); break;
-    case 0x69: printf("MOV L,C"); break;
-    case 0x6a: printf("MOV L,D"); break;
-    case 0x6b: printf("MOV L,E"); break;
-    case 0x6c: printf("MOV L,H"); break;
-    case 0x6d: printf("MOV L,L"); break;
-    case 0x6e: printf("MOV L,M"); break;
-    case 0x6f: printf("MOV L,A"); break;
-    case 0x70: printf("MOV M,B"); break;
-    case 0x71: printf("MOV M,C"); break;
-    case 0x72: printf("MOV M,D"); break;
-    case 0x73: printf("MOV M,E"); break;
-    case 0x74: printf("MOV M,H"); break;
-    case 0x75: printf("MOV M,L"); break;
-    case 0x76: printf("HLT"); break;
-    case 0x77: printf("MOV M,A"); break;
-    case 0x78: printf("MOV A,B"); break;
-    case 0x79: printf("MOV A,C"); break;
-    case 0x7a: printf("MOV A,D"); break;
-    case 0x7b: printf("MOV A,E"); break;
-    case 0x7c: printf("MOV A,H"); break;
-    case 0x7d: printf("MOV A,L"); break;
-    case 0x7e: printf("MOV A,M"); break;
-    case 0x7f: printf("MOV A,A"); break;
-    case 0x80: printf("ADD B"); break;
-    case 0x81: printf("ADD C"); break;
-    case 0x82: printf("ADD D"); break;
-    case 0x83: printf("ADD E"); break;
-    case 0x84: printf("ADD H"); break;
-    case 0x85: printf("ADD L"); break;
-    case 0x86: printf("ADD M"); break;
-    case 0x87: printf("ADD A"); break;
-    case 0x88: printf("ADC B"); break;
-    case 0x89: printf("ADC C"); break;
-    case 0x8a: printf("ADC D"); break;
-    case 0x8b: printf("ADC E"); break;
-    case 0x8c: printf("ADC H"); break;
-    case 0x8d: printf("ADC L"); break;
-    case 0x8e: printf("ADC M"); break;
-    case 0x8f: printf("ADC A"); break;
-    case 0x90: printf("SUB B"); break;
-    case 0x91: printf("SUB C"); break;
-    case 0x92: printf("SUB D"); break;
-    case 0x93: printf("SUB E"); break;
-    case 0x94: printf("SUB H"); break;
-    case 0x95: printf("SUB L"); break;
-    case 0x96: printf("SUB M"); break;
-    case 0x97: printf("SUB A"); break;
-    case 0x98: printf("SBB B"); break;
-    case 0x99: printf("SBB C"); break;
-    case 0x9a: printf("SBB D"); break;
-    case 0x9b: printf("SBB E"); break;
-    case 0x9c: printf("SBB H"); break;
-    case 0x9d: printf("SBB L"); break;
-    case 0x9e: printf("SBB M"); break;
-    case 0x9f: printf("SBB A"); break;
-    case 0xa0: printf("ANA B"); break;
-    case 0xa1: printf("ANA C"); break;
-    case 0xa2: printf("ANA D"); break;
-    case 0xa3: printf("ANA E"); break;
-    case 0xa4: printf("ANA H"); break;
-    case 0xa5: printf("ANA L"); break;
-    case 0xa6: printf("ANA M"); break;
-    case 0xa7: printf("ANA A"); break;
-    case 0xa8: printf("XRA B"); break;
-    case 0xa9: printf("XRA C"); break;
-    case 0xaa: printf("XRA D"); break;
-    case 0xab: printf("XRA E"); break;
-    case 0xac: printf("XRA H"); break;
-    case 0xad: printf("XRA L"); break;
-    case 0xae: printf("XRA M"); break;
-    case 0xaf: printf("XRA A"); break;
-    case 0xb0: printf("ORA B"); break;
-    case 0xb1: printf("ORA C"); break;
-    case 0xb2: printf("ORA D"); break;
-    case 0xb3: printf("ORA E"); break;
-    case 0xb4: printf("ORA H"); break;
-    case 0xb5: printf("ORA L"); break;
-    case 0xb6: printf("ORA M"); break;
-    case 0xb7: printf("ORA A"); break;
-    case 0xb8: printf("CMP B"); break;
-    case 0xb9: printf("CMP C"); break;
-    case 0xba: printf("CMP D"); break;
-    case 0xbb: printf("CMP E"); break;
-    case 0xbc: printf("CMP H"); break;
-    case 0xbd: printf("CMP L"); break;
-    case 0xbe: printf("CMP M"); break;
-    case 0xbf: printf("CMP A"); break;
-    case 0xc0: printf("RNZ"); break;
-    case 0xc1: printf("POP B"); break;
-    case 0xc2: printf("JNZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xc3: printf("JMP $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xc4: printf("CNZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xc5: printf("PUSH B"); break;
-    case 0xc6: printf("ADI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xc7: printf("RST 0"); break;
-    case 0xc8: printf("RZ"); break;
-    case 0xc9: printf("RET"); break;
-    case 0xca: printf("JZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xcb: break; // Free Opcode
-    case 0xcc: printf("CZ $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xcd: printf("CALL $%02x%02x", code[2], code[1]);
-    	         opbytes = 3;
-               break;
-    case 0xce: printf("ACI $%02x", code[1]);
-        	     opbytes = 2;
-               break;
-    case 0xcf: printf("RST 1"); break;
-    case 0xd0: printf("RNC"); break;
-    case 0xd1: printf("POP D"); break;
-    case 0xd2: printf("JNC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xd3: printf("OUT $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xd4: printf("CNC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xd5: printf("PUSH D"); break;
-    case 0xd6: printf("SUI D8");
-               opbytes = 2;
-               break;
-    case 0xd7: printf("RST 2"); break;
-    case 0xd8: printf("RC"); break;
-    case 0xd9: break; // Free OpCode
-    case 0xda: printf("JC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xdb: printf("IN $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xdc: printf("CC $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xdd: break; // Free OpCode
-    case 0xde: printf("SBI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xdf: printf("RST 3"); break;
-    case 0xe0: printf("RPO"); break;
-    case 0xe1: printf("POP H"); break;
-    case 0xe2: printf("JPO $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xe3: printf("XTHL"); break;
-    case 0xe4: printf("CPO $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xe5: printf("PUSH H"); break;
-    case 0xe6: printf("ANI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xe7: printf("RST 4"); break;
-    case 0xe8: printf("RPE"); break;
-    case 0xe9: printf("PCHL"); break;
-    case 0xea: printf("JPE $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xeb: printf("XCHG"); break;
-    case 0xec: printf("CPE $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xed: break; // Free OpCode
-    case 0xee: printf("XRI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xef: printf("RST 5"); break;
-    case 0xf0: printf("RP"); break;
-    case 0xf1: printf("POP PSW"); break;
-    case 0xf2: printf("JP $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xf3: printf("DI"); break;
-    case 0xf4: printf("CP $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xf5: printf("PUSH PSW"); break;
-    case 0xf6: printf("ORI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xf7: printf("RST 6");
-    case 0xf8: printf("RM"); break;
-    case 0xf9: printf("SPHL"); break;
-    case 0xfa: printf("JM $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xfb: printf("EI"); break;
-    case 0xfc: printf("CM $%02x%02x", code[2], code[1]);
-               opbytes = 3;
-               break;
-    case 0xfd: break; // Free OpCode
-    case 0xfe: printf("CPI $%02x", code[1]);
-               opbytes = 2;
-               break;
-    case 0xff: printf("RST 7"); break;
-    default: break;
+  for (int x = 0; x < SCREEN_WIDTH; x++) {
+    for (int i = 0; i < VRAM_LINE; i++) {
+      uint8_t byte = vram[x * VRAM_LINE + i];
+      for (int bit = 0; bit < 8; bit++) {
+        int pixel = (SCREEN_HEIGHT - 1 - (i * 8 + bit)) * SCREEN_WIDTH + x;
+        frame[pixel] = ((byte >> bit) & 1) ? gel[pixel] : COLOUR_BLACK;
+      }
+    }
   }
+}
+
+#ifdef VIDEO_SIMD
+/*
+  16x16 byte transpose, in both 128 bit lanes with AVX2
+  A round interleaves row i with row i+8, moving every byte from row r,
+  column c to row (r << 1 | c >> 3) & 15, column (c << 1 | r >> 3) & 15:
+  four rounds swap rows and columns
+*/
+#define TRANSPOSE16(type, unpacklo, unpackhi, rows)                          \
+  do {                                                                       \
+    type in_[16];                                                            \
+    for (int round_ = 0; round_ < 4; round_++) {                             \
+      memcpy(in_, rows, sizeof(in_));                                        \
+      for (int i_ = 0; i_ < 8; i_++) {                                       \
+        rows[2 * i_] = unpacklo(in_[i_], in_[i_ + 8]);                       \
+        rows[2 * i_ + 1] = unpackhi(in_[i_], in_[i_ + 8]);                   \
+      }                                                                      \
+    }                                                                        \
+  } while (0)
 
-  printf("\n");
+/*
+ * Function: RenderSse2
+ * --------------------
+ *  Renders 16 columns at a time: the lines of 16 columns are transposed
+ *  so every register holds one video RAM byte of each column, then each
+ *  bit becomes a row of 16 pixels with a compare and a mask of the gel
+ *
+ *  vram: video RAM(7 KB)
+ *  gel: colour of every lit pixel
+ *  frame: colour indices drawn
+ *
+ *  returns: void
+ */
+void RenderSse2(const uint8_t *vram, const uint8_t *gel, uint8_t *frame)
+{
+  __m128i rows[16];
 
-  return opbytes;
+  for (int x = 0; x < SCREEN_WIDTH; x += 16) {
+    for (int half = 0; half < VRAM_LINE; half += 16) {
+      for (int i = 0; i < 16; i++) {
+        rows[i] = _mm_loadu_si128((const __m128i *)
+                                  (vram + (x + i) * VRAM_LINE + half));
+      }
+      TRANSPOSE16(__m128i, _mm_unpacklo_epi8, _mm_unpackhi_epi8, rows);
+
+      for (int i = 0; i < 16; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+          int y = SCREEN_HEIGHT - 1 - ((half + i) * 8 + bit);
+          __m128i mask = _mm_set1_epi8((char)(1 << bit));
+          __m128i lit = _mm_cmpeq_epi8(_mm_and_si128(rows[i], mask), mask);
+          __m128i colour = _mm_loadu_si128((const __m128i *)
+                                           (gel + y * SCREEN_WIDTH + x));
+          _mm_storeu_si128((__m128i *)(frame + y * SCREEN_WIDTH + x),
+                           _mm_and_si128(lit, colour));
+        }
+      }
+    }
+  }
 }
 
 /*
- * Function: Emulator
+ * Function: RenderAvx2
  * --------------------
- *  Emulates the Intel8080 CPU architecture from given instructions
+ *  Renders 32 columns at a time like RenderSse2, the low lane of every
+ *  register holding columns x to x+15 and the high lane the next 16, so
+ *  the in-lane transpose leaves 32 neighbouring pixels in a register
+ *
+ *  vram: video RAM(7 KB)
+ *  gel: colour of every lit pixel
+ *  frame: colour indices drawn
+ *
+ *  returns: void
+ */
+__attribute__((target("avx2")))
+void RenderAvx2(const uint8_t *vram, const uint8_t *gel, uint8_t *frame)
+{
+  __m256i rows[16];
+
+  for (int x = 0; x < SCREEN_WIDTH; x += 32) {
+    for (int half = 0; half < VRAM_LINE; half += 16) {
+      for (int i = 0; i < 16; i++) {
+        const uint8_t *line = vram + (x + i) * VRAM_LINE + half;
+        rows[i] = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(
+                      _mm_loadu_si128((const __m128i *)line)),
+                    _mm_loadu_si128((const __m128i *)
+                                    (line + 16 * VRAM_LINE)), 1);
+      }
+      TRANSPOSE16(__m256i, _mm256_unpacklo_epi8, _mm256_unpackhi_epi8, rows);
+
+      for (int i = 0; i < 16; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+          int y = SCREEN_HEIGHT - 1 - ((half + i) * 8 + bit);
+          __m256i mask = _mm256_set1_epi8((char)(1 << bit));
+          __m256i lit = _mm256_cmpeq_epi8(_mm256_and_si256(rows[i], mask),
+                                          mask);
+          __m256i colour = _mm256_loadu_si256((const __m256i *)
+                                              (gel + y * SCREEN_WIDTH + x));
+          _mm256_storeu_si256((__m256i *)(frame + y * SCREEN_WIDTH + x),
+                              _mm256_and_si256(lit, colour));
+        }
+      }
+    }
+  }
+}
+#endif
+
+/*
+ * Function: BenchmarkRenderer
+ * ---------------------------
+ *  Renders the current video RAM with every renderer the host supports,
+ *  checks each against the scalar reference and reports its cost
+ *
+ *  memory: 64 KB of a machine that has drawn something
+ *
+ *  returns: void
+ */
+void BenchmarkRenderer(const uint8_t *memory)
+{
+  struct {
+    Renderer render;
+    const char *name;
+  } kernels[3] = { { RenderScalar, "scalar" } };
+  int nkernels = 1;
+#ifdef VIDEO_SIMD
+  kernels[nkernels].render = RenderSse2;
+  kernels[nkernels++].name = "sse2";
+  if (__builtin_cpu_supports("avx2")) {
+    kernels[nkernels].render = RenderAvx2;
+    kernels[nkernels++].name = "avx2";
+  }
+#endif
+
+  Video *video = malloc(sizeof(Video));
+  uint8_t *reference = malloc(SCREEN_PIXELS);
+  InitVideo(video);
+  RenderScalar(memory + VRAM_START, video->gel, reference);
+  int lit = 0;
+  for (int i = 0; i < SCREEN_PIXELS; i++) {
+    lit += reference[i] != COLOUR_BLACK;
+  }
+  printf("Screen: %d of %d pixels lit\n", lit, SCREEN_PIXELS);
+
+  for (int k = 0; k < nkernels; k++) {
+    memset(video->frame, 0xff, SCREEN_PIXELS);
+    double start = Seconds();
+    for (int i = 0; i < RENDER_BENCH_FRAMES; i++) {
+      kernels[k].render(memory + VRAM_START, video->gel, video->frame);
+    }
+    double frame = (Seconds() - start) / RENDER_BENCH_FRAMES;
+    int same = memcmp(video->frame, reference, SCREEN_PIXELS) == 0;
+    printf("Renderer(%s): %.2f us per frame(%.3f%% of a 60 Hz frame)%s\n",
+           kernels[k].name, frame * 1e6, 100.0 * frame * 60,
+           same ? "" : ", DIFFERS from the scalar renderer");
+  }
+
+  free(reference);
+  free(video);
+}
+
+/*
+ * Function: RunFrames
+ * -------------------
+ *  Runs the machine a frame at a time, stopping at every vblank to render
+ *  and dump the screen and wait for the end of the frame, until the frame
+ *  count or until the machine halts for good
+ *  The mid-screen and vblank interrupts are scheduled on the machine's
+ *  cycle counter, so they land on the same cycles whatever the pacing or
+ *  the frames skipped
+ *
+ *  state: state of Intel8080 machine, ready to run
+ *  frames: frames to run
+ *  skip: one frame in skip is rendered(and can be dumped)
+ *  dumper: where the frames go, prefix NULL for nowhere
+ *  pacer: wall clock pacing, NULL to run as fast as possible
+ *
+ *  returns: void
+ */
+void RunFrames(States *state, uint64_t frames, int skip, Dumper *dumper,
+               Pacer *pacer)
+{
+  uint64_t frame = 0;
+  uint64_t rendered = 0;
+  double rendering = 0; // Seconds spent rendering
+
+  Video *video = malloc(sizeof(Video));
+  if (video == NULL) {
+    fprintf(stderr, "Can't allocate the frame buffer\n");
+    exit(EXIT_FAILURE);
+  }
+  InitVideo(video);
+  if (dumper->prefix != NULL) {
+    dumper->buffer = malloc(PPM_SIZE);
+    if (dumper->buffer == NULL) {
+      fprintf(stderr, "Can't allocate the file buffer\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* The vblank interrupt is raised at the end of every frame */
+  double start = Seconds();
+  double cpu = CpuSeconds();
+  if (pacer != NULL) {
+    pacer->deadline = start + pacer->period;
+  }
+  while (frame < frames && state->error == I8080_OK &&
+         !(state->halted && !state->int_enable)) {
+    uint64_t end = (state->cycles / CYCLES_PER_FRAME + 1) * CYCLES_PER_FRAME;
+    EmulateCycles(state, (uint32_t)(end - state->cycles));
+    if (frame % skip == 0) {
+      double now = Seconds();
+      RenderFrame(video, state->memory);
+      rendering += Seconds() - now;
+      rendered++;
+      if (dumper->prefix != NULL &&
+          DumpFrame(dumper, video, state->memory, frame) < 0) {
+        fprintf(stderr, "Can't write frame %llu\n",
+                (unsigned long long)frame);
+        break;
+      }
+    }
+    if (pacer != NULL) {
+      PaceFrame(pacer);
+    }
+    frame++;
+  }
+  double elapsed = Seconds() - start;
+  cpu = CpuSeconds() - cpu;
+
+  fprintf(stderr, "%llu frames, %llu cycles in %.3f s (%.1fx a 2 MHz 8080)\n",
+          (unsigned long long)frame, (unsigned long long)state->cycles,
+          elapsed, state->cycles / elapsed / 2e6);
+  fprintf(stderr, "Rendered %llu frames(1 in %d, renderer %s) in %.3f s, "
+          "%.1f%% of the run\n", (unsigned long long)rendered, skip,
+          video->kernel, rendering, 100.0 * rendering / elapsed);
+  if (pacer == NULL) {
+    fprintf(stderr, "Turbo: %.0f frames a second, %.1fx the speed of the "
+            "cabinet\n", frame / elapsed,
+            frame / elapsed * CYCLES_PER_FRAME / CPU_HZ);
+  }
+  if (dumper->prefix != NULL) {
+    fprintf(stderr, "Dumped %llu frames(%s) in %.3f s, %.1f%% of the run\n",
+            (unsigned long long)dumper->written, dumper->png ? "png" : "ppm",
+            dumper->seconds, 100.0 * dumper->seconds / elapsed);
+  }
+  if (pacer != NULL) {
+    ReportPacer(pacer, elapsed, cpu);
+  }
+
+  free(dumper->buffer);
+  dumper->buffer = NULL;
+  free(video);
+}
+
+/*
+ * Function: InitPacer
+ * -------------------
+ *  Sets up pacing at the speed of the cabinet, the first deadline is set
+ *  when the frames start
  *
- *  state: pointer to current state of machine
+ *  pacer: pacer to set up
+ *  spin: seconds spun instead of slept before each deadline
  *
- *  returns: 0 if instruction is processed
+ *  returns: void
  */
-int Emulator(States *state)
+void InitPacer(Pacer *pacer, double spin)
 {
-  uint8_t *opcode = &state->memory[state->pc];
-  Disassembler(state->memory, state->pc);
-
-  state->pc += 1;
-  switch(*opcode)
-  {
-    case 0x00: break;// NOP
-    case 0x01: // LXI B,D16
-        {
-          state->c = opcode[1];
-          state->b = opcode[2];
-          state-> pc += 2;//Advance by 2 bytes
-        } break;
-    case 0x02: IncompleteInstruction(state); break;
-    case 0x03: IncompleteInstruction(state); break;
-    case 0x04: IncompleteInstruction(state); break;
-    case 0x05: //DCR B
-        {
-          uint8_t answer = state->b - 1;
-          state->cc.z = (answer == 0);// If result is zero, set flag
-          state->cc.s = ((answer & 0x80) == 0x80);// If bit 7 is set, set sign flag
-          state->cc.p = Parity8b(answer);// Parity flag is set if even
-          state->b = answer;
-        } break;
-    case 0x06: // MVI B,D8
-        {
-          state->b = opcode[1];
-          state->pc++;
-        } break;
-    case 0x07: IncompleteInstruction(state); break;
-    case 0x08: IncompleteInstruction(state); break;
-    case 0x09: // DAD B
-        {
-          uint32_t rp = ((state->b)<< 8) | (state->c); // set B to MSByte
-          uint32_t hl = ((state->h)<< 8) | (state->l); // set H to MSByte
-          uint32_t answer = hl + rp; // Add HL + BC
-          state->cc.cy = (answer > 0xffff);
-          /* move MSByte to LSByte and clear upper half*/
-          state->h = ( (answer>>8) & 0xff);
-          state->l = (answer & 0xff); // Clear upper half
-        } break;
-    case 0x0a: IncompleteInstruction(state); break;
-    case 0x0b: IncompleteInstruction(state); break;
-    case 0x0c: IncompleteInstruction(state); break;
-    case 0x0d: // DCR C
-        {
-          uint8_t answer = state->c - 1;
-          state->cc.z = (answer == 0);
-          state->cc.s = ((answer & 0x80) == 0x80);
-          state->cc.p = Parity8b(answer);
-          state->c = answer;
-        } break;
-    case 0x0e: // MVI C,D8
-        {
-          state->c = opcode[1];
-          state->pc++;
-        } break;
-    case 0x0f: // RRC
-        {
-          uint8_t x = state->a;
-          state->a = ((x & 1) << 7) | (x >> 1);
-          state->cc.cy = (1 == (x&1));
-        }break;
-    case 0x10: IncompleteInstruction(state); break;
-    case 0x11: // LXI D,D16
-               state->e = opcode[1];
-               state->d = opcode[2];
-               state-> pc += 2;
-               break;
-    case 0x12: IncompleteInstruction(state); break;
-    case 0x13: // INX D
-        {
-          uint16_t rp = ((state->d) << 8) | (state->e);
-          uint16_t answer = rp + 1;
-          state->d = ((answer >> 8) & 0xff);
-          state->e = (answer & 0xff);
-        } break;
-    case 0x14: IncompleteInstruction(state); break;
-    case 0x15: IncompleteInstruction(state); break;
-    case 0x16: IncompleteInstruction(state); break;
-    case 0x17: IncompleteInstruction(state); break;
-    case 0x18: IncompleteInstruction(state); break;
-    case 0x19: // DAD D
-        {
-          uint32_t rp = ((state->d)<< 8) | (state->e);
-          uint32_t hl = ((state->h)<< 8) | (state->l);
-          uint32_t answer = hl + rp; // Add HL + DE
-          state->cc.cy = (answer > 0xffff);
-          state->h = ( (answer>>8) & 0xff);
-          state->l = (answer & 0xff);
-        } break;
-    case 0x1a: // LDAX D
-        {
-          uint16_t rp_addr = ((state->d) << 8) | (state->e);
-          state->a = state->memory[rp_addr];
-        }break;
-    case 0x1b: IncompleteInstruction(state); break;
-    case 0x1c: IncompleteInstruction(state); break;
-    case 0x1d: IncompleteInstruction(state); break;
-    case 0x1e: IncompleteInstruction(state); break;
-    case 0x1f: // RAR
-        {
-          uint8_t x = state->a;
-          state->a = ((state->cc.cy) << 7) | (x >> 1);
-          state->cc.cy = (1 == (x&1));
-        } break;
-    case 0x20: IncompleteInstruction(state); break;
-    case 0x21: // LXI H,D16
-        {
-          state->l = opcode[1];
-          state->h = opcode[2];
-          state-> pc += 2;
-        } break;
-    case 0x22: IncompleteInstruction(state); break;
-    case 0x23: // INX H
-        {
-          uint16_t rp = ((state->h) << 8) | (state->l);
-          uint16_t answer = rp + 1;
-          state->h = ((answer >> 8) & 0xff);
-          state->l = (answer & 0xff);
-        } break;
-    case 0x24: IncompleteInstruction(state); break;
-    case 0x25: IncompleteInstruction(state); break;
-    case 0x26: // MVI H,D8
-        {
-          state->h = opcode[1];
-          state->pc++;
-        } break;
-    case 0x27: IncompleteInstruction(state); break;
-    case 0x28: IncompleteInstruction(state); break;
-    case 0x29: // DAD H
-        {
-          uint16_t rp = ((state->h)<< 8) | (state->l);
-          uint16_t answer = rp + rp; // Add HL + HL
-          state->cc.cy = (answer > 0xffff);
-          state->h = ( (answer>>8) & 0xff);
-          state->l = (answer & 0xff);
-        } break;
-    case 0x2a: IncompleteInstruction(state); break;
-    case 0x2b: IncompleteInstruction(state); break;
-    case 0x2c: IncompleteInstruction(state); break;
-    case 0x2d: IncompleteInstruction(state); break;
-    case 0x2e: IncompleteInstruction(state); break;
-    case 0x2f: // CMA
-        {
-          state->a = ~state->a;
-        } break;
-    case 0x30: IncompleteInstruction(state); break;
-    case 0x31: // LXI SP,D16
-        {
-          state->sp = ((opcode[2] << 8) | opcode[1]);
-          state->pc += 2;
-        } break;
-    case 0x32: // STA addr
-        {
-          uint16_t addr = ((opcode[2] << 8) | opcode[1]); // Form address
-          state->memory[addr] = state->a; // Load Acc to addr location
-          state->pc += 2;
-        } break;
-    case 0x33: IncompleteInstruction(state); break;
-    case 0x34: IncompleteInstruction(state); break;
-    case 0x35: IncompleteInstruction(state); break;
-    case 0x36: // MVI M,D8
-        {
-          uint16_t addr = ((state->h) << 8) | (state->l);
-          state->memory[addr] = opcode[1];
-          state->pc++;
-        } break;
-    case 0x37: IncompleteInstruction(state); break;
-    case 0x38: IncompleteInstruction(state); break;
-    case 0x39: IncompleteInstruction(state); break;
-    case 0x3a: // LDA addr
-        {
-          uint16_t addr = ((opcode[2] << 8) | opcode[1]);
-          state->a = state->memory[addr];
-          state->pc +=2;
-        } break;
-    case 0x3b: IncompleteInstruction(state); break;
-    case 0x3c: IncompleteInstruction(state); break;
-    case 0x3d: IncompleteInstruction(state); break;
-    case 0x3e: // MVI A,D8
-        {
-          state->a = opcode[1];
-          state->pc++;
-        } break;
-    case 0x3f: IncompleteInstruction(state); break;
-    case 0x40: IncompleteInstruction(state); break;
-    case 0x41: // MOV B,C
-        {
-          state->b = state->c;
-        } break;
-    case 0x42: // MOV B,D
-        {
-          state->b = state->d;
-        } break;
-    case 0x43: // MOV B,E
-        {
-          state->b = state->e;
-        } break;
-    case 0x44: IncompleteInstruction(state); break;
-    case 0x45: IncompleteInstruction(state); break;
-    case 0x46: IncompleteInstruction(state); break;
-    case 0x47: IncompleteInstruction(state); break;
-    case 0x48: IncompleteInstruction(state); break;
-    case 0x49: IncompleteInstruction(state); break;
-    case 0x4a: IncompleteInstruction(state); break;
-    case 0x4b: IncompleteInstruction(state); break;
-    case 0x4c: IncompleteInstruction(state); break;
-    case 0x4d: IncompleteInstruction(state); break;
-    case 0x4e: IncompleteInstruction(state); break;
-    case 0x4f: IncompleteInstruction(state); break;
-    case 0x50: IncompleteInstruction(state); break;
-    case 0x51: IncompleteInstruction(state); break;
-    case 0x52: IncompleteInstruction(state); break;
-    case 0x53: IncompleteInstruction(state); break;
-    case 0x54: IncompleteInstruction(state); break;
-    case 0x55: IncompleteInstruction(state); break;
-    case 0x56: // MOV D,M
-        {
-          uint16_t addr = ((state->h) << 8) | (state->l);
-          state->d = state->memory[addr];
-        } break;
-    case 0x57: IncompleteInstruction(state); break;
-    case 0x58: IncompleteInstruction(state); break;
-    case 0x59: IncompleteInstruction(state); break;
-    case 0x5a: IncompleteInstruction(state); break;
-    case 0x5b: IncompleteInstruction(state); break;
-    case 0x5c: IncompleteInstruction(state); break;
-    case 0x5d: IncompleteInstruction(state); break;
-    case 0x5e: // MOV E,M
-        {
-          uint16_t addr = ((state->h) << 8) | (state->l);
-          state->e = state->memory[addr];
-        } break;
-    case 0x5f: IncompleteInstruction(state); break;
-    case 0x60: IncompleteInstruction(state); break;
-    case 0x61: IncompleteInstruction(state); break;
-    case 0x62: IncompleteInstruction(state); break;
-    case 0x63: IncompleteInstruction(state); break;
-    case 0x64: IncompleteInstruction(state); break;
-    case 0x65: IncompleteInstruction(state); break;
-    case 0x66: // MOV H,M
-        {
-          uint16_t addr = ((state->h) << 8) | (state->l);
-          state->h = state->memory[addr];
-        } break;
-    case 0x67: IncompleteInstruction(state); break;
-    case 0x68: IncompleteInstruction(state); break;
-    case 0x69: IncompleteInstruction(state); break;
-    case 0x6a: IncompleteInstruction(state); break;
-    case 0x6b: IncompleteInstruction(state); break;
-    case 0x6c: IncompleteInstruction(state); break;
-    case 0x6d: IncompleteInstruction(state); break;
-    case 0x6e: IncompleteInstruction(state); break;
-    case 0x6f: // MOV L,A
-        {
-          state->l = state->a;
-        } break;
-    case 0x70: IncompleteInstruction(state); break;
-    case 0x71: IncompleteInstruction(state); break;
-    case 0x72: IncompleteInstruction(state); break;
-    case 0x73: IncompleteInstruction(state); break;
-    case 0x74: IncompleteInstruction(state); break;
-    case 0x75: IncompleteInstruction(state); break;
-    case 0x76: IncompleteInstruction(state); break;
-    case 0x77: // MOV M,A
-        {
-          uint16_t addr = ((state->h) << 8) | (state->l);
-          state->memory[addr] = state->a;
-        } break;
-    case 0x78: IncompleteInstruction(state); break;
-    case 0x79: IncompleteInstruction(state); break;
-    case 0x7a: // MOV A,D
-        {
-          state->a = state->d;
-        } break;
-    case 0x7b: // MOV A,E
-        {
-          state->a = state->e;
-        } break;
-    case 0x7c: // MOV A,H
-        {
-          state->a = state->h;
-        } break;
-    case 0x7d: IncompleteInstruction(state); break;
-    case 0x7e: // MOV A,M
-        {
-          uint16_t addr = ((state->h) << 8) | (state->l);
-          state->a = state->memory[addr];
-        } break;
-    case 0x7f: IncompleteInstruction(state); break;
-    case 0x80: // ADD B
-        {
-          uint16_t answer = (uint16_t)state->a + (uint16_t)state->b;
-          state->cc.z = ((answer & 0xff) == 0);
-          state->cc.s = ((answer & 0x80) != 0);
-          state->cc.cy = (answer > 0xff);
-          state->cc.p = Parity16b(answer & 0xff);
-          state->a = answer & 0xff;
-        } break;
-    case 0x81: // ADD C
-        {
-          uint16_t answer = (uint16_t)state->a + (uint16_t)state->c;
-          state->cc.z = ((answer & 0xff) == 0);
-          state->cc.s = ((answer & 0x80) != 0);
-          state->cc.cy = (answer > 0xff);
-          state->cc.p = Parity16b(answer & 0xff);
-          state->a = answer & 0xff;
-        } break;
-    case 0x82: IncompleteInstruction(state); break;
-    case 0x83: IncompleteInstruction(state); break;
-    case 0x84: IncompleteInstruction(state); break;
-    case 0x85: IncompleteInstruction(state); break;
-    case 0x86: // ADD M
-        {
-          uint16_t offset = (state->h<<8) | (state->l);
-          uint16_t answer = (uint16_t)state->a +
-                            (uint16_t)state->memory[offset];
-          state->cc.z = ((answer & 0xff) == 0);
-          state->cc.s = ((answer & 0x80) != 0);
-          state->cc.cy = (answer > 0xff);
-          state->cc.p = Parity16b(answer & 0xff);
-          state->a = answer & 0xff;
-        } break;
-    case 0x87: IncompleteInstruction(state); break;
-    case 0x88: IncompleteInstruction(state); break;
-    case 0x89: IncompleteInstruction(state); break;
-    case 0x8a: IncompleteInstruction(state); break;
-    case 0x8b: IncompleteInstruction(state); break;
-    case 0x8c: IncompleteInstruction(state); break;
-    case 0x8d: IncompleteInstruction(state); break;
-    case 0x8e: IncompleteInstruction(state); break;
-    case 0x8f: IncompleteInstruction(state); break;
-    case 0x90: IncompleteInstruction(state); break;
-    case 0x91: IncompleteInstruction(state); break;
-    case 0x92: IncompleteInstruction(state); break;
-    case 0x93: IncompleteInstruction(state); break;
-    case 0x94: IncompleteInstruction(state); break;
-    case 0x95: IncompleteInstruction(state); break;
-    case 0x96: IncompleteInstruction(state); break;
-    case 0x97: IncompleteInstruction(state); break;
-    case 0x98: IncompleteInstruction(state); break;
-    case 0x99: IncompleteInstruction(state); break;
-    case 0x9a: IncompleteInstruction(state); break;
-    case 0x9b: IncompleteInstruction(state); break;
-    case 0x9c: IncompleteInstruction(state); break;
-    case 0x9d: IncompleteInstruction(state); break;
-    case 0x9e: IncompleteInstruction(state); break;
-    case 0x9f: IncompleteInstruction(state); break;
-    case 0xa0: IncompleteInstruction(state); break;
-    case 0xa1: IncompleteInstruction(state); break;
-    case 0xa2: IncompleteInstruction(state); break;
-    case 0xa3: IncompleteInstruction(state); break;
-    case 0xa4: IncompleteInstruction(state); break;
-    case 0xa5: IncompleteInstruction(state); break;
-    case 0xa6: IncompleteInstruction(state); break;
-    case 0xa7: // ANA A
-        {
-          uint8_t answer = (state->a) & (state->a); // A AND A
-          state->cc.z = (answer == 0);
-          state->cc.s = ((answer & 0x80) == 0x80);
-          state->cc.p = Parity8b(answer);
-          state->cc.cy = 0; // Cleared
-          state->a = answer;
-        } break;
-    case 0xa8: IncompleteInstruction(state); break;
-    case 0xa9: IncompleteInstruction(state); break;
-    case 0xaa: IncompleteInstruction(state); break;
-    case 0xab: IncompleteInstruction(state); break;
-    case 0xac: IncompleteInstruction(state); break;
-    case 0xad: IncompleteInstruction(state); break;
-    case 0xae: IncompleteInstruction(state); break;
-    case 0xaf: // XRA A
-        {
-          uint8_t answer = (state->a) ^ (state->a); // A XOR A
-          state->cc.z = (answer == 0);
-          state->cc.s = ((answer & 0x80) == 0x80);
-          state->cc.p = Parity8b(answer);
-          state->cc.cy = 0; // Cleared
-          state->cc.ac = 0; // Cleared
-          state->a = answer;
-        } break;
-    case 0xb0: IncompleteInstruction(state); break;
-    case 0xb1: IncompleteInstruction(state); break;
-    case 0xb2: IncompleteInstruction(state); break;
-    case 0xb3: IncompleteInstruction(state); break;
-    case 0xb4: IncompleteInstruction(state); break;
-    case 0xb5: IncompleteInstruction(state); break;
-    case 0xb6: IncompleteInstruction(state); break;
-    case 0xb7: IncompleteInstruction(state); break;
-    case 0xb8: IncompleteInstruction(state); break;
-    case 0xb9: IncompleteInstruction(state); break;
-    case 0xba: IncompleteInstruction(state); break;
-    case 0xbb: IncompleteInstruction(state); break;
-    case 0xbc: IncompleteInstruction(state); break;
-    case 0xbd: IncompleteInstruction(state); break;
-    case 0xbe: IncompleteInstruction(state); break;
-    case 0xbf: IncompleteInstruction(state); break;
-    case 0xc0: IncompleteInstruction(state); break;
-    case 0xc1: // POP B
-        {
-          state->c = state->memory[state->sp];
-          state->b = state->memory[state->sp+1];
-          state->sp += 2;
-        } break;
-    case 0xc2: // JNZ addr
-        {
-          if(state->cc.z == 0){
-            state->pc = (opcode[2] << 8) | opcode[1];
-          } else {
-            state->pc += 2;
-          }
-        } break;
-    case 0xc3: // JMP addr
-        {
-          state->pc = (opcode[2]<<8) | opcode[1];
-        } break;
-    case 0xc4: IncompleteInstruction(state); break;
-    case 0xc5: // PUSH B
-        {
-          state->memory[state->sp-1] = state->b;
-          state->memory[state->sp-2] = state->c;
-          state->sp = state->sp - 2;
-        } break;
-    case 0xc6: // ADI D8
-        {
-          uint16_t answer = (uint16_t)state->a + (uint16_t)opcode[1];
-          state->cc.z = ((answer & 0xff) == 0);
-          state->cc.s = ((answer & 0x80) != 0);
-          state->cc.cy = (answer > 0xff);
-          state->cc.p = Parity16b(answer & 0xff);
-          state->a = answer & 0xff;
-          state->pc++;
-        } break;
-    case 0xc7: IncompleteInstruction(state); break;
-    case 0xc8: IncompleteInstruction(state); break;
-    case 0xc9: // RET
-        {
-              state->pc = state->memory[state->sp] |
-                          (state->memory[state->sp+1]<<8);
-              state->sp += 2;
-        } break;
-    case 0xca: IncompleteInstruction(state); break;
-    case 0xcb: IncompleteInstruction(state); break;
-    case 0xcc: IncompleteInstruction(state); break;
-    case 0xcd: // CALL addr
-        {
-          uint16_t ret = state->pc+2;
-          state->memory[state->sp-1] = (ret>>8) & 0xff;
-          state->memory[state->sp-2] = (ret & 0xff);
-          state->sp = state->sp - 2;
-          state->pc = (opcode[2]<<8) | opcode[1];
-        } break;
-    case 0xce: IncompleteInstruction(state); break;
-    case 0xcf: IncompleteInstruction(state); break;
-    case 0xd0: IncompleteInstruction(state); break;
-    case 0xd1: // POP D
-        {
-          state->e = state->memory[state->sp];
-          state->d = state->memory[state->sp+1];
-          state->sp += 2;
-        } break;
-    case 0xd2: IncompleteInstruction(state); break;
-    case 0xd3: // OUT D8
-        {
-          // need to verify user manual
-          // state->a
-          state->pc++;
-        } break;
-    case 0xd4: IncompleteInstruction(state); break;
-    case 0xd5: // PUSH D
-        {
-          state->memory[state->sp-1] = state->d;
-          state->memory[state->sp-2] = state->e;
-          state->sp = state->sp - 2;
-        } break;
-    case 0xd6: IncompleteInstruction(state); break;
-    case 0xd7: IncompleteInstruction(state); break;
-    case 0xd8: IncompleteInstruction(state); break;
-    case 0xd9: IncompleteInstruction(state); break;
-    case 0xda: IncompleteInstruction(state); break;
-    case 0xdb: IncompleteInstruction(state); break;
-    case 0xdc: IncompleteInstruction(state); break;
-    case 0xdd: IncompleteInstruction(state); break;
-    case 0xde: IncompleteInstruction(state); break;
-    case 0xdf: IncompleteInstruction(state); break;
-    case 0xe0: IncompleteInstruction(state); break;
-    case 0xe1: // POP H
-        {
-          state->l = state->memory[state->sp];
-          state->h = state->memory[state->sp+1];
-          state->sp += 2;
-        } break;
-    case 0xe2: IncompleteInstruction(state); break;
-    case 0xe3: IncompleteInstruction(state); break;
-    case 0xe4: IncompleteInstruction(state); break;
-    case 0xe5: // PUSH H
-        {
-          state->memory[state->sp-1] = state->h;
-          state->memory[state->sp-2] = state->l;
-          state->sp = state->sp - 2;
-        } break;
-    case 0xe6: // ANI D8
-        {
-          uint8_t x = state->a & opcode[1];
-          state->cc.z = (x == 0);
-          state->cc.s = ((x & 0x80) == 0x80);
-          state->cc.p = Parity8b(x);
-          state->cc.cy = 0;
-          state->cc.ac = 0;
-          state->a = x;
-          state->pc++;
-        } break;
-    case 0xe7: IncompleteInstruction(state); break;
-    case 0xe8: IncompleteInstruction(state); break;
-    case 0xe9: IncompleteInstruction(state); break;
-    case 0xea: IncompleteInstruction(state); break;
-    case 0xeb: // XCHG
-        {
-          uint8_t rh_temp = state->h; // Temp for higher register
-          uint8_t rl_temp = state->l; // Temp for lower register
-          state->h = state->d; // Swap H for D
-          state->d = rh_temp;
-          state->l = state->e; // Swap L for E
-          state->e = rl_temp;
-        } break;
-    case 0xec: IncompleteInstruction(state); break;
-    case 0xed: IncompleteInstruction(state); break;
-    case 0xee: IncompleteInstruction(state); break;
-    case 0xef: IncompleteInstruction(state); break;
-    case 0xf0: IncompleteInstruction(state); break;
-    case 0xf1: // POP PSW
-        {
-          state->a = state->memory[state->sp+1];
-          uint8_t psw = state->memory[state->sp];
-          state->cc.z = ((psw & 0x01) == 0x01);
-          state->cc.s = ((psw & 0x02) == 0x02);
-          state->cc.p = ((psw & 0x04) == 0x04);
-          state->cc.cy = ((psw & 0x08) == 0x08);
-          state->cc.ac = ((psw & 0x10) == 0x10);
-          state->sp += 2;
-        } break;
-    case 0xf2: IncompleteInstruction(state); break;
-    case 0xf3: IncompleteInstruction(state); break;
-    case 0xf4: IncompleteInstruction(state); break;
-    case 0xf5: // PUSH PSW
-        {
-          state->memory[state->sp-1] = state->a;
-          uint8_t psw = (state->cc.z | state->cc.s << 1 | state->cc.p << 2|
-                         state->cc.cy << 3 | state->cc.ac << 4);
-          state->memory[state->sp-2] = psw;
-          state->sp = state->sp - 2;
-        } break;
-    case 0xf6: IncompleteInstruction(state); break;
-    case 0xf7: IncompleteInstruction(state); break;
-    case 0xf8: IncompleteInstruction(state); break;
-    case 0xf9: IncompleteInstruction(state); break;
-    case 0xfa: IncompleteInstruction(state); break;
-    case 0xfb: // EI
-        {
-          state->int_enable = 1;
-        } break;
-    case 0xfc: IncompleteInstruction(state); break;
-    case 0xfd: IncompleteInstruction(state); break;
-    case 0xfe: // CPI D8
-        {
-          uint8_t x = state->a - opcode[1];
-          state->cc.z = (x == 0);
-          state->cc.s = ((x & 0x80) == 0x80);
-          state->cc.p = Parity8b(x);
-          state->cc.cy = (state->a < opcode[1]);
-          state->pc++;
-        } break;
-    case 0xff: IncompleteInstruction(state); break;
+  memset(pacer, 0, sizeof(Pacer));
+  pacer->period = CYCLES_PER_FRAME / CPU_HZ;
+  pacer->spin = spin > 0 ? spin : 0;
+}
+
+/*
+ * Function: PaceFrame
+ * -------------------
+ *  Waits for the deadline of the frame just emulated: sleeps on the
+ *  monotonic clock until spin seconds before it, then spins, and records
+ *  how late it woke up. Deadlines are absolute so errors don't add up,
+ *  a host falling MAX_BEHIND frames behind starts over from now
+ *
+ *  pacer: pacer of the frames
+ *
+ *  returns: void
+ */
+void PaceFrame(Pacer *pacer)
+{
+  double now = Seconds();
+
+  if (now > pacer->deadline) {
+    pacer->late++;
+  }
+  else {
+    double sleep = pacer->deadline - pacer->spin;
+    if (sleep > now) {
+      struct timespec ts;
+      ts.tv_sec = (time_t)sleep;
+      ts.tv_nsec = (long)((sleep - ts.tv_sec) * 1e9);
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                             NULL) == EINTR) {
+      }
+    }
+    do {
+      now = Seconds();
+    } while (now < pacer->deadline);
+
+    double jitter = now - pacer->deadline;
+    int bucket = (int)(jitter / JITTER_BUCKET);
+    pacer->histogram[bucket < JITTER_BUCKETS ? bucket : JITTER_BUCKETS]++;
+    pacer->jitter_sum += jitter;
+    if (jitter > pacer->jitter_max) {
+      pacer->jitter_max = jitter;
+    }
+  }
+
+  pacer->frames++;
+  pacer->deadline += pacer->period;
+  if (now - pacer->deadline > MAX_BEHIND * pacer->period) {
+    pacer->deadline = now + pacer->period;
+    pacer->resyncs++;
   }
+}
+
+/*
+ * Function: ReportPacer
+ * ---------------------
+ *  Prints the frame rate kept, the jitter of the frame deadlines and the
+ *  host CPU time used
+ *
+ *  pacer: pacer of the frames
+ *  elapsed: wall clock time of the run
+ *  cpu: CPU time of the run
+ *
+ *  returns: void
+ */
+void ReportPacer(const Pacer *pacer, double elapsed, double cpu)
+{
+  uint64_t on_time = pacer->frames - pacer->late;
+
+  fprintf(stderr, "Paced %llu frames at %.3f Hz(cabinet %.3f Hz), "
+          "%llu late, %llu resyncs\n", (unsigned long long)pacer->frames,
+          pacer->frames / elapsed, 1 / pacer->period,
+          (unsigned long long)pacer->late,
+          (unsigned long long)pacer->resyncs);
+  if (on_time > 0) {
+    fprintf(stderr, "Jitter: mean %.1f us, 50%% under %.0f us, 99%% under "
+            "%.0f us, max %.1f us(spin %.0f us)\n",
+            pacer->jitter_sum / on_time * 1e6,
+            JitterPercentile(pacer, 0.5) * 1e6,
+            JitterPercentile(pacer, 0.99) * 1e6, pacer->jitter_max * 1e6,
+            pacer->spin * 1e6);
+  }
+  fprintf(stderr, "Host CPU: %.1f%% of one core\n", 100.0 * cpu / elapsed);
+}
+
+/*
+ * Function: JitterPercentile
+ * --------------------------
+ *  Reads a percentile of the wake up lateness from the histogram
+ *
+ *  pacer: pacer of the frames
+ *  percentile: fraction of the frames woken up at least this early(0-1)
+ *
+ *  returns: upper bound of the bucket holding the percentile, in seconds
+ */
+double JitterPercentile(const Pacer *pacer, double percentile)
+{
+  uint64_t total = 0;
+  uint64_t count = 0;
+
+  for (int i = 0; i <= JITTER_BUCKETS; i++) {
+    total += pacer->histogram[i];
+  }
+  for (int i = 0; i < JITTER_BUCKETS; i++) {
+    count += pacer->histogram[i];
+    if (count >= percentile * total) {
+      return (i + 1) * JITTER_BUCKET;
+    }
+  }
+  return pacer->jitter_max;
+}
+
+/*
+ * Function: DumpFrame
+ * -------------------
+ *  Writes the rendered screen into a file, unless the frame is skipped:
+ *  only every Nth frame is dumped, and with changed set only if the video
+ *  RAM differs from the last frame dumped(which costs no encoding)
+ *
+ *  dumper: where the frames go
+ *  video: screen rendered from memory
+ *  memory: 64 KB of the machine
+ *  frame: frame number, counted from 0
+ *
+ *  returns: 0 if the frame was written or skipped, -1 if it can't be written
+ */
+int DumpFrame(Dumper *dumper, Video *video, const uint8_t *memory,
+              uint64_t frame)
+{
+  const uint8_t *vram = memory + VRAM_START;
+  char filename[PATH_SIZE];
+  size_t size;
+
+  if (frame % dumper->every != 0) {
+    return 0;
+  }
+  if (dumper->changed && dumper->dumped &&
+      memcmp(dumper->vram, vram, VRAM_SIZE) == 0) {
+    return 0;
+  }
+  double start = Seconds();
+  memcpy(dumper->vram, vram, VRAM_SIZE);
+  dumper->dumped = 1;
+
+  if (dumper->png) {
+    size = EncodePng(video->frame, dumper->buffer);
+  }
+  else {
+    size = EncodePpm(video->frame, dumper->buffer);
+  }
+
+  snprintf(filename, sizeof(filename), "%s%06llu.%s", dumper->prefix,
+           (unsigned long long)frame, dumper->png ? "png" : "ppm");
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    return -1;
+  }
+  int error = fwrite(dumper->buffer, 1, size, fp) != size;
+  error |= fclose(fp) != 0;
+
+  dumper->written++;
+  dumper->seconds += Seconds() - start;
+  return error ? -1 : 0;
+}
+
+/*
+ * Function: EncodePpm
+ * -------------------
+ *  Encodes a frame as a binary PPM(P6) image
+ *
+ *  frame: colour indices of the screen
+ *  buffer: PPM_SIZE bytes receiving the file
+ *
+ *  returns: size of the file
+ */
+size_t EncodePpm(const uint8_t *frame, uint8_t *buffer)
+{
+  int header = sprintf((char *)buffer, "P6\n%d %d\n255\n", SCREEN_WIDTH,
+                       SCREEN_HEIGHT);
+  uint8_t *p = buffer + header;
+
+  for (int i = 0; i < SCREEN_PIXELS; i++) {
+    memcpy(p, palette[frame[i]], 3);
+    p += 3;
+  }
+  return p - buffer;
+}
+
+/*
+ * Function: EncodePng
+ * -------------------
+ *  Encodes a frame as a PNG image of 2 bit palette indices, the pixels
+ *  are stored without compression(deflate stored block) so encoding
+ *  costs little more than packing them
+ *
+ *  frame: colour indices of the screen
+ *  buffer: PNG_SIZE bytes receiving the file
+ *
+ *  returns: size of the file
+ */
+size_t EncodePng(const uint8_t *frame, uint8_t *buffer)
+{
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n',
+                                        0x1a, '\n' };
+  uint8_t *p = buffer;
+
+  memcpy(p, signature, 8);
+  p += 8;
+
+  /* Size, 2 bit depth, palette colour type, no interlace */
+  PutBig32(p + 8, SCREEN_WIDTH);
+  PutBig32(p + 12, SCREEN_HEIGHT);
+  memcpy(p + 16, "\x02\x03\x00\x00\x00", 5);
+  p += PngChunk(p, "IHDR", 13);
+
+  memcpy(p + 8, palette, COLOURS * 3);
+  p += PngChunk(p, "PLTE", COLOURS * 3);
+
+  /* zlib stream holding one stored deflate block */
+  uint8_t *data = p + 8;
+  data[0] = 0x78;
+  data[1] = 0x01;
+  data[2] = 0x01; // Last block, stored
+  data[3] = PNG_DATA & 0xff;
+  data[4] = PNG_DATA >> 8;
+  data[5] = ~PNG_DATA & 0xff;
+  data[6] = (~PNG_DATA >> 8) & 0xff;
+
+  uint8_t *row = data + 7;
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    const uint8_t *pixels = frame + y * SCREEN_WIDTH;
+    row[0] = 0; // No filter
+    for (int x = 0; x < SCREEN_WIDTH / 4; x++) {
+      row[1 + x] = pixels[4 * x] << 6 | pixels[4 * x + 1] << 4 |
+                   pixels[4 * x + 2] << 2 | pixels[4 * x + 3];
+    }
+    /* Adler-32 of the row, the sums can't overflow within a row */
+    for (int i = 0; i < PNG_ROW; i++) {
+      a += row[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    row += PNG_ROW;
+  }
+  PutBig32(row, b << 16 | a);
+  p += PngChunk(p, "IDAT", 7 + PNG_DATA + 4);
+
+  p += PngChunk(p, "IEND", 0);
+  return p - buffer;
+}
+
+/*
+ * Function: PngChunk
+ * ------------------
+ *  Completes a PNG chunk whose data is already in place
+ *
+ *  chunk: start of the chunk, its data begins 8 bytes further
+ *  type: 4 letter chunk type
+ *  size: size of the data
+ *
+ *  returns: size of the whole chunk
+ */
+size_t PngChunk(uint8_t *chunk, const char *type, uint32_t size)
+{
+  PutBig32(chunk, size);
+  memcpy(chunk + 4, type, 4);
+  PutBig32(chunk + 8 + size, Crc32(0, chunk + 4, 4 + size));
+  return 12 + size;
+}
+
+/*
+ * Function: Crc32
+ * ---------------
+ *  Updates the CRC-32 used by PNG(and zip), a table lookup per byte
+ *
+ *  crc: CRC of the data before, 0 to start
+ *  data: bytes to add
+ *  size: number of bytes
+ *
+ *  returns: CRC of all the data
+ */
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+  static uint32_t table[256];
+
+  if (table[1] == 0) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+  }
+
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/*
+ * Function: PutBig32
+ * ------------------
+ *  Stores a 32 bit value most significant byte first
+ *
+ *  p: 4 bytes receiving the value
+ *  value: value to store
+ *
+ *  returns: void
+ */
+void PutBig32(uint8_t *p, uint32_t value)
+{
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+/*
+ * Function: Seconds
+ * -----------------
+ *  Reads the monotonic clock
+ *
+ *  returns: current time in seconds
+ */
+double Seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Function: CpuSeconds
+ * --------------------
+ *  Reads the CPU time used by the process
+ *
+ *  returns: CPU time in seconds
+ */
+double CpuSeconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Function: TraceState
+ * --------------------
+ *  Trace sink printing an executed instruction,
+ *  followed by the condition flags and registers
+ *
+ *  state: state of Intel8080 machine
+ *  pc: location of the executed instruction
+ *
+ *  returns: void
+ */
+void TraceState(States *state, uint16_t pc)
+{
+  char text[I8080_TEXT_SIZE];
+  Disassemble(state->memory, pc, text);
+  printf("%04x %s\n", pc, text);
 
   // Print out condition flag content
   printf("C = %d\t"    "P = %d\t"   "S = %d\t"   "Z = %d\n",
@@ -1147,6 +1206,4 @@ int Emulator(States *state)
          state->h,
          state->l,
          state->sp);
-
-  return 0;
 }